@@ -1,6 +1,16 @@
 #include <systemc.h>
+#include "wave_tracer.h"
+#include <chrono>
+#include <string.h>
 using namespace std;
 #define NUM_COUNTERS 4
+#define CLOCK_PERIOD_NS 10
+
+// CLOCK_THREAD toggles clk from an SC_THREAD, CLOCK_SC_CLOCK uses an
+// sc_clock, CLOCK_CYCLE calls the rising-edge logic from one method
+// activation per cycle without any clock signal
+enum clock_mode { CLOCK_THREAD, CLOCK_SC_CLOCK, CLOCK_CYCLE };
+static const char *clock_mode_names[] = {"thread", "sc_clock", "cycle"};
 SC_MODULE(JK_FF)
 {
     sc_in<bool> j;
@@ -10,42 +20,68 @@ SC_MODULE(JK_FF)
     sc_in<bool> clk;
     sc_in<bool> reset;
     bool state = 0;
+    bool clocked = true;
+    void next_state()
+    {
+        if (j == 0 && k == 0)
+        {
+            // no change
+        }
+        if (j == 0 && k == 1)
+        {
+            state = 0;
+        }
+        if (j == 1 && k == 0)
+        {
+            state = 1;
+        }
+        if (j == 1 && k == 1)
+        {
+            state = !state;
+        }
+    }
+
     void handle_ff_state()
     {
         if (reset.read() == 1)
         {
             state = 0;
         }
-        else
+        else if (clk.posedge())
         {
-            if (clk.posedge())
-            {
-
-                if (j == 0 && k == 0)
-                {
-                    // no change
-                }
-                if (j == 0 && k == 1)
-                {
-                    state = 0;
-                }
-                if (j == 1 && k == 0)
-                {
-                    state = 1;
-                }
-                if (j == 1 && k == 1)
-                {
-                    state = !state;
-                }
-            }
+            next_state();
         }
         q.write(state);
         qn.write(!state);
     }
 
-    SC_CTOR(JK_FF)
+    // A rising edge without a clock signal (CLOCK_CYCLE). The caller's
+    // process then writes q, so handle_ff_state must not be registered as well.
+    void clock_edge()
+    {
+        if (reset.read() == 1)
+            state = 0;
+        else
+            next_state();
+        q.write(state);
+        qn.write(!state);
+    }
+
+    SC_CTOR(JK_FF) : j("j"), k("k"), q("q"), qn("qn"), clk("clk"), reset("reset")
     {
         state = 0;
+    }
+
+    // false when clock_edge drives the flip-flop instead; before sc_start
+    void set_clocked(bool enable)
+    {
+        clocked = enable;
+    }
+
+    void before_end_of_elaboration()
+    {
+        if (!clocked)
+            return;
         SC_METHOD(handle_ff_state);
         sensitive << clk.pos();
         sensitive << reset;
@@ -55,12 +91,12 @@ SC_MODULE(JK_FF)
 SC_MODULE(MOD10_COUNTER)
 {
     JK_FF *jk_ff[NUM_COUNTERS];
-    sc_signal<bool> j[NUM_COUNTERS];
-    sc_signal<bool> k[NUM_COUNTERS];
+    sc_vector<sc_signal<bool>> j;
+    sc_vector<sc_signal<bool>> k;
     sc_in<bool> clk;
     sc_in<bool> reset;
-    sc_signal<bool> q[NUM_COUNTERS];
-    sc_signal<bool> qn[NUM_COUNTERS];
+    sc_vector<sc_signal<bool>> q;
+    sc_vector<sc_signal<bool>> qn;
     sc_out<sc_uint<4>> count;
 
     void counter_logic()
@@ -79,7 +115,8 @@ SC_MODULE(MOD10_COUNTER)
         count.write(cnt);
     }
 
-    SC_CTOR(MOD10_COUNTER)
+    SC_CTOR(MOD10_COUNTER) : j("j", NUM_COUNTERS), k("k", NUM_COUNTERS), clk("clk"), reset("reset"),
+                             q("q", NUM_COUNTERS), qn("qn", NUM_COUNTERS), count("count")
     {
         for (int i = 0; i < NUM_COUNTERS; i++)
         {
@@ -100,6 +137,18 @@ SC_MODULE(MOD10_COUNTER)
         }
     }
 
+    void clock_edge()
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+            jk_ff[i]->clock_edge();
+    }
+
+    void set_clocked(bool enable)
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+            jk_ff[i]->set_clocked(enable);
+    }
+
     ~MOD10_COUNTER()
     {
         for (int i = 0; i < NUM_COUNTERS; i++)
@@ -115,40 +164,109 @@ SC_MODULE(Testbench)
     sc_signal<bool> clk;
     sc_signal<bool> reset;
     sc_signal<sc_uint<4>> count;
+    clock_mode clocking = CLOCK_THREAD;
+    sc_clock *sys_clock = NULL;
+    sc_signal_in_if<bool> *clock = &clk;
+    bool quiet = false;
 
     void generate_clock()
     {
         while(true){
             clk.write(0);
-            wait(5, SC_NS);
+            wait(CLOCK_PERIOD_NS / 2, SC_NS);
             clk.write(1);
-            wait(5, SC_NS);
+            wait(CLOCK_PERIOD_NS / 2, SC_NS);
         }
     }
 
+    // rising edges at the same times as generate_clock's
+    void run_cycles()
+    {
+        if (sc_time_stamp() != SC_ZERO_TIME)
+        {
+            mod10_cntr->clock_edge();
+            monitor();
+        }
+        next_trigger(sc_time_stamp() == SC_ZERO_TIME ? CLOCK_PERIOD_NS / 2 : CLOCK_PERIOD_NS, SC_NS);
+    }
+
     void monitor()
     {
-        cout << "Timestamp: " << sc_time_stamp() << " | Count: " << count.read() << endl;
+        if (!quiet)
+            cout << "Timestamp: " << sc_time_stamp() << " | Count: " << count.read() << endl;
     }
 
-    SC_CTOR(Testbench)
+    SC_CTOR(Testbench) : clk("clk"), reset("reset"), count("count")
     {
         mod10_cntr = new MOD10_COUNTER("mod_10_counter");
-        mod10_cntr->clk(clk);
         mod10_cntr->reset(reset);
         mod10_cntr->count(count);
-        SC_THREAD(generate_clock);
+    }
+
+    // before sc_start
+    bool set_clock_mode(const char *name)
+    {
+        for (int i = CLOCK_THREAD; i <= CLOCK_CYCLE; i++)
+            if (!strcmp(name, clock_mode_names[i]))
+            {
+                clocking = (clock_mode)i;
+                // run_cycles is then the only process writing the flip-flop outputs
+                mod10_cntr->set_clocked(clocking != CLOCK_CYCLE);
+                return true;
+            }
+        return false;
+    }
+
+    // the clock is chosen after construction, so it is bound here
+    void before_end_of_elaboration()
+    {
+        if (clocking == CLOCK_SC_CLOCK)
+        {
+            sys_clock = new sc_clock("sys_clock", CLOCK_PERIOD_NS, SC_NS, 0.5, CLOCK_PERIOD_NS / 2, SC_NS, true);
+            clock = sys_clock;
+        }
+        mod10_cntr->clk(*clock);
+        if (clocking == CLOCK_THREAD)
+            SC_THREAD(generate_clock);
+        else if (clocking == CLOCK_CYCLE)
+            SC_METHOD(run_cycles);
         SC_METHOD(monitor);
-        sensitive << clk.posedge_event();
+        sensitive << clock->posedge_event();
     }
+
     ~Testbench()
     {
         delete mod10_cntr;
+        delete sys_clock;
     }
 };
 
 int sc_main(int argc, char *argv[]) {
+    // m10counter.elf [-clock thread|sc_clock|cycle] [-cycles n] [-quiet] [-wave options]
+    // -quiet drops the per-cycle output and reports simulated cycles per second instead
     Testbench tb("tb");
-    sc_start(200, SC_NS);
+    WaveTracer waves("waves");
+    uint64_t cycles = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-clock") && i + 1 < argc)
+        {
+            if (!tb.set_clock_mode(argv[++i]))
+                cout << "Unknown clock mode " << argv[i] << ", using thread" << endl;
+        }
+        else if (!strcmp(argv[i], "-cycles") && i + 1 < argc)
+            cycles = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-quiet"))
+            tb.quiet = true;
+        else
+            waves.parse_option(argc, argv, i);
+    }
+    auto start = chrono::steady_clock::now();
+    sc_start((double)cycles * CLOCK_PERIOD_NS, SC_NS);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    waves.close();
+    if (tb.quiet)
+        cout << cycles << " cycles in " << elapsed.count() << " s, " << cycles / elapsed.count() / 1e6
+             << " Mcycles/s with the " << clock_mode_names[tb.clocking] << " clock" << endl;
     return 0;
 };
\ No newline at end of file
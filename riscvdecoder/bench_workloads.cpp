@@ -0,0 +1,124 @@
+#include "bench_workloads.h"
+#include "decode_table.h"
+#include "elf_parser.h"
+#include "rvc.h"
+#include <random>
+#include <string.h>
+
+#define BENCH_ADVERSARIAL_DEFS  16
+
+void bench_random_words(vector<uint32_t> &words, size_t n)
+{
+    mt19937 rng(1);
+    words.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t word = rng() | 0x3;
+        if (i % 8)
+        {
+            instr_def idef = instr_defs[rng() % MAX_INSTR];
+            word = (word & ~idef.instruction_mask) | idef.instruction_match;
+        }
+        words[i] = word;
+    }
+}
+
+void bench_adversarial_words(vector<uint32_t> &words, size_t n)
+{
+    mt19937 rng(2);
+    words.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        instr_def idef = instr_defs[MAX_INSTR - 1 - rng() % BENCH_ADVERSARIAL_DEFS];
+        uint32_t word = (rng() & ~idef.instruction_mask) | idef.instruction_match;
+        uint32_t free_bits = idef.instruction_mask & ~(DECODE_PRIMARY_MASK | DECODE_FUNCT7_MASK);
+        if ((i & 1) && free_bits)
+        {
+            // flip one bit the slot selection does not look at
+            uint32_t bit;
+            do
+                bit = 1u << (rng() % 32);
+            while (!(bit & free_bits));
+            if (rv_decode_table.lookup(word ^ bit) < 0)
+                word ^= bit;
+        }
+        words[i] = word;
+    }
+}
+
+bool bench_elf_words(const char *elf_file, vector<uint32_t> &words, size_t n)
+{
+    FILE *probe = fopen(elf_file, "rb");
+    if (probe == NULL)
+        return false;
+    fclose(probe);
+    uint8_t *mem = NULL;
+    uint32_t total_mem_size = 0;
+    uint32_t start_addr = 0;
+    ELFParser elf_parser(elf_file, &start_addr, &mem, &total_mem_size, false);
+    if (mem == NULL)
+        return false;
+    vector<uint32_t> text;
+    const vector<region> &regions = elf_parser.regmgr.get_regions();
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        if (!(reg_val->region_flags & SHF_EXECINSTR))
+            continue;
+        const uint8_t *base = mem + reg_val->region_base;
+        uint32_t offset = 0;
+        while (offset + 2 <= reg_val->region_size)
+        {
+            uint16_t half;
+            uint32_t word;
+            memcpy(&half, base + offset, 2);
+            if (RVC_IS_COMPRESSED(half))
+            {
+                word = rvc_expand(half);
+                offset += 2;
+                if (word == 0)
+                    continue;
+            }
+            else
+            {
+                if (offset + 4 > reg_val->region_size)
+                    break;
+                memcpy(&word, base + offset, 4);
+                offset += 4;
+            }
+            text.push_back(word);
+        }
+    }
+    delete[] mem;
+    if (text.empty())
+        return false;
+    words.resize(n);
+    for (size_t i = 0; i < n; i++)
+        words[i] = text[i % text.size()];
+    return true;
+}
+
+bool bench_workload(const char *name, const char *elf_file, vector<uint32_t> &words, size_t n)
+{
+    if (!strcmp(name, "random"))
+        bench_random_words(words, n);
+    else if (!strcmp(name, "adversarial"))
+        bench_adversarial_words(words, n);
+    else if (!strcmp(name, "elf"))
+        return bench_elf_words(elf_file, words, n);
+    else
+        return false;
+    return true;
+}
+
+void bench_record(const char *results_file, const char *path, const char *workload, uint64_t insns, double seconds)
+{
+    FILE *out = fopen(results_file, "a");
+    if (out == NULL)
+        return;
+    fseek(out, 0, SEEK_END);
+    if (ftell(out) == 0)
+        fprintf(out, "path,workload,instructions,seconds,minstr_per_s\n");
+    fprintf(out, "%s,%s,%llu,%.6f,%.3f\n", path, workload, (unsigned long long)insns, seconds,
+            seconds > 0 ? insns / seconds / 1e6 : 0.0);
+    fclose(out);
+}
@@ -0,0 +1,29 @@
+#ifndef __BENCH_WORKLOADS__
+#define __BENCH_WORKLOADS__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+using namespace std;
+
+//--------------------------------------------------------------------
+// Instruction word sets shared by decode_bench (native paths) and
+// decode_bench_sc (RV_DECODER driven by the Testbench). All words are
+// 32-bit encodings; RVC text is expanded when loaded.
+//--------------------------------------------------------------------
+#define BENCH_WORDS             (1 << 20)
+#define BENCH_DEFAULT_ELF       "elfs/linux.elf"
+#define BENCH_DEFAULT_RESULTS   "decode_bench.csv"
+
+// random valid encodings, one in eight words random apart from the length bits
+void bench_random_words(vector<uint32_t> &words, size_t n);
+// last instr_defs entries plus near misses that pass the primary and
+// funct7 selection but fail every candidate
+void bench_adversarial_words(vector<uint32_t> &words, size_t n);
+// the executable sections of an ELF, repeated up to n words; false if unreadable
+bool bench_elf_words(const char *elf_file, vector<uint32_t> &words, size_t n);
+bool bench_workload(const char *name, const char *elf_file, vector<uint32_t> &words, size_t n);
+
+// Appends "path,workload,instructions,seconds,minstr_per_s" to a CSV
+// file, writing the header when the file is new.
+void bench_record(const char *results_file, const char *path, const char *workload, uint64_t insns, double seconds);
+#endif
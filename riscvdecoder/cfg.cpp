@@ -0,0 +1,174 @@
+#include "cfg.h"
+#include "rvc.h"
+#include <algorithm>
+
+#define CFG_OPCODE(x)       ((x) & 0x7f)
+#define CFG_OPCODE_JAL      0x6f
+#define CFG_OPCODE_JALR     0x67
+
+static bool region_by_addr(const region *a, const region *b)
+{
+    return a->start_addr < b->start_addr;
+}
+
+void ControlFlowGraph::build(const uint8_t *mem, const vector<region> &regions)
+{
+    addrs.clear();
+    words.clear();
+    lengths.clear();
+    blocks.clear();
+    succs.clear();
+
+    // linear sweep of the executable sections in address order
+    vector<const region *> text;
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+        if (reg_val->region_flags & SHF_EXECINSTR)
+            text.push_back(&*reg_val);
+    sort(text.begin(), text.end(), region_by_addr);
+    vector<uint32_t> section_first;
+    for (auto reg_val = text.begin(); reg_val != text.end(); reg_val++)
+    {
+        const uint8_t *base = mem + (*reg_val)->region_base;
+        uint32_t offset = 0;
+        section_first.push_back(addrs.size());
+        while (offset + 2 <= (*reg_val)->region_size)
+        {
+            uint16_t half;
+            uint32_t word;
+            uint32_t len = 4;
+            memcpy(&half, base + offset, 2);
+            if (RVC_IS_COMPRESSED(half))
+            {
+                word = rvc_expand(half);
+                len = 2;
+            }
+            else if (offset + 4 <= (*reg_val)->region_size)
+                memcpy(&word, base + offset, 4);
+            else
+                break;
+            addrs.push_back((*reg_val)->start_addr + offset);
+            words.push_back(word);
+            lengths.push_back(len);
+            offset += len;
+        }
+    }
+    uint32_t insn_count = addrs.size();
+    decode_block(words.data(), insn_count, decoded);
+
+    // leaders
+    vector<uint8_t> leader(insn_count + 1, 0);
+    for (auto first = section_first.begin(); first != section_first.end(); first++)
+        leader[*first] = 1;
+    for (uint32_t i = 0; i < insn_count; i++)
+    {
+        uint32_t word = words[i];
+        if (decoded.opcode_id[i] < 0)
+        {
+            leader[i + 1] = 1;
+            continue;
+        }
+        if (!IS_BRANCH_INST(word))
+            continue;
+        leader[i + 1] = 1;
+        uint32_t target = CFG_NO_BLOCK;
+        if (IS_COND_BRANCH_2RI_INST(word))
+            target = insn_at(addrs[i] + OPCODE_SBTYPE_IMM(word));
+        else if (CFG_OPCODE(word) == CFG_OPCODE_JAL)
+            target = insn_at(addrs[i] + OPCODE_UJTYPE_IMM(word));
+        if (target != CFG_NO_BLOCK)
+            leader[target] = 1;
+    }
+
+    // blocks
+    for (uint32_t i = 0; i < insn_count; i++)
+    {
+        if (leader[i] || blocks.empty())
+            blocks.push_back({addrs[i], 0, i, 0, 0, 0, 0});
+        cfg_block &block = blocks.back();
+        block.insn_count++;
+        block.end_addr = addrs[i] + lengths[i];
+    }
+
+    // successors, taken edge first
+    for (auto block = blocks.begin(); block != blocks.end(); block++)
+    {
+        uint32_t last = block->first_insn + block->insn_count - 1;
+        uint32_t word = words[last];
+        uint32_t rd = (word & OPCODE_RD_MASK) >> OPCODE_RD_SHIFT;
+        bool falls_through = true;
+        block->succ_first = succs.size();
+        if (decoded.opcode_id[last] < 0)
+        {
+            block->flags = CFG_BLOCK_ILLEGAL;
+            falls_through = false;
+        }
+        else if (IS_COND_BRANCH_2RI_INST(word))
+        {
+            block->flags = CFG_BLOCK_COND_BRANCH;
+            add_edge(*block, addrs[last] + OPCODE_SBTYPE_IMM(word));
+        }
+        else if (CFG_OPCODE(word) == CFG_OPCODE_JAL)
+        {
+            block->flags = CFG_BLOCK_JUMP | (rd ? CFG_BLOCK_CALL : 0);
+            add_edge(*block, addrs[last] + OPCODE_UJTYPE_IMM(word));
+            falls_through = rd != 0;
+        }
+        else if (CFG_OPCODE(word) == CFG_OPCODE_JALR)
+        {
+            block->flags = CFG_BLOCK_INDIRECT | (rd ? CFG_BLOCK_CALL : 0);
+            falls_through = rd != 0;
+        }
+        else if (IS_BRANCH_INST(word))
+        {
+            block->flags = CFG_BLOCK_TRAP;
+            falls_through = (word & INST_MRET_MASK) != INST_MRET;
+        }
+        else
+            block->flags = CFG_BLOCK_FALLTHROUGH;
+        // no fall-through edge off the end of a section
+        if (falls_through && last + 1 < insn_count && addrs[last + 1] == block->end_addr)
+            add_edge(*block, block->end_addr);
+    }
+}
+
+void ControlFlowGraph::add_edge(cfg_block &block, uint32_t target_addr)
+{
+    uint32_t target = block_at(target_addr);
+    if (target == CFG_NO_BLOCK)
+    {
+        block.flags |= CFG_BLOCK_EXTERNAL;
+        return;
+    }
+    succs.push_back(target);
+    block.succ_count++;
+}
+
+uint32_t ControlFlowGraph::insn_at(uint32_t addr) const
+{
+    auto it = lower_bound(addrs.begin(), addrs.end(), addr);
+    if (it == addrs.end() || *it != addr)
+        return CFG_NO_BLOCK;
+    return it - addrs.begin();
+}
+
+uint32_t ControlFlowGraph::block_at(uint32_t addr) const
+{
+    auto it = lower_bound(blocks.begin(), blocks.end(), addr,
+                          [](const cfg_block &block, uint32_t a) { return block.start_addr < a; });
+    if (it == blocks.end() || it->start_addr != addr)
+        return CFG_NO_BLOCK;
+    return it - blocks.begin();
+}
+
+bool ControlFlowGraph::write(const char *file) const
+{
+    FILE *out = fopen(file, "wb");
+    if (out == NULL)
+        return false;
+    cfg_file_header header = {CFG_FILE_MAGIC, CFG_FILE_VER, (uint32_t)blocks.size(), (uint32_t)succs.size(),
+                              (uint32_t)addrs.size()};
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(blocks.data(), sizeof(cfg_block), blocks.size(), out) == blocks.size();
+    ok = ok && fwrite(succs.data(), sizeof(uint32_t), succs.size(), out) == succs.size();
+    return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,67 @@
+#ifndef __CFG__
+#define __CFG__
+#include <stdint.h>
+#include <vector>
+#include "elf_parser.h"
+#include "decode_block.h"
+using namespace std;
+
+//--------------------------------------------------------------------
+// Basic blocks and control-flow graph over the executable sections of
+// a loaded image. Leaders are section starts, direct branch/jump
+// targets and the instruction after any IS_BRANCH_INST; successors are
+// stored as one flat array indexed from each block (CSR layout).
+//--------------------------------------------------------------------
+#define CFG_NO_BLOCK        0xffffffff
+#define CFG_FILE_MAGIC      0x46435652  // "RVCF"
+#define CFG_FILE_VER        1
+
+// how a block ends
+#define CFG_BLOCK_FALLTHROUGH   0x01    // next instruction is a leader
+#define CFG_BLOCK_COND_BRANCH   0x02
+#define CFG_BLOCK_JUMP          0x04    // jal
+#define CFG_BLOCK_INDIRECT      0x08    // jalr, target unknown statically
+#define CFG_BLOCK_CALL          0x10    // jal/jalr with rd != x0, return edge to the next block
+#define CFG_BLOCK_TRAP          0x20    // ecall, ebreak, mret
+#define CFG_BLOCK_ILLEGAL       0x40    // unknown encoding
+#define CFG_BLOCK_EXTERNAL      0x80    // a direct target lies outside the text
+
+typedef struct {
+    uint32_t start_addr;
+    uint32_t end_addr;      // address after the last instruction
+    uint32_t first_insn;    // index into the per-instruction arrays
+    uint32_t insn_count;
+    uint32_t succ_first;    // index into succs
+    uint16_t succ_count;
+    uint16_t flags;         // CFG_BLOCK_*
+}cfg_block;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_count;
+    uint32_t edge_count;
+    uint32_t insn_count;
+}cfg_file_header;
+
+class ControlFlowGraph
+{
+public:
+    // per instruction, in address order; RVC encodings are expanded in words
+    vector<uint32_t> addrs;
+    vector<uint32_t> words;
+    vector<uint8_t> lengths;
+    DecodedSoA decoded;
+
+    vector<cfg_block> blocks;
+    vector<uint32_t> succs;     // block indices
+
+    void build(const uint8_t *mem, const vector<region> &regions);
+    uint32_t block_at(uint32_t addr) const;     // block starting at addr, or CFG_NO_BLOCK
+    uint32_t insn_at(uint32_t addr) const;      // instruction at addr, or CFG_NO_BLOCK
+    // header, blocks, then succs; false on I/O error
+    bool write(const char *file) const;
+protected:
+    void add_edge(cfg_block &block, uint32_t target_addr);
+};
+#endif
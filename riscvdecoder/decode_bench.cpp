@@ -0,0 +1,124 @@
+// Native decode throughput. Each workload from bench_workloads runs
+// through the instr_defs scan, the decode table and decode_block; the
+// numbers are printed and appended to a CSV file.
+//   decode_bench.elf [-elf file.elf] [-o results.csv]
+#include "decode_table.h"
+#include "decode_block.h"
+#include "bench_workloads.h"
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <string.h>
+
+#define BENCH_ROUNDS    20
+
+// reference decoder: full scan of instr_defs, last match wins
+static int scan_decode(uint32_t opcode_val)
+{
+    int opcode_id = -1;
+    for (int i = 0; i < MAX_INSTR; i++)
+    {
+        instr_def idef = instr_defs[i];
+        if ((opcode_val & idef.instruction_mask) == idef.instruction_match)
+            opcode_id = i;
+    }
+    return opcode_id;
+}
+
+static bool same_soa(const DecodedSoA &a, const DecodedSoA &b)
+{
+    return a.opcode_id == b.opcode_id && a.rd == b.rd && a.rs1 == b.rs1 && a.rs2 == b.rs2 &&
+           a.shamt == b.shamt && a.itype_imm == b.itype_imm && a.stype_imm == b.stype_imm &&
+           a.sbtype_imm == b.sbtype_imm && a.utype_imm == b.utype_imm && a.ujtype_imm == b.ujtype_imm;
+}
+
+template <typename F>
+static double run_block_bench(const vector<uint32_t> &words, F decode, DecodedSoA &out)
+{
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+        decode(words.data(), words.size(), out);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template <typename F>
+static double run_bench(const vector<uint32_t> &words, F decode, uint64_t *checksum)
+{
+    auto start = chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+        for (size_t i = 0; i < words.size(); i++)
+            sum += decode(words[i]);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    *checksum = sum;
+    return elapsed.count();
+}
+
+static void report(const char *results_file, const char *path, const char *workload, uint64_t insns, double seconds)
+{
+    cout << "  " << path << ": " << insns / seconds / 1e6 << " Minstr/s" << endl;
+    bench_record(results_file, path, workload, insns, seconds);
+}
+
+static bool bench_words(const char *workload, const vector<uint32_t> &words, const char *results_file)
+{
+    const DecodeTable &decode_table = rv_decode_table;
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        if (decode_table.lookup(words[i]) != scan_decode(words[i]))
+        {
+            cout << "Mismatch for word " << hex << words[i] << dec << ": table " << decode_table.lookup(words[i])
+                 << ", scan " << scan_decode(words[i]) << endl;
+            return false;
+        }
+    }
+    uint64_t insns = (uint64_t)words.size() * BENCH_ROUNDS;
+    uint64_t scan_sum, table_sum;
+    cout << workload << ":" << endl;
+    report(results_file, "scan", workload, insns, run_bench(words, scan_decode, &scan_sum));
+    report(results_file, "table", workload, insns,
+           run_bench(words, [&](uint32_t w) { return decode_table.lookup(w); }, &table_sum));
+    if (scan_sum != table_sum)
+        return false;
+
+    DecodedSoA block_out, scalar_out;
+    double scalar_time = run_block_bench(words, decode_block_scalar, scalar_out);
+    double block_time = run_block_bench(words, decode_block, block_out);
+    if (!same_soa(block_out, scalar_out))
+    {
+        cout << "Mismatch between decode_block (" << decode_block_isa() << ") and scalar decode" << endl;
+        return false;
+    }
+    report(results_file, "block_scalar", workload, insns, scalar_time);
+    report(results_file, (string("block_") + decode_block_isa()).c_str(), workload, insns, block_time);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *elf_file = BENCH_DEFAULT_ELF;
+    const char *results_file = BENCH_DEFAULT_RESULTS;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], "-elf"))
+            elf_file = argv[++i];
+        else if (!strcmp(argv[i], "-o"))
+            results_file = argv[++i];
+    }
+    rv_decode_table.print_table_info();
+
+    const char *workloads[] = {"random", "elf", "adversarial"};
+    for (const char *workload : workloads)
+    {
+        vector<uint32_t> words;
+        if (!bench_workload(workload, elf_file, words, BENCH_WORDS))
+        {
+            cout << workload << ": skipped, unable to load " << elf_file << endl;
+            continue;
+        }
+        if (!bench_words(workload, words, results_file))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Decode throughput of RV_DECODER driven by the Testbench, with the
+// per-instruction trace off, so the result is kernel plus decode cost.
+// One path per run since ports are bound at elaboration; the pin paths
+// also report simulated clock cycles per host second for the clock mode:
+//   decode_bench_sc.elf [-tlm | -packed] [-clock thread|sc_clock|cycle] [-workload random|elf|adversarial]
+//                       [-elf file.elf] [-o results.csv]
+#include <systemc.h>
+#include "testbench.h"
+#include "bench_workloads.h"
+#include <chrono>
+#include <string.h>
+
+#define BENCH_SC_WORDS  (1 << 18)
+
+int sc_main(int argc, char *argv[])
+{
+    const char *workload = "random";
+    const char *elf_file = BENCH_DEFAULT_ELF;
+    const char *results_file = BENCH_DEFAULT_RESULTS;
+    string path = "sc_pins";
+    clock_mode clocking = CLOCK_THREAD;
+    Testbench tb("tb");
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-tlm"))
+        {
+            tb.set_tlm_mode(true);
+            path = "sc_tlm";
+        }
+        else if (!strcmp(argv[i], "-packed"))
+        {
+            tb.set_packed_output();
+            path = "sc_packed";
+        }
+        else if (!strcmp(argv[i], "-clock") && i + 1 < argc)
+        {
+            if (!clock_mode_by_name(argv[++i], &clocking))
+            {
+                cout << "Unknown clock mode " << argv[i] << endl;
+                return 1;
+            }
+            tb.set_clock_mode(clocking);
+        }
+        else if (!strcmp(argv[i], "-workload") && i + 1 < argc)
+            workload = argv[++i];
+        else if (!strcmp(argv[i], "-elf") && i + 1 < argc)
+            elf_file = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            results_file = argv[++i];
+    }
+
+    vector<uint32_t> words;
+    if (!bench_workload(workload, elf_file, words, BENCH_SC_WORDS))
+    {
+        cout << workload << ": skipped, unable to load " << elf_file << endl;
+        return 0;
+    }
+    tb.set_verbose(false);
+    tb.init_mem((uint8_t *)words.data(), 0, words.size() * 4);
+    tlm::tlm_global_quantum::instance().set(sc_time(FETCH_QUANTUM_NS, SC_NS));
+
+    auto start = chrono::steady_clock::now();
+    if (tb.tlm_mode)
+        sc_start();
+    else
+        sc_start(10.0 * words.size(), SC_NS);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    // the pin paths are recorded per clock mode, e.g. sc_pins_cycle
+    if (!tb.tlm_mode && clocking != CLOCK_THREAD)
+        path = path + "_" + clock_mode_names[clocking];
+    cout << path << " " << workload << ": " << tb.fetched / elapsed.count() / 1e6 << " Minstr/s";
+    if (!tb.tlm_mode)
+        cout << ", " << sc_time_stamp().to_seconds() * 1e9 / CLOCK_PERIOD_NS / elapsed.count() / 1e6 << " Mcycles/s";
+    cout << endl;
+    bench_record(results_file, path.c_str(), workload, tb.fetched, elapsed.count());
+    return 0;
+}
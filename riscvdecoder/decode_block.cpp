@@ -0,0 +1,168 @@
+#include "decode_block.h"
+#include "decode_table.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DECODE_BLOCK_X86
+#endif
+
+void DecodedSoA::resize(size_t n)
+{
+    count = n;
+    opcode_id.resize(n);
+    rd.resize(n);
+    rs1.resize(n);
+    rs2.resize(n);
+    shamt.resize(n);
+    itype_imm.resize(n);
+    stype_imm.resize(n);
+    sbtype_imm.resize(n);
+    utype_imm.resize(n);
+    ujtype_imm.resize(n);
+}
+
+static void decode_fields_scalar(const uint32_t *words, size_t first, size_t last, DecodedSoA &out)
+{
+    for (size_t i = first; i < last; i++)
+    {
+        uint32_t x = words[i];
+        out.rd[i] = (x & OPCODE_RD_MASK) >> OPCODE_RD_SHIFT;
+        out.rs1[i] = (x & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
+        out.rs2[i] = (x & OPCODE_RS2_MASK) >> OPCODE_RS2_SHIFT;
+        out.shamt[i] = (x & OPCODE_SHAMT_MASK) >> OPCODE_SHAMT_SHIFT;
+        out.itype_imm[i] = OPCODE_ITYPE_IMM(x);
+        out.stype_imm[i] = OPCODE_STYPE_IMM(x);
+        out.sbtype_imm[i] = OPCODE_SBTYPE_IMM(x);
+        out.utype_imm[i] = OPCODE_UTYPE_IMM(x);
+        out.ujtype_imm[i] = OPCODE_UJTYPE_IMM(x);
+    }
+}
+
+static void decode_opcodes(const uint32_t *words, size_t n, DecodedSoA &out)
+{
+    for (size_t i = 0; i < n; i++)
+        out.opcode_id[i] = rv_decode_table.lookup(words[i]);
+}
+
+#ifdef DECODE_BLOCK_X86
+//--------------------------------------------------------------------
+// SIMD field extraction. The body is written once against the V* ops
+// and instantiated for SSE2 and AVX2. Sign handling uses arithmetic
+// shifts, which reproduce the OPCODE_IMM_SIGN terms of the macros.
+//--------------------------------------------------------------------
+#define VFIELD(x, s, n)     VAND(VSRL(x, s), VSET1((1 << (n)) - 1))
+#define VSIGN(x)            VSRA(x, 31)
+
+#define DECODE_FIELDS_SIMD_BODY(width)                                                          \
+    size_t i = 0;                                                                               \
+    for (; i + (width) <= n; i += (width))                                                      \
+    {                                                                                           \
+        VTYPE x = VLOAD(words + i);                                                             \
+        VTYPE sign = VSIGN(x);                                                                  \
+        VSTORE(&out.rd[i], VFIELD(x, OPCODE_RD_SHIFT, 5));                                      \
+        VSTORE(&out.rs1[i], VFIELD(x, OPCODE_RS1_SHIFT, 5));                                    \
+        VSTORE(&out.rs2[i], VFIELD(x, OPCODE_RS2_SHIFT, 5));                                    \
+        VSTORE(&out.shamt[i], VFIELD(x, OPCODE_SHAMT_SHIFT, 6));                                \
+        VSTORE(&out.itype_imm[i], VSRA(x, 20));                                                 \
+        VSTORE(&out.stype_imm[i], VOR(VSLL(VSRA(x, 25), 5), VFIELD(x, 7, 5)));                  \
+        VSTORE(&out.sbtype_imm[i], VOR(VOR(VSLL(VFIELD(x, 8, 4), 1), VSLL(VFIELD(x, 25, 6), 5)), \
+                                       VOR(VSLL(VFIELD(x, 7, 1), 11), VSLL(sign, 12))));         \
+        VSTORE(&out.utype_imm[i], VSRA(x, 12));                                                 \
+        VSTORE(&out.ujtype_imm[i], VOR(VOR(VSLL(VFIELD(x, 21, 10), 1), VSLL(VFIELD(x, 20, 1), 11)), \
+                                       VOR(VSLL(VFIELD(x, 12, 8), 12), VSLL(sign, 20))));        \
+    }                                                                                           \
+    decode_fields_scalar(words, i, n, out);
+
+#define VTYPE           __m128i
+#define VLOAD(p)        _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE(p, v)    _mm_storeu_si128((__m128i *)(p), v)
+#define VSET1(a)        _mm_set1_epi32(a)
+#define VAND(a, b)      _mm_and_si128(a, b)
+#define VOR(a, b)       _mm_or_si128(a, b)
+#define VSLL(a, s)      _mm_slli_epi32(a, s)
+#define VSRL(a, s)      _mm_srli_epi32(a, s)
+#define VSRA(a, s)      _mm_srai_epi32(a, s)
+__attribute__((target("sse2"))) static void decode_fields_sse2(const uint32_t *words, size_t n, DecodedSoA &out)
+{
+    DECODE_FIELDS_SIMD_BODY(4)
+}
+#undef VTYPE
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VAND
+#undef VOR
+#undef VSLL
+#undef VSRL
+#undef VSRA
+
+#define VTYPE           __m256i
+#define VLOAD(p)        _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p, v)    _mm256_storeu_si256((__m256i *)(p), v)
+#define VSET1(a)        _mm256_set1_epi32(a)
+#define VAND(a, b)      _mm256_and_si256(a, b)
+#define VOR(a, b)       _mm256_or_si256(a, b)
+#define VSLL(a, s)      _mm256_slli_epi32(a, s)
+#define VSRL(a, s)      _mm256_srli_epi32(a, s)
+#define VSRA(a, s)      _mm256_srai_epi32(a, s)
+__attribute__((target("avx2"))) static void decode_fields_avx2(const uint32_t *words, size_t n, DecodedSoA &out)
+{
+    DECODE_FIELDS_SIMD_BODY(8)
+}
+#undef VTYPE
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VAND
+#undef VOR
+#undef VSLL
+#undef VSRL
+#undef VSRA
+#endif
+
+typedef void (*decode_fields_fn)(const uint32_t *words, size_t n, DecodedSoA &out);
+
+static void decode_fields_fallback(const uint32_t *words, size_t n, DecodedSoA &out)
+{
+    decode_fields_scalar(words, 0, n, out);
+}
+
+static decode_fields_fn select_decode_fields(const char **isa_name)
+{
+#ifdef DECODE_BLOCK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *isa_name = "avx2";
+        return decode_fields_avx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        *isa_name = "sse2";
+        return decode_fields_sse2;
+    }
+#endif
+    *isa_name = "scalar";
+    return decode_fields_fallback;
+}
+
+static const char *decode_fields_isa = "";
+static decode_fields_fn decode_fields = select_decode_fields(&decode_fields_isa);
+
+void decode_block(const uint32_t *words, size_t n, DecodedSoA &out)
+{
+    out.resize(n);
+    decode_fields(words, n, out);
+    decode_opcodes(words, n, out);
+}
+
+void decode_block_scalar(const uint32_t *words, size_t n, DecodedSoA &out)
+{
+    out.resize(n);
+    decode_fields_scalar(words, 0, n, out);
+    decode_opcodes(words, n, out);
+}
+
+const char *decode_block_isa()
+{
+    return decode_fields_isa;
+}
@@ -0,0 +1,33 @@
+#ifndef __DECODE_BLOCK__
+#define __DECODE_BLOCK__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "isa.h"
+using namespace std;
+
+// Structure-of-arrays result of decoding a block of instruction words.
+// Fields follow the isa.h OPCODE_* masks and OPCODE_*_IMM macros;
+// opcode_id is the instr_defs index, or -1 for an unknown encoding.
+struct DecodedSoA
+{
+    size_t count = 0;
+    vector<int32_t> opcode_id;
+    vector<uint32_t> rd;
+    vector<uint32_t> rs1;
+    vector<uint32_t> rs2;
+    vector<uint32_t> shamt;
+    vector<uint32_t> itype_imm;
+    vector<uint32_t> stype_imm;
+    vector<uint32_t> sbtype_imm;
+    vector<uint32_t> utype_imm;
+    vector<uint32_t> ujtype_imm;
+    void resize(size_t n);
+};
+
+// Decodes n words into out (resized to n). Uses AVX2 (8 words) or SSE2
+// (4 words) when the host supports it, a scalar loop otherwise.
+void decode_block(const uint32_t *words, size_t n, DecodedSoA &out);
+void decode_block_scalar(const uint32_t *words, size_t n, DecodedSoA &out);
+const char *decode_block_isa();
+#endif
@@ -0,0 +1,12 @@
+#include "decode_table.h"
+#include <iostream>
+
+void DecodeTable::print_table_info() const
+{
+    uint32_t used_slots = 0;
+    for (uint32_t i = 0; i < DECODE_PRIMARY_SLOTS; i++)
+        if (primary[i].count)
+            used_slots++;
+    cout << "Decode table: " << used_slots << " primary slots used, " << split_count << " split on funct7, "
+         << candidate_count << " candidates, longest leaf " << max_leaf << endl;
+}
@@ -0,0 +1,182 @@
+#ifndef __DECODE_TABLE__
+#define __DECODE_TABLE__
+#include <stdint.h>
+#include "isa.h"
+using namespace std;
+
+//--------------------------------------------------------------------
+// Decode tree generated at compile time from instr_defs
+//   primary:   major opcode (bits 6-0) + funct3 (bits 14-12)
+//   secondary: funct7 (bits 31-25), only for crowded primary slots
+//   leaf:      at most DECODE_MAX_LEAF mask/match candidates
+//--------------------------------------------------------------------
+#define DECODE_FUNCT3_BITS      3
+#define DECODE_FUNCT7_BITS      7
+#define DECODE_PRIMARY_SLOTS    (1 << (7 + DECODE_FUNCT3_BITS))
+#define DECODE_FUNCT7_SLOTS     (1 << DECODE_FUNCT7_BITS)
+#define DECODE_PRIMARY_MASK     0x707f
+#define DECODE_FUNCT7_MASK      OPCODE_FUNC7_MASK
+#define DECODE_MAX_LEAF         2
+#define DECODE_MAX_SPLIT        8
+#define DECODE_MAX_CANDIDATES   4096
+
+#define DECODE_PRIMARY_INDEX(x) ((((x) & 0x7f) << DECODE_FUNCT3_BITS) | \
+                                 OPCODE_SHIFT_MASK(x, OPCODE_FUNC3_SHIFT, DECODE_FUNCT3_BITS))
+#define DECODE_FUNCT7_INDEX(x)  OPCODE_SHIFT_MASK(x, OPCODE_FUNC7_SHIFT, DECODE_FUNCT7_BITS)
+
+typedef struct {
+    uint32_t first;         // first candidate, or first secondary slot when split
+    uint16_t count;         // number of candidates
+    uint16_t split_funct7;  // candidates are further indexed on funct7
+}decode_slot;
+
+// check whether instruction definition can match any word carrying `bits` in the `field_mask` positions
+constexpr bool decode_is_compatible(const instr_def &idef, uint32_t bits, uint32_t field_mask)
+{
+    return ((bits ^ idef.instruction_match) & idef.instruction_mask & field_mask) == 0;
+}
+
+constexpr int decode_mask_bits(uint32_t mask)
+{
+    int bits = 0;
+    for (; mask; mask &= mask - 1)
+        bits++;
+    return bits;
+}
+
+// Two entries that can match the same word are only allowed when one
+// strictly refines the other; the more specific entry then wins.
+// A violation stops compilation at the throw with the matching message.
+constexpr bool decode_check_pair(const instr_def &first, const instr_def &second)
+{
+    uint32_t common_mask = first.instruction_mask & second.instruction_mask;
+    if (first.instruction_enum == second.instruction_enum)
+        throw "instr_defs: two entries share an eInstructions value";
+    if (((first.instruction_match ^ second.instruction_match) & common_mask) == 0 &&
+        (first.instruction_mask == second.instruction_mask ||
+         (common_mask != first.instruction_mask && common_mask != second.instruction_mask)))
+        throw "instr_defs: entries overlap ambiguously";
+    return true;
+}
+
+constexpr bool decode_check_table(const instr_def *defs, int instr_count)
+{
+    if (instr_count > 256)
+        throw "instr_defs: candidate indices are 8 bits wide";
+    for (int i = 0; i < instr_count; i++)
+    {
+        if ((defs[i].instruction_match & ~defs[i].instruction_mask) != 0)
+            throw "instr_defs: match has bits outside its mask";
+        for (int j = i + 1; j < instr_count; j++)
+            decode_check_pair(defs[i], defs[j]);
+    }
+    return true;
+}
+
+class DecodeTable
+{
+protected:
+    const instr_def *defs = nullptr;
+    decode_slot primary[DECODE_PRIMARY_SLOTS] = {};
+    decode_slot secondary[DECODE_MAX_SPLIT * DECODE_FUNCT7_SLOTS] = {};
+    uint8_t candidates[DECODE_MAX_CANDIDATES] = {};
+    uint32_t split_count = 0;
+    uint32_t candidate_count = 0;
+    uint32_t max_leaf = 0;
+
+    constexpr decode_slot add_candidates(const uint8_t *slot_candidates, uint32_t count)
+    {
+        if (candidate_count + count > DECODE_MAX_CANDIDATES)
+            throw "decode table: raise DECODE_MAX_CANDIDATES";
+        // identical leaves (mostly funct7 fan-out) share storage with the previous one
+        if (count && count <= candidate_count)
+        {
+            bool same = true;
+            for (uint32_t i = 0; i < count; i++)
+                same = same && candidates[candidate_count - count + i] == slot_candidates[i];
+            if (same)
+                return {candidate_count - count, (uint16_t)count, 0};
+        }
+        decode_slot slot = {candidate_count, (uint16_t)count, 0};
+        for (uint32_t i = 0; i < count; i++)
+            candidates[candidate_count++] = slot_candidates[i];
+        if (count > max_leaf)
+            max_leaf = count;
+        return slot;
+    }
+
+public:
+    constexpr DecodeTable(const instr_def *instr_table, int instr_count)
+    {
+        defs = instr_table;
+        decode_check_table(defs, instr_count);
+
+        // candidate order: most specific mask first, then table order
+        uint8_t order[256] = {};
+        for (int i = 0; i < instr_count; i++)
+        {
+            int pos = i;
+            while (pos > 0 && decode_mask_bits(defs[order[pos - 1]].instruction_mask) <
+                                  decode_mask_bits(defs[i].instruction_mask))
+            {
+                order[pos] = order[pos - 1];
+                pos--;
+            }
+            order[pos] = i;
+        }
+
+        for (uint32_t slot_index = 0; slot_index < DECODE_PRIMARY_SLOTS; slot_index++)
+        {
+            uint32_t slot_bits = (slot_index >> DECODE_FUNCT3_BITS) |
+                                 ((slot_index & ((1 << DECODE_FUNCT3_BITS) - 1)) << OPCODE_FUNC3_SHIFT);
+            uint8_t slot_candidates[256] = {};
+            uint32_t count = 0;
+            for (int i = 0; i < instr_count; i++)
+                if (decode_is_compatible(defs[order[i]], slot_bits, DECODE_PRIMARY_MASK))
+                    slot_candidates[count++] = order[i];
+
+            if (count <= DECODE_MAX_LEAF)
+            {
+                primary[slot_index] = add_candidates(slot_candidates, count);
+                continue;
+            }
+            // crowded slot (r-type, amo, system): index again on funct7
+            if (split_count == DECODE_MAX_SPLIT)
+                throw "decode table: raise DECODE_MAX_SPLIT";
+            decode_slot *funct7_slots = &secondary[split_count * DECODE_FUNCT7_SLOTS];
+            for (uint32_t funct7 = 0; funct7 < DECODE_FUNCT7_SLOTS; funct7++)
+            {
+                uint8_t funct7_candidates[256] = {};
+                uint32_t funct7_count = 0;
+                for (uint32_t i = 0; i < count; i++)
+                    if (decode_is_compatible(defs[slot_candidates[i]], funct7 << OPCODE_FUNC7_SHIFT, DECODE_FUNCT7_MASK))
+                        funct7_candidates[funct7_count++] = slot_candidates[i];
+                if (funct7_count > DECODE_MAX_LEAF)
+                    throw "decode table: funct7 leaf still too crowded";
+                funct7_slots[funct7] = add_candidates(funct7_candidates, funct7_count);
+            }
+            primary[slot_index] = {split_count * DECODE_FUNCT7_SLOTS, (uint16_t)count, 1};
+            split_count++;
+        }
+    }
+
+    void print_table_info() const;
+
+    // Returns the instr_defs index matching opcode_val, or -1.
+    int lookup(uint32_t opcode_val) const
+    {
+        const decode_slot *slot = &primary[DECODE_PRIMARY_INDEX(opcode_val)];
+        if (slot->split_funct7)
+            slot = &secondary[slot->first + DECODE_FUNCT7_INDEX(opcode_val)];
+        for (uint32_t i = slot->first; i < slot->first + slot->count; i++)
+        {
+            const instr_def &idef = defs[candidates[i]];
+            if ((opcode_val & idef.instruction_mask) == idef.instruction_match)
+                return candidates[i];
+        }
+        return -1;
+    }
+};
+
+static constexpr DecodeTable rv_decode_table(instr_defs, MAX_INSTR);
+#endif
@@ -0,0 +1,54 @@
+#ifndef __DECODED_INSTR__
+#define __DECODED_INSTR__
+#include <systemc.h>
+#include <stdint.h>
+#include "isa.h"
+
+// All RV_DECODER outputs for one instruction, so they can travel as a
+// single sc_signal update or TLM extension instead of ten port writes.
+struct DecodedInstr
+{
+    uint32_t instr = 0;
+    uint32_t rs1 = 0;
+    uint32_t rs2 = 0;
+    uint32_t rd = 0;
+    uint32_t imm_12_itype = 0;
+    uint32_t imm_12_sbtype = 0;
+    uint32_t imm_20_ujtype = 0;
+    uint32_t selected_imm = 0;
+    uint32_t shift_amt = 0;
+    uint32_t opcode_id = 0;
+    uint32_t instr_type = INSTR_TYPE_DEFAULT;
+
+    bool operator==(const DecodedInstr &other) const
+    {
+        return instr == other.instr && rs1 == other.rs1 && rs2 == other.rs2 && rd == other.rd &&
+               imm_12_itype == other.imm_12_itype && imm_12_sbtype == other.imm_12_sbtype &&
+               imm_20_ujtype == other.imm_20_ujtype && selected_imm == other.selected_imm &&
+               shift_amt == other.shift_amt && opcode_id == other.opcode_id && instr_type == other.instr_type;
+    }
+};
+
+inline ostream &operator<<(ostream &os, const DecodedInstr &d)
+{
+    os << "instr: " << d.instr << ", opcode_id: " << d.opcode_id << ", type: " << d.instr_type
+       << ", rs1: " << d.rs1 << ", rs2: " << d.rs2 << ", rd: " << d.rd
+       << ", selected_imm: " << d.selected_imm << ", shift_amt: " << d.shift_amt;
+    return os;
+}
+
+inline void sc_trace(sc_trace_file *tf, const DecodedInstr &d, const std::string &name)
+{
+    sc_trace(tf, d.instr, name + ".instr");
+    sc_trace(tf, d.rs1, name + ".rs1");
+    sc_trace(tf, d.rs2, name + ".rs2");
+    sc_trace(tf, d.rd, name + ".rd");
+    sc_trace(tf, d.imm_12_itype, name + ".imm_12_itype");
+    sc_trace(tf, d.imm_12_sbtype, name + ".imm_12_sbtype");
+    sc_trace(tf, d.imm_20_ujtype, name + ".imm_20_ujtype");
+    sc_trace(tf, d.selected_imm, name + ".selected_imm");
+    sc_trace(tf, d.shift_amt, name + ".shift_amt");
+    sc_trace(tf, d.opcode_id, name + ".opcode_id");
+    sc_trace(tf, d.instr_type, name + ".instr_type");
+}
+#endif
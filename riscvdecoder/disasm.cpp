@@ -0,0 +1,183 @@
+#include "disasm.h"
+
+static inline void put_str(char *&p, const char *s)
+{
+    while (*s)
+        *p++ = *s++;
+}
+
+static inline void put_hex(char *&p, uint32_t v, int width)
+{
+    static const char digits[] = "0123456789abcdef";
+    int len = 1;
+    while (len < 8 && (v >> (4 * len)))
+        len++;
+    if (len < width)
+        len = width;
+    for (int i = len - 1; i >= 0; i--)
+        *p++ = digits[(v >> (4 * i)) & 0xf];
+}
+
+static inline void put_dec(char *&p, int32_t v)
+{
+    char tmp[12];
+    int len = 0;
+    uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    if (v < 0)
+        *p++ = '-';
+    do
+    {
+        tmp[len++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    while (len)
+        *p++ = tmp[--len];
+}
+
+static inline void put_reg(char *&p, uint32_t word, uint32_t mask, uint32_t shift)
+{
+    put_str(p, gpr_names[(word & mask) >> shift]);
+}
+
+// imm(rs1) operand of loads, stores, jalr and amos
+static inline void put_mem(char *&p, uint32_t word, int32_t imm)
+{
+    put_dec(p, imm);
+    *p++ = '(';
+    put_reg(p, word, OPCODE_RS1_MASK, OPCODE_RS1_SHIFT);
+    *p++ = ')';
+}
+
+uint32_t disasm_immediate(uint32_t word)
+{
+    switch (word & 0x7f)
+    {
+    case 0x23:
+        return OPCODE_STYPE_IMM(word);
+    case 0x63:
+        return OPCODE_SBTYPE_IMM(word);
+    case 0x37:
+    case 0x17:
+        return OPCODE_UTYPE_IMM(word);
+    case 0x6f:
+        return OPCODE_UJTYPE_IMM(word);
+    default:
+        return OPCODE_ITYPE_IMM(word);
+    }
+}
+
+size_t disasm_format(char *buf, uint32_t pc, uint32_t word, int opcode_id, int32_t compressed)
+{
+    char *p = buf;
+    put_hex(p, pc, 8);
+    put_str(p, ":\t");
+    if (compressed >= 0)
+    {
+        put_str(p, "    ");
+        put_hex(p, compressed, 4);
+    }
+    else
+        put_hex(p, word, 8);
+    *p++ = '\t';
+    if (compressed >= 0 && opcode_id < 0)
+    {
+        put_str(p, ".half\t0x");
+        put_hex(p, compressed, 4);
+        *p++ = '\n';
+        return p - buf;
+    }
+    if (opcode_id < 0)
+    {
+        put_str(p, ".word\t0x");
+        put_hex(p, word, 8);
+        *p++ = '\n';
+        return p - buf;
+    }
+    put_str(p, inst_names[instr_defs[opcode_id].instruction_enum]);
+
+    int32_t imm = (int32_t)disasm_immediate(word);
+    uint32_t funct3 = (word & OPCODE_FUNC3_MASK) >> OPCODE_FUNC3_SHIFT;
+    switch (word & 0x7f)
+    {
+    case 0x37: // lui, auipc
+    case 0x17:
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        put_str(p, ",0x");
+        put_hex(p, imm & 0xfffff, 0);
+        break;
+    case 0x6f: // jal
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        *p++ = ',';
+        put_hex(p, pc + imm, 0);
+        break;
+    case 0x63: // branches
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RS1_MASK, OPCODE_RS1_SHIFT);
+        *p++ = ',';
+        put_reg(p, word, OPCODE_RS2_MASK, OPCODE_RS2_SHIFT);
+        *p++ = ',';
+        put_hex(p, pc + imm, 0);
+        break;
+    case 0x67: // jalr
+    case 0x03: // loads
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        *p++ = ',';
+        put_mem(p, word, imm);
+        break;
+    case 0x23: // stores
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RS2_MASK, OPCODE_RS2_SHIFT);
+        *p++ = ',';
+        put_mem(p, word, imm);
+        break;
+    case 0x13: // alu immediate, shifts take shamt
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        *p++ = ',';
+        put_reg(p, word, OPCODE_RS1_MASK, OPCODE_RS1_SHIFT);
+        *p++ = ',';
+        put_dec(p, (funct3 == 1 || funct3 == 5) ? (int32_t)((word & OPCODE_SHAMT_MASK) >> OPCODE_SHAMT_SHIFT) : imm);
+        break;
+    case 0x33: // alu register, mul/div
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        *p++ = ',';
+        put_reg(p, word, OPCODE_RS1_MASK, OPCODE_RS1_SHIFT);
+        *p++ = ',';
+        put_reg(p, word, OPCODE_RS2_MASK, OPCODE_RS2_SHIFT);
+        break;
+    case 0x2f: // amo: rd,rs2,(rs1)
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        *p++ = ',';
+        if (instr_defs[opcode_id].instruction_enum != ENUM_INST_AMOLR_W)
+        {
+            put_reg(p, word, OPCODE_RS2_MASK, OPCODE_RS2_SHIFT);
+            *p++ = ',';
+        }
+        *p++ = '(';
+        put_reg(p, word, OPCODE_RS1_MASK, OPCODE_RS1_SHIFT);
+        *p++ = ')';
+        break;
+    case 0x73: // csr access: rd,csr,rs1 or rd,csr,uimm
+        if (funct3 == 0)
+            break;
+        *p++ = '\t';
+        put_reg(p, word, OPCODE_RD_MASK, OPCODE_RD_SHIFT);
+        put_str(p, ",0x");
+        put_hex(p, word >> 20, 3);
+        *p++ = ',';
+        if (funct3 & 4)
+            put_dec(p, (word & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT);
+        else
+            put_reg(p, word, OPCODE_RS1_MASK, OPCODE_RS1_SHIFT);
+        break;
+    default:
+        break;
+    }
+    *p++ = '\n';
+    return p - buf;
+}
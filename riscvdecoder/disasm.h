@@ -0,0 +1,20 @@
+#ifndef __DISASM__
+#define __DISASM__
+#include <stdint.h>
+#include <stddef.h>
+#include "isa.h"
+
+// longest line disasm_format can produce, including the newline
+#define DISASM_MAX_LINE     96
+
+// Writes one objdump-style line ("addr:\tword\tmnemonic\toperands\n")
+// for word at pc into buf and returns its length. opcode_id is the
+// instr_defs index from the decode table, or -1 for an unknown word.
+// For an RVC instruction word is the expansion and compressed the
+// original 16-bit encoding, which is what the line shows; -1 otherwise.
+size_t disasm_format(char *buf, uint32_t pc, uint32_t word, int opcode_id, int32_t compressed = -1);
+
+// Immediate operand of word according to its major opcode, as used in
+// the disassembly text and the binary decode table.
+uint32_t disasm_immediate(uint32_t word);
+#endif
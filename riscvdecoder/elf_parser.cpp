@@ -8,34 +8,117 @@ bool compare_region(const region &region1, const region &region2)
 RegionManager::RegionManager()
 {
     total_memory_size = 0;
+    start_addr = 0;
+    last_span = REGION_NO_SPAN;
 }
 
 void RegionManager::add_region(region mem_region)
 {
-    regions.push_back({mem_region.start_addr, mem_region.end_addr, mem_region.region_size, 0, mem_region.region_name});
+    regions.push_back({mem_region.start_addr, mem_region.end_addr, mem_region.region_size, 0, mem_region.region_name, mem_region.region_flags});
 }
 
 void RegionManager::init_regions()
 {
     sort(regions.begin(), regions.end(), compare_region);
     total_memory_size = 0;
+    if (regions.empty())
+        return;
     start_addr = regions[0].start_addr;
     for (int i = 0; i < regions.size(); i++)
     {
         regions[i].region_base = total_memory_size;
         total_memory_size += regions[i].region_size;
     }
+    // a region only gets what earlier regions leave: sorted by start, the
+    // addresses covered before it from its start on run up to covered_end
+    spans.clear();
+    uint64_t covered_end = 0;
+    for (uint32_t i = 0; i < regions.size(); i++)
+    {
+        uint64_t span_start = max((uint64_t)regions[i].start_addr, covered_end);
+        if (span_start < regions[i].end_addr)
+            spans.push_back({(uint32_t)span_start, regions[i].end_addr, i});
+        covered_end = max(covered_end, (uint64_t)regions[i].end_addr);
+    }
+    last_span = REGION_NO_SPAN;
+    page_table.clear();
+}
+
+bool RegionManager::build_page_table()
+{
+    page_table.clear();
+    if (spans.empty())
+        return false;
+    uint64_t pages = (((uint64_t)spans.back().end_addr - 1) >> REGION_PAGE_BITS) - (start_addr >> REGION_PAGE_BITS) + 1;
+    if (pages > REGION_PAGE_TABLE_MAX)
+        return false;
+    // each page gets the first span ending past its start; the few spans
+    // sharing a page are stepped over in find_span
+    page_table.resize(pages);
+    uint32_t index = 0;
+    for (uint32_t page = 0; page < pages; page++)
+    {
+        uint64_t page_start = ((uint64_t)(start_addr >> REGION_PAGE_BITS) + page) << REGION_PAGE_BITS;
+        while (index < spans.size() && spans[index].end_addr <= page_start)
+            index++;
+        page_table[page] = index;
+    }
+    return true;
+}
+
+// index of the span holding addr, REGION_NO_SPAN if none
+uint32_t RegionManager::find_span(uint32_t addr)
+{
+    if (last_span != REGION_NO_SPAN && spans[last_span].start_addr <= addr && spans[last_span].end_addr > addr)
+        return last_span;
+    uint32_t index;
+    uint32_t page = (addr >> REGION_PAGE_BITS) - (start_addr >> REGION_PAGE_BITS);
+    if (!page_table.empty() && addr >= start_addr && page < page_table.size())
+    {
+        index = page_table[page];
+        while (index < spans.size() && spans[index].end_addr <= addr)
+            index++;
+        if (index == spans.size())
+            return REGION_NO_SPAN;
+    }
+    else
+    {
+        // last span starting at or below addr
+        auto it = upper_bound(spans.begin(), spans.end(), addr,
+                              [](uint32_t value, const region_span &span) { return value < span.start_addr; });
+        if (it == spans.begin())
+            return REGION_NO_SPAN;
+        index = (it - 1) - spans.begin();
+    }
+    if (spans[index].end_addr <= addr || spans[index].start_addr > addr)
+        return REGION_NO_SPAN;
+    last_span = index;
+    return index;
 }
 
 uint32_t RegionManager::get_mem_address(uint32_t addr)
 {
-    for (auto region_val = regions.begin(); region_val != regions.end(); region_val++)
-        if (region_val->start_addr <= addr && region_val->end_addr > addr)
-        {
-            return region_val->region_base + (addr - region_val->start_addr);
-        }
-    return -1;
+    uint32_t index = find_span(addr);
+    if (index == REGION_NO_SPAN)
+        return -1;
+    const region &region_val = regions[spans[index].region_index];
+    return region_val.region_base + (addr - region_val.start_addr);
 }
+
+// inverse of get_mem_address: memory image offset back to the section address
+uint32_t RegionManager::get_virt_address(uint32_t mem_addr)
+{
+    // region_base grows with the index, the image has no gaps
+    auto region_val = upper_bound(regions.begin(), regions.end(), mem_addr,
+                                  [](uint32_t value, const region &reg) { return value < reg.region_base; });
+    if (region_val == regions.begin())
+        return -1;
+    region_val--;
+    if (region_val->region_base + region_val->region_size <= mem_addr)
+        return -1;
+    return region_val->start_addr + (mem_addr - region_val->region_base);
+}
+
 void RegionManager::print_region_info()
 {
     for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
@@ -50,38 +133,40 @@ uint32_t RegionManager::get_memory_size()
     return total_memory_size;
 }
 
-ELFParser::ELFParser(string file_location, uint32_t *start_addr, uint8_t **mem, uint32_t *total_memory_size)
+uint32_t RegionManager::get_start_address()
+{
+    return start_addr;
+}
+
+const vector<region> &RegionManager::get_regions()
+{
+    return regions;
+}
+
+// Opens the ELF and collects its SHF_ALLOC sections into regmgr; NULL if
+// it cannot be read
+Elf *ELFParser::open_elf(string file_location, int *elf_fd, size_t *shstrndx, uint32_t *start_addr, bool verbose)
 {
-    int elf_fd;
     Elf *elf_pointer;
-    Elf_Kind elf_kind_val;
     Elf_Scn *elf_scn;
-    Elf_Data *elf_data;
     Elf32_Shdr *elf_shdr;
-    size_t section_heaher_index;
-    uint32_t base_addr = 0xFFFFFFFFL;
-    uint32_t mem_size = 0;
-    vector<region> regions;
-    RegionManager regmgr;
     // check if version is none
     if (elf_version(EV_CURRENT) == EV_NONE)
-        return;
+        return NULL;
     // obtain filedescriptor to the elf_file
-    if ((elf_fd = open((const char *)file_location.c_str(), O_RDONLY, 0)) < 0)
+    if ((*elf_fd = open((const char *)file_location.c_str(), O_RDONLY, 0)) < 0)
     {
-        cout << "ELF FD " << elf_fd << endl;
-        return;
+        cout << "ELF FD " << *elf_fd << endl;
+        return NULL;
     }
     // get pointer to the beginning
-    if ((elf_pointer = elf_begin(elf_fd, ELF_C_READ, NULL)) == NULL)
-        return;
-
-    elf_kind_val = elf_kind(elf_pointer);
-    if (elf_kind_val != ELF_K_ELF)
-        return;
+    if ((elf_pointer = elf_begin(*elf_fd, ELF_C_READ, NULL)) == NULL)
+        return NULL;
+    if (elf_kind(elf_pointer) != ELF_K_ELF)
+        return NULL;
     // get section header index
-    if (elf_getshdrstrndx(elf_pointer, &section_heaher_index) != 0)
-        return;
+    if (elf_getshdrstrndx(elf_pointer, shstrndx) != 0)
+        return NULL;
 
     // Get entrypoint header
     GElf_Ehdr _ehdr;
@@ -90,7 +175,6 @@ ELFParser::ELFParser(string file_location, uint32_t *start_addr, uint8_t **mem,
     *start_addr = ehdr->e_entry;
 
     int section_index = 0;
-
     // Iterate through each section
     while ((elf_scn = elf_getscn(elf_pointer, section_index)) != NULL)
     {
@@ -98,41 +182,47 @@ ELFParser::ELFParser(string file_location, uint32_t *start_addr, uint8_t **mem,
         // check if the section needs to be allocated on memory
         if ((elf_shdr->sh_flags & SHF_ALLOC) && (elf_shdr->sh_size > 0))
         {
-            elf_data = elf_getdata(elf_scn, NULL);
-            string region_name = elf_strptr(elf_pointer, section_heaher_index, elf_shdr->sh_name);
-            if (base_addr > elf_shdr->sh_addr)
-                base_addr = elf_shdr->sh_addr;
-            regmgr.add_region({elf_shdr->sh_addr, (elf_shdr->sh_addr + elf_shdr->sh_size), elf_shdr->sh_size, 0, region_name});
+            string region_name = elf_strptr(elf_pointer, *shstrndx, elf_shdr->sh_name);
+            regmgr.add_region({elf_shdr->sh_addr, (elf_shdr->sh_addr + elf_shdr->sh_size), elf_shdr->sh_size, 0, region_name, elf_shdr->sh_flags});
         }
         section_index++;
     }
-    section_index = 0;
     regmgr.init_regions();
-    regmgr.print_region_info();
+    if (verbose)
+        regmgr.print_region_info();
+    return elf_pointer;
+}
+
+ELFParser::ELFParser(string file_location, uint32_t *start_addr, uint8_t **mem, uint32_t *total_memory_size, bool verbose)
+{
+    int elf_fd;
+    size_t section_heaher_index;
+    Elf *elf_pointer = open_elf(file_location, &elf_fd, &section_heaher_index, start_addr, verbose);
+    Elf_Scn *elf_scn;
+    Elf_Data *elf_data;
+    Elf32_Shdr *elf_shdr;
+    if (elf_pointer == NULL)
+        return;
+    int section_index = 0;
     *start_addr = regmgr.get_mem_address(*start_addr);
     uint32_t msize = regmgr.get_memory_size();
     *total_memory_size = msize;
     *mem = new uint8_t[msize];
-    elf_pointer = elf_begin(elf_fd, ELF_C_READ, NULL);
-    if (elf_pointer == NULL)
-        cout << "elf_pointer: " << elf_pointer << " " << endl;
     while ((elf_scn = elf_getscn(elf_pointer, section_index)) != NULL)
     {
-        string region_name = elf_strptr(elf_pointer, section_heaher_index, elf_shdr->sh_name);
-        cout << region_name << hex << " start addr: " << elf_shdr->sh_addr << " end addr: " << (elf_shdr->sh_addr + elf_shdr->sh_size) << endl;
         elf_shdr = elf32_getshdr(elf_scn);
+        string region_name = elf_strptr(elf_pointer, section_heaher_index, elf_shdr->sh_name);
+        if (verbose)
+            cout << region_name << hex << " start addr: " << elf_shdr->sh_addr << " end addr: " << (elf_shdr->sh_addr + elf_shdr->sh_size) << endl;
 
         if ((elf_shdr->sh_flags & SHF_ALLOC) && (elf_shdr->sh_size > 0))
         {
             // check if current section is text section
+            // a section is contiguous in the image
             if (elf_shdr->sh_type == SHT_PROGBITS)
             {
                 elf_data = elf_getdata(elf_scn, NULL);
-                uint64_t currr_addr = elf_shdr->sh_addr;
-                for (int i = 0; i < elf_shdr->sh_size; i++)
-                {
-                    (*mem)[regmgr.get_mem_address(elf_shdr->sh_addr + i)] = ((uint8_t *)elf_data->d_buf)[i];
-                }
+                memcpy(*mem + regmgr.get_mem_address(elf_shdr->sh_addr), elf_data->d_buf, elf_shdr->sh_size);
             }
         }
         section_index++;
@@ -140,3 +230,100 @@ ELFParser::ELFParser(string file_location, uint32_t *start_addr, uint8_t **mem,
     elf_end(elf_pointer);
     close(elf_fd);
 }
+
+// pread len bytes at offset of the file into guest memory at addr
+static bool copy_from_file(int elf_fd, off_t offset, uint32_t addr, uint32_t len, GuestMemory *mem)
+{
+    while (len > 0)
+    {
+        uint32_t page_offset = addr & GUEST_PAGE_MASK;
+        uint32_t chunk = min(len, (uint32_t)GUEST_PAGE_SIZE - page_offset);
+        uint8_t *host = mem->page(addr);
+        if (host == NULL || pread(elf_fd, host + page_offset, chunk, offset) != chunk)
+            return false;
+        addr += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+// The whole pages of a segment's file data are mapped MAP_PRIVATE from the
+// file and attached to guest memory, so they are only read when touched and
+// copied by the host on the first write. Partial pages at either end, and
+// segments whose file offset and address disagree within a page, are read.
+bool ELFParser::map_segment(int elf_fd, const Elf32_Phdr *phdr, GuestMemory *mem)
+{
+    uint32_t file_end = phdr->p_vaddr + phdr->p_filesz;
+    uint32_t first_page = (phdr->p_vaddr + GUEST_PAGE_MASK) & ~GUEST_PAGE_MASK;
+    uint32_t last_page = file_end & ~GUEST_PAGE_MASK;
+    if (phdr->p_filesz == 0)
+        return true;
+    if (((phdr->p_offset ^ phdr->p_vaddr) & GUEST_PAGE_MASK) || first_page < phdr->p_vaddr || first_page >= last_page)
+        return copy_from_file(elf_fd, phdr->p_offset, phdr->p_vaddr, phdr->p_filesz, mem);
+
+    size_t len = last_page - first_page;
+    off_t map_offset = phdr->p_offset + (first_page - phdr->p_vaddr);
+    uint8_t *base = (uint8_t *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, elf_fd, map_offset);
+    if (base == MAP_FAILED)
+        return copy_from_file(elf_fd, phdr->p_offset, phdr->p_vaddr, phdr->p_filesz, mem);
+    mem->keep_mapping(base, len);
+    for (uint32_t done = 0; done < len; done += GUEST_PAGE_SIZE)
+    {
+        // a page already written by an earlier segment keeps its host page
+        if (!mem->attach_page(first_page + done, base + done))
+            memcpy(mem->page(first_page + done), base + done, GUEST_PAGE_SIZE);
+    }
+    return copy_from_file(elf_fd, phdr->p_offset, phdr->p_vaddr, first_page - phdr->p_vaddr, mem) &&
+           copy_from_file(elf_fd, map_offset + len, last_page, file_end - last_page, mem);
+}
+
+// Loads the PT_LOAD segments at their virtual addresses, the same addresses
+// as the sections in regmgr; the part of a segment beyond its file data
+// (.bss) is left to be zero-filled on first touch. An ELF without program
+// headers is loaded section by section.
+ELFParser::ELFParser(string file_location, uint32_t *start_addr, GuestMemory *mem, bool verbose)
+{
+    int elf_fd;
+    size_t section_heaher_index;
+    size_t phnum = 0;
+    Elf *elf_pointer = open_elf(file_location, &elf_fd, &section_heaher_index, start_addr, verbose);
+    Elf_Scn *elf_scn;
+    Elf_Data *elf_data;
+    Elf32_Shdr *elf_shdr;
+    Elf32_Phdr *phdr;
+    if (elf_pointer == NULL)
+        return;
+    const vector<region> &regions = regmgr.get_regions();
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+        mem->add_range(reg_val->start_addr, reg_val->region_size);
+    if (elf_getphdrnum(elf_pointer, &phnum) == 0 && phnum > 0 && (phdr = elf32_getphdr(elf_pointer)) != NULL)
+    {
+        for (size_t i = 0; i < phnum; i++)
+        {
+            if (phdr[i].p_type != PT_LOAD || phdr[i].p_memsz == 0)
+                continue;
+            if (verbose)
+                cout << hex << "PT_LOAD vaddr: " << phdr[i].p_vaddr << " filesz: " << phdr[i].p_filesz << " memsz: " << phdr[i].p_memsz << dec << endl;
+            mem->add_range(phdr[i].p_vaddr, phdr[i].p_memsz);
+            if (!map_segment(elf_fd, &phdr[i], mem))
+                cout << "Failed to load segment at " << hex << phdr[i].p_vaddr << dec << endl;
+        }
+    }
+    else
+    {
+        int section_index = 0;
+        while ((elf_scn = elf_getscn(elf_pointer, section_index)) != NULL)
+        {
+            elf_shdr = elf32_getshdr(elf_scn);
+            if ((elf_shdr->sh_flags & SHF_ALLOC) && (elf_shdr->sh_size > 0) && elf_shdr->sh_type == SHT_PROGBITS)
+            {
+                elf_data = elf_getdata(elf_scn, NULL);
+                mem->write(elf_shdr->sh_addr, elf_data->d_buf, elf_shdr->sh_size);
+            }
+            section_index++;
+        }
+    }
+    elf_end(elf_pointer);
+    close(elf_fd);
+}
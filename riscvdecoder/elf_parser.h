@@ -8,11 +8,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <systemc.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <algorithm>
+#include <iostream>
+#include <string>
 #include <vector>
+#include "guest_memory.h"
 using namespace std;
 typedef struct {
     uint32_t start_addr;
@@ -20,26 +23,59 @@ typedef struct {
     uint32_t region_size;
     uint32_t region_base;
     string region_name;
+    uint32_t region_flags;  // section sh_flags (SHF_ALLOC, SHF_EXECINSTR, ...)
 }region;
 
+// Part of the address space resolved to one region: where sections
+// overlap (.tbss, ...), the first one in address order owns the overlap.
+typedef struct {
+    uint32_t start_addr;
+    uint32_t end_addr;
+    uint32_t region_index;
+}region_span;
+
+#define REGION_PAGE_BITS        12
+#define REGION_PAGE_TABLE_MAX   (1 << 20)   // entries, i.e. spans up to 4 GiB
+#define REGION_NO_SPAN          0xffffffff
+
+// Address lookups try the span of the previous hit first, then either
+// the page table built by build_page_table() (first span of the page,
+// stepping over the others sharing it) or a binary search over the spans.
 class RegionManager{
 protected:   
     vector<region>regions;
     uint32_t start_addr;
+    vector<region_span> spans;          // sorted and disjoint
+    uint32_t last_span;
+    vector<uint32_t> page_table;        // first span ending in or after each page from start_addr
+    uint32_t find_span(uint32_t addr);
 public:
     uint32_t total_memory_size;
     RegionManager();
     void add_region(region mem_region);
     void init_regions();
+    // false if the sections cover too large a range for a table
+    bool build_page_table();
     uint32_t get_mem_address(uint32_t addr);
+    uint32_t get_virt_address(uint32_t mem_addr);
     void print_region_info();
     uint32_t get_memory_size();
     uint32_t get_start_address();
+    const vector<region> &get_regions();
 };
 
 class ELFParser
 {
 public:
-    ELFParser(string file_location, uint32_t *start_addr, uint8_t** mem, uint32_t*total_memory_size);
+    RegionManager regmgr;
+    // packed image: sections back to back at their region_base, start_addr
+    // returned as an image offset
+    ELFParser(string file_location, uint32_t *start_addr, uint8_t** mem, uint32_t*total_memory_size, bool verbose = true);
+    // sparse image at the section addresses, start_addr is the entry point
+    ELFParser(string file_location, uint32_t *start_addr, GuestMemory *mem, bool verbose = true);
+
+protected:
+    Elf *open_elf(string file_location, int *elf_fd, size_t *shstrndx, uint32_t *start_addr, bool verbose);
+    bool map_segment(int elf_fd, const Elf32_Phdr *phdr, GuestMemory *mem);
 };
 #endif
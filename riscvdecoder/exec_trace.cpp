@@ -0,0 +1,237 @@
+#include "exec_trace.h"
+#include "isa.h"
+#include "varint.h"
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+#define EXEC_TRACE_BUFFER   (1 << 20)   // writer's output buffer
+#define EXEC_TRACE_IDLE_US  50          // writer's sleep when the ring is empty
+
+size_t exec_trace_encode(uint8_t *buf, const exec_trace_record &rec, uint32_t *last_pc, uint64_t *last_timestamp)
+{
+    int32_t pc_delta = (int32_t)(rec.pc - *last_pc);
+    size_t len = put_varint(buf, ((uint32_t)pc_delta << 1) ^ (uint32_t)(pc_delta >> 31));
+    len += put_varint(buf + len, rec.timestamp - *last_timestamp);
+    memcpy(buf + len, &rec.word, 4);
+    len += 4;
+    len += put_varint(buf + len, rec.opcode_id);
+    uint16_t regs = (rec.rs1 & 0x1f) | (rec.rs2 & 0x1f) << 5 | (rec.rd & 0x1f) << 10;
+    memcpy(buf + len, &regs, 2);
+    len += 2;
+    len += put_varint(buf + len, rec.selected_imm);
+    *last_pc = rec.pc;
+    *last_timestamp = rec.timestamp;
+    return len;
+}
+
+//--------------------------------------------------------------------
+// ExecTrace
+//--------------------------------------------------------------------
+ExecTrace::ExecTrace()
+{
+    ring = NULL;
+    out = NULL;
+    write_failed = false;
+    head.store(0, memory_order_relaxed);
+    tail.store(0, memory_order_relaxed);
+    tail_cache = 0;
+    stopping.store(false, memory_order_relaxed);
+}
+
+ExecTrace::~ExecTrace()
+{
+    close();
+}
+
+bool ExecTrace::open(const char *path, uint64_t resolution_fs)
+{
+    if (out != NULL)
+        return false;
+    out = fopen(path, "wb");
+    if (out == NULL)
+        return false;
+    exec_trace_header header = {EXEC_TRACE_MAGIC, EXEC_TRACE_VER, resolution_fs};
+    if (fwrite(&header, sizeof(header), 1, out) != 1)
+    {
+        fclose(out);
+        out = NULL;
+        return false;
+    }
+    ring = new exec_trace_record[EXEC_TRACE_RING_SIZE]();   // touched now, not by the first records
+    head.store(0, memory_order_relaxed);
+    tail.store(0, memory_order_relaxed);
+    tail_cache = 0;
+    write_failed = false;
+    stopping.store(false, memory_order_relaxed);
+    writer_thread = thread(&ExecTrace::writer, this);
+    return true;
+}
+
+bool ExecTrace::close()
+{
+    if (out == NULL)
+        return true;
+    stopping.store(true, memory_order_release);
+    writer_thread.join();
+    bool ok = fclose(out) == 0 && !write_failed;
+    out = NULL;
+    delete[] ring;
+    ring = NULL;
+    return ok;
+}
+
+void ExecTrace::wait_for_space(uint64_t slot)
+{
+    tail_cache = tail.load(memory_order_acquire);
+    while (slot - tail_cache >= EXEC_TRACE_RING_SIZE)
+    {
+        this_thread::yield();
+        tail_cache = tail.load(memory_order_acquire);
+    }
+}
+
+// Encodes whatever the producer has published, a ring slot at a time,
+// and hands the slots back once their records are in the buffer.
+void ExecTrace::writer()
+{
+    vector<uint8_t> buffer(EXEC_TRACE_BUFFER + EXEC_TRACE_MAX_ENCODED);
+    size_t used = 0;
+    uint32_t last_pc = 0;
+    uint64_t last_timestamp = 0;
+    uint64_t consumed = 0;
+    while (true)
+    {
+        // read stopping first: records published before it are then seen below
+        bool stop = stopping.load(memory_order_acquire);
+        uint64_t published = head.load(memory_order_acquire);
+        if (consumed == published)
+        {
+            if (stop)
+                break;
+            if (used)
+            {
+                write_failed |= fwrite(buffer.data(), 1, used, out) != used;
+                used = 0;
+            }
+            this_thread::sleep_for(chrono::microseconds(EXEC_TRACE_IDLE_US));
+            continue;
+        }
+        while (consumed != published)
+        {
+            used += exec_trace_encode(buffer.data() + used, ring[consumed & (EXEC_TRACE_RING_SIZE - 1)], &last_pc,
+                                      &last_timestamp);
+            consumed++;
+            if (used >= EXEC_TRACE_BUFFER)
+            {
+                tail.store(consumed, memory_order_release);
+                write_failed |= fwrite(buffer.data(), 1, used, out) != used;
+                used = 0;
+            }
+        }
+        tail.store(consumed, memory_order_release);
+    }
+    if (used)
+        write_failed |= fwrite(buffer.data(), 1, used, out) != used;
+}
+
+//--------------------------------------------------------------------
+// ExecTraceReader
+//--------------------------------------------------------------------
+ExecTraceReader::ExecTraceReader()
+{
+    in = NULL;
+    memset(&header, 0, sizeof(header));
+    last_pc = 0;
+    last_timestamp = 0;
+    partial = false;
+}
+
+ExecTraceReader::~ExecTraceReader()
+{
+    if (in != NULL)
+        fclose(in);
+}
+
+bool ExecTraceReader::open(const char *path)
+{
+    in = fopen(path, "rb");
+    if (in == NULL)
+        return false;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != EXEC_TRACE_MAGIC ||
+        header.version != EXEC_TRACE_VER)
+    {
+        fclose(in);
+        in = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool ExecTraceReader::next(exec_trace_record *rec)
+{
+    uint64_t pc_delta, time_delta, opcode_id, imm;
+    uint8_t word[4], regs[2];
+    if (in == NULL || partial || !get_varint(in, &pc_delta, &partial, true))
+        return false;
+    if (!get_varint(in, &time_delta, &partial, false))
+        return false;
+    if (fread(word, 1, 4, in) != 4)
+    {
+        partial = true;
+        return false;
+    }
+    if (!get_varint(in, &opcode_id, &partial, false))
+        return false;
+    if (fread(regs, 1, 2, in) != 2)
+    {
+        partial = true;
+        return false;
+    }
+    if (!get_varint(in, &imm, &partial, false))
+        return false;
+    last_pc += (uint32_t)(pc_delta >> 1) ^ -(uint32_t)(pc_delta & 1);
+    last_timestamp += time_delta;
+    uint16_t reg_bits = regs[0] | regs[1] << 8;
+    rec->timestamp = last_timestamp;
+    rec->pc = last_pc;
+    rec->word = word[0] | word[1] << 8 | word[2] << 16 | (uint32_t)word[3] << 24;
+    rec->opcode_id = opcode_id;
+    rec->selected_imm = imm;
+    rec->rs1 = reg_bits & 0x1f;
+    rec->rs2 = (reg_bits >> 5) & 0x1f;
+    rec->rd = (reg_bits >> 10) & 0x1f;
+    return true;
+}
+
+//--------------------------------------------------------------------
+// Text form
+//--------------------------------------------------------------------
+// sc_time's format: the value in the largest unit it is a whole number of
+static size_t format_time(char *buf, size_t size, uint64_t fs)
+{
+    static const char *units[] = {"fs", "ps", "ns", "us", "ms", "s"};
+    int unit = 0;
+    if (fs == 0)
+        unit = 5;
+    while (unit < 5 && fs % 1000 == 0)
+    {
+        fs /= 1000;
+        unit++;
+    }
+    return snprintf(buf, size, "%llu %s", (unsigned long long)fs, units[unit]);
+}
+
+size_t exec_trace_format(char *buf, size_t size, const exec_trace_record &rec, uint64_t time_fs)
+{
+    char time[32];
+    format_time(time, sizeof(time), time_fs);
+    const char *name = "unknown";
+    if (rec.opcode_id < MAX_INSTR &&
+        (rec.word & instr_defs[rec.opcode_id].instruction_mask) == instr_defs[rec.opcode_id].instruction_match)
+        name = inst_names[instr_defs[rec.opcode_id].instruction_enum];
+    int len = snprintf(buf, size, "Timestamp: %s pc_val %u| instr: %u: %s, reg1: %s, reg2: %s, reg_rd: %s, selected_imm: %u\n",
+                       time, rec.pc, rec.word, name, gpr_names[rec.rs1 & 0x1f], gpr_names[rec.rs2 & 0x1f],
+                       gpr_names[rec.rd & 0x1f], rec.selected_imm);
+    return len < 0 ? 0 : min((size_t)len, size - 1);
+}
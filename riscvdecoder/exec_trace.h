@@ -0,0 +1,128 @@
+#ifndef __EXEC_TRACE__
+#define __EXEC_TRACE__
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+//--------------------------------------------------------------------
+// Binary execution trace. The simulation thread stores one fixed-size
+// record per instruction into a single-producer ring; a writer thread
+// drains it, delta-encodes pc and timestamp against the previous record
+// and writes the result to the trace file. rvtrace.elf renders a trace
+// file as the text the testbench used to print.
+//
+// File: exec_trace_header, then one record after another:
+//   varint  zigzag(pc - previous pc)
+//   varint  timestamp - previous timestamp, in resolution_fs units
+//   4 bytes instruction word, little endian
+//   varint  opcode_id
+//   2 bytes rs1 | rs2 << 5 | rd << 10
+//   varint  selected_imm
+// The first record's deltas are taken against zero.
+//--------------------------------------------------------------------
+#define EXEC_TRACE_MAGIC        0x52545652  // "RVTR"
+#define EXEC_TRACE_VER          1
+#define EXEC_TRACE_RING_BITS    16
+#define EXEC_TRACE_RING_SIZE    (1 << EXEC_TRACE_RING_BITS)
+#define EXEC_TRACE_MAX_ENCODED  31          // longest encoding of one record
+#define EXEC_TRACE_LINE         64
+#define EXEC_TRACE_TEXT_MAX     192         // longest exec_trace_format line
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t resolution_fs;     // length of one timestamp unit
+}exec_trace_header;
+
+typedef struct {
+    uint64_t timestamp;
+    uint32_t pc;
+    uint32_t word;
+    uint32_t opcode_id;
+    uint32_t selected_imm;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t rd;
+}exec_trace_record;
+
+class ExecTrace
+{
+public:
+    ExecTrace();
+    ~ExecTrace();
+    // creates path and starts the writer thread
+    bool open(const char *path, uint64_t resolution_fs);
+    // drains the ring, stops the writer and closes the file; false if
+    // anything failed to be written
+    bool close();
+    bool is_open() { return out != NULL; }
+    uint64_t records() { return head.load(memory_order_relaxed); }
+
+    // Called from the simulation thread only. Waits for the writer if
+    // the ring is full, so no record is ever dropped.
+    inline void record(uint64_t timestamp, uint32_t pc, uint32_t word, uint32_t opcode_id,
+                       uint32_t rs1, uint32_t rs2, uint32_t rd, uint32_t selected_imm)
+    {
+        uint64_t slot = head.load(memory_order_relaxed);
+        if (slot - tail_cache >= EXEC_TRACE_RING_SIZE)
+            wait_for_space(slot);
+        exec_trace_record &rec = ring[slot & (EXEC_TRACE_RING_SIZE - 1)];
+        rec.timestamp = timestamp;
+        rec.pc = pc;
+        rec.word = word;
+        rec.opcode_id = opcode_id;
+        rec.selected_imm = selected_imm;
+        rec.rs1 = rs1;
+        rec.rs2 = rs2;
+        rec.rd = rd;
+        head.store(slot + 1, memory_order_release);
+    }
+
+protected:
+    void wait_for_space(uint64_t slot);
+    void writer();
+
+    exec_trace_record *ring;
+    FILE *out;
+    thread writer_thread;
+    bool write_failed;
+    // producer side
+    alignas(EXEC_TRACE_LINE) atomic<uint64_t> head;
+    uint64_t tail_cache;        // last tail seen by the producer
+    // consumer side
+    alignas(EXEC_TRACE_LINE) atomic<uint64_t> tail;
+    atomic<bool> stopping;
+};
+
+// Sequential reader for rvtrace and other offline tools.
+class ExecTraceReader
+{
+public:
+    ExecTraceReader();
+    ~ExecTraceReader();
+    bool open(const char *path);
+    // false at the end of the trace; truncated() tells whether it ended
+    // inside a record
+    bool next(exec_trace_record *rec);
+    bool truncated() { return partial; }
+    uint64_t get_resolution_fs() { return header.resolution_fs; }
+
+protected:
+    FILE *in;
+    exec_trace_header header;
+    uint32_t last_pc;
+    uint64_t last_timestamp;
+    bool partial;
+};
+
+// encodes rec against the previous pc and timestamp into buf, returns its length
+size_t exec_trace_encode(uint8_t *buf, const exec_trace_record &rec, uint32_t *last_pc, uint64_t *last_timestamp);
+// rec as a line of the testbench's text trace, newline included, with the
+// time in fs printed the way sc_time prints it. opcode_id is an instr_defs
+// index; a word it does not match (the decoder leaves opcode_id alone for
+// unknown words) shows as "unknown". Returns the line's length.
+size_t exec_trace_format(char *buf, size_t size, const exec_trace_record &rec, uint64_t time_fs);
+#endif
@@ -0,0 +1,193 @@
+#include "guest_memory.h"
+#include <string.h>
+#include <algorithm>
+#include <sys/mman.h>
+
+GuestMemory::GuestMemory()
+{
+    for (int i = 0; i < GUEST_TABLE_SIZE; i++)
+        dir[i].store(NULL, memory_order_relaxed);
+    pages.store(0, memory_order_relaxed);
+}
+
+GuestMemory::~GuestMemory()
+{
+    for (int i = 0; i < GUEST_TABLE_SIZE; i++)
+        delete[] dir[i].load(memory_order_relaxed);
+    for (auto page = owned.begin(); page != owned.end(); page++)
+        delete[] *page;
+    for (auto mapping = mappings.begin(); mapping != mappings.end(); mapping++)
+        munmap(mapping->first, mapping->second);
+}
+
+void GuestMemory::add_range(uint32_t start_addr, uint64_t size)
+{
+    if (size == 0)
+        return;
+    guest_range range = {start_addr, min((uint64_t)start_addr + size, (uint64_t)1 << 32)};
+    // merge with every range it overlaps or touches
+    auto it = ranges.begin();
+    while (it != ranges.end() && it->end_addr < range.start_addr)
+        it++;
+    while (it != ranges.end() && it->start_addr <= range.end_addr)
+    {
+        range.start_addr = min(range.start_addr, it->start_addr);
+        range.end_addr = max(range.end_addr, it->end_addr);
+        it = ranges.erase(it);
+    }
+    ranges.insert(it, range);
+}
+
+bool GuestMemory::contains(uint32_t addr, uint32_t size)
+{
+    // last range starting at or below addr
+    auto it = upper_bound(ranges.begin(), ranges.end(), addr,
+                          [](uint32_t value, const guest_range &range) { return value < range.start_addr; });
+    if (it == ranges.begin())
+        return false;
+    it--;
+    return (uint64_t)addr + size <= it->end_addr;
+}
+
+// whether any byte of [addr, addr + size) is in a range
+bool GuestMemory::overlaps(uint32_t addr, uint64_t size)
+{
+    uint64_t end = (uint64_t)addr + size;
+    // first range ending above addr
+    auto it = upper_bound(ranges.begin(), ranges.end(), (uint64_t)addr,
+                          [](uint64_t value, const guest_range &range) { return value < range.end_addr; });
+    return it != ranges.end() && it->start_addr < end;
+}
+
+// second level table for addr, created if needed; with populate_mutex held
+atomic<uint8_t *> *GuestMemory::table_for(uint32_t addr)
+{
+    atomic<uint8_t *> *table = dir[GUEST_DIR_INDEX(addr)].load(memory_order_relaxed);
+    if (table == NULL)
+    {
+        table = new atomic<uint8_t *>[GUEST_TABLE_SIZE];
+        for (int i = 0; i < GUEST_TABLE_SIZE; i++)
+            table[i].store(NULL, memory_order_relaxed);
+        dir[GUEST_DIR_INDEX(addr)].store(table, memory_order_release);
+    }
+    return table;
+}
+
+uint8_t *GuestMemory::populate(uint32_t addr)
+{
+    if (!overlaps(addr & ~GUEST_PAGE_MASK, GUEST_PAGE_SIZE))
+        return NULL;
+    lock_guard<mutex> lock(populate_mutex);
+    atomic<uint8_t *> *table = table_for(addr);
+    // another thread may have got here first
+    uint8_t *host = table[GUEST_TABLE_INDEX(addr)].load(memory_order_relaxed);
+    if (host == NULL)
+    {
+        host = new uint8_t[GUEST_PAGE_SIZE]();
+        owned.push_back(host);
+        table[GUEST_TABLE_INDEX(addr)].store(host, memory_order_release);
+        pages.fetch_add(1, memory_order_relaxed);
+    }
+    return host;
+}
+
+bool GuestMemory::attach_page(uint32_t addr, uint8_t *host)
+{
+    if (!overlaps(addr & ~GUEST_PAGE_MASK, GUEST_PAGE_SIZE))
+        return false;
+    lock_guard<mutex> lock(populate_mutex);
+    atomic<uint8_t *> *table = table_for(addr);
+    if (table[GUEST_TABLE_INDEX(addr)].load(memory_order_relaxed) != NULL)
+        return false;
+    table[GUEST_TABLE_INDEX(addr)].store(host, memory_order_release);
+    pages.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+void GuestMemory::keep_mapping(void *base, size_t len)
+{
+    lock_guard<mutex> lock(populate_mutex);
+    mappings.push_back(make_pair(base, len));
+}
+
+uint8_t *GuestMemory::peek(uint32_t addr)
+{
+    atomic<uint8_t *> *table = dir[GUEST_DIR_INDEX(addr)].load(memory_order_acquire);
+    if (table == NULL)
+        return NULL;
+    uint8_t *host = table[GUEST_TABLE_INDEX(addr)].load(memory_order_acquire);
+    return host == NULL ? NULL : host + (addr & GUEST_PAGE_MASK);
+}
+
+bool GuestMemory::write(uint32_t addr, const void *src, uint32_t len)
+{
+    if (!contains(addr, len))
+        return false;
+    const uint8_t *bytes = (const uint8_t *)src;
+    while (len > 0)
+    {
+        uint32_t offset = addr & GUEST_PAGE_MASK;
+        uint32_t chunk = min(len, (uint32_t)GUEST_PAGE_SIZE - offset);
+        uint8_t *host = page(addr);
+        if (host == NULL)
+            return false;
+        memcpy(host + offset, bytes, chunk);
+        addr += chunk;
+        bytes += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+// untouched pages read as zero without being allocated
+bool GuestMemory::read(uint32_t addr, void *dst, uint32_t len)
+{
+    if (!contains(addr, len))
+        return false;
+    uint8_t *bytes = (uint8_t *)dst;
+    while (len > 0)
+    {
+        uint32_t offset = addr & GUEST_PAGE_MASK;
+        uint32_t chunk = min(len, (uint32_t)GUEST_PAGE_SIZE - offset);
+        uint8_t *host = peek(addr);
+        if (host != NULL)
+            memcpy(bytes, host, chunk);
+        else
+            memset(bytes, 0, chunk);
+        addr += chunk;
+        bytes += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+const vector<guest_range> &GuestMemory::get_ranges()
+{
+    return ranges;
+}
+
+uint64_t GuestMemory::mapped_size()
+{
+    uint64_t size = 0;
+    for (auto range = ranges.begin(); range != ranges.end(); range++)
+        size += range->end_addr - range->start_addr;
+    return size;
+}
+
+uint32_t GuestMemory::resident_pages()
+{
+    return pages.load(memory_order_relaxed);
+}
+
+void GuestMemory::page_addresses(vector<uint32_t> &addrs)
+{
+    for (uint32_t i = 0; i < GUEST_TABLE_SIZE; i++)
+    {
+        atomic<uint8_t *> *table = dir[i].load(memory_order_acquire);
+        if (table == NULL)
+            continue;
+        for (uint32_t j = 0; j < GUEST_TABLE_SIZE; j++)
+            if (table[j].load(memory_order_acquire) != NULL)
+                addrs.push_back((i << (GUEST_PAGE_BITS + GUEST_TABLE_BITS)) | (j << GUEST_PAGE_BITS));
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef __GUEST_MEMORY__
+#define __GUEST_MEMORY__
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+using namespace std;
+
+//--------------------------------------------------------------------
+// Sparse guest physical memory. The 32-bit address space is split into
+// 4 KiB pages found through a two-level table (10 + 10 bits, the same
+// split as Sv32); tables and pages are allocated zero-filled on first
+// touch. Only pages holding part of a mapped range (ELF sections, RAM
+// given with add_range) are backed, so a large .bss or RAM map costs
+// nothing until the guest uses it. Ranges need not be page aligned; a
+// page a range starts or ends in is backed as a whole.
+//
+// A page may also be attached from elsewhere, e.g. a private file mapping
+// made by the ELF loader, which is then copied on write by the host.
+//
+// Pages never move or go away before the object is destroyed, so host
+// pointers into a page stay valid. Lookups are lock free; populating a
+// page takes a lock, cores on host threads may touch memory concurrently.
+//--------------------------------------------------------------------
+#define GUEST_PAGE_BITS     12
+#define GUEST_PAGE_SIZE     (1 << GUEST_PAGE_BITS)
+#define GUEST_PAGE_MASK     (GUEST_PAGE_SIZE - 1)
+#define GUEST_TABLE_BITS    10
+#define GUEST_TABLE_SIZE    (1 << GUEST_TABLE_BITS)
+#define GUEST_DIR_INDEX(addr)   ((addr) >> (GUEST_PAGE_BITS + GUEST_TABLE_BITS))
+#define GUEST_TABLE_INDEX(addr) (((addr) >> GUEST_PAGE_BITS) & (GUEST_TABLE_SIZE - 1))
+
+typedef struct {
+    uint32_t start_addr;
+    uint64_t end_addr;      // exclusive, a range may end at 4 GiB
+}guest_range;
+
+class GuestMemory
+{
+public:
+    GuestMemory();
+    ~GuestMemory();
+    // back [start_addr, start_addr + size); ranges may overlap
+    void add_range(uint32_t start_addr, uint64_t size);
+    bool contains(uint32_t addr, uint32_t size);
+
+    // host address of the page holding addr, allocated if needed;
+    // NULL if no byte of the page is in a mapped range
+    uint8_t *page(uint32_t addr)
+    {
+        atomic<uint8_t *> *table = dir[GUEST_DIR_INDEX(addr)].load(memory_order_acquire);
+        if (table != NULL)
+        {
+            uint8_t *host = table[GUEST_TABLE_INDEX(addr)].load(memory_order_acquire);
+            if (host != NULL)
+                return host;
+        }
+        return populate(addr);
+    }
+    // host address of addr if its page has been touched, NULL otherwise
+    uint8_t *peek(uint32_t addr);
+    // use the GUEST_PAGE_SIZE bytes at host as the page holding addr;
+    // false if that page is already present or no byte of it is in a range
+    bool attach_page(uint32_t addr, uint8_t *host);
+    // mmap'ed memory to unmap on destruction
+    void keep_mapping(void *base, size_t len);
+
+    // copy to/from guest memory, false if any byte is outside the ranges
+    bool write(uint32_t addr, const void *src, uint32_t len);
+    bool read(uint32_t addr, void *dst, uint32_t len);
+
+    const vector<guest_range> &get_ranges();
+    uint64_t mapped_size();
+    // pages present in the table, allocated or attached
+    uint32_t resident_pages();
+    // their addresses, ascending
+    void page_addresses(vector<uint32_t> &addrs);
+
+protected:
+    atomic<atomic<uint8_t *> *> dir[GUEST_TABLE_SIZE];
+    vector<guest_range> ranges;     // sorted, disjoint
+    atomic<uint32_t> pages;
+    mutex populate_mutex;
+    vector<uint8_t *> owned;        // pages allocated by populate
+    vector<pair<void *, size_t>> mappings;
+
+    bool overlaps(uint32_t addr, uint64_t size);
+    uint8_t *populate(uint32_t addr);
+    atomic<uint8_t *> *table_for(uint32_t addr);
+};
+#endif
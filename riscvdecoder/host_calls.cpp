@@ -0,0 +1,408 @@
+#include "host_calls.h"
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// appends value formatted by the host printf with spec
+template <typename T> static void append_format(string &out, const string &spec, T value)
+{
+    int len = snprintf(NULL, 0, spec.c_str(), value);
+    if (len <= 0)
+        return;
+    size_t at = out.size();
+    out.resize(at + len + 1);
+    snprintf(&out[at], len + 1, spec.c_str(), value);
+    out.resize(at + len);
+}
+
+HostCalls::HostCalls(size_t console_buffer)
+{
+    console.resize(max(console_buffer, (size_t)1));
+    used = 0;
+    root_fd = -1;
+    for (int i = 0; i < HOSTCALL_MAX_FILES; i++)
+        files[i] = -1;
+}
+
+HostCalls::~HostCalls()
+{
+    close();
+    if (root_fd >= 0)
+        ::close(root_fd);
+}
+
+bool HostCalls::set_root(const char *dir)
+{
+    if (root_fd >= 0)
+        ::close(root_fd);
+    root_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return root_fd >= 0;
+}
+
+bool HostCalls::host_csr_write(RvCore *core, uint32_t csr_num, uint32_t value)
+{
+    if (csr_num != CSR_SIM_CTRL)
+        return false;
+    const uint32_t *a = &core->gpr[GPR_A0];
+    int32_t result;
+    switch (value & CORE_SIM_CTRL_CMD)
+    {
+    case CSR_SIM_CTRL_PUTC:
+    {
+        char c = (char)value;
+        console_put(&c, 1);
+        result = 0;
+        break;
+    }
+    case CSR_SIM_CTRL_GETC:
+        result = guest_getc();
+        break;
+    case CSR_SIM_PRINTF:
+        result = guest_printf(core);
+        break;
+    case CSR_SIM_CTRL_WRITE:
+        result = guest_write(core, a[0], a[1], a[2]);
+        break;
+    case CSR_SIM_CTRL_READ:
+        result = guest_read(core, a[0], a[1], a[2]);
+        break;
+    case CSR_SIM_CTRL_OPEN:
+        result = guest_open(core, a[0], a[1], a[2]);
+        break;
+    case CSR_SIM_CTRL_CLOSE:
+        result = guest_close(a[0]);
+        break;
+    default:
+        return false;
+    }
+    core->csr[CSR_SIM_CTRL] = (uint32_t)result;
+    return true;
+}
+
+void HostCalls::flush()
+{
+    if (used == 0)
+        return;
+    write_all(STDOUT_FILENO, console.data(), used);
+    used = 0;
+}
+
+void HostCalls::close()
+{
+    flush();
+    for (int i = 0; i < HOSTCALL_MAX_FILES; i++)
+    {
+        if (files[i] >= 0)
+            ::close(files[i]);
+        files[i] = -1;
+    }
+}
+
+void HostCalls::console_put(const void *data, size_t len)
+{
+    if (used + len > console.size())
+        flush();
+    if (len > console.size())
+    {
+        write_all(STDOUT_FILENO, data, len);
+        return;
+    }
+    memcpy(console.data() + used, data, len);
+    used += len;
+}
+
+int32_t HostCalls::guest_getc()
+{
+    // whatever the guest printed is likely the prompt
+    flush();
+    unsigned char c;
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, &c, 1)) < 0 && errno == EINTR)
+        ;
+    return n == 1 ? c : -1;
+}
+
+int32_t HostCalls::guest_printf(RvCore *core)
+{
+    string format, out;
+    if (!read_string(core, core->gpr[GPR_A0], format))
+        return -EFAULT;
+    uint32_t arg = 1;   // next argument, a1
+    auto next_arg = [&]() -> uint32_t { return arg <= HOSTCALL_PRINTF_ARGS ? core->gpr[GPR_A0 + arg++] : 0; };
+    // 64-bit varargs take an even/odd register pair
+    auto next_arg64 = [&]() -> uint64_t {
+        arg += arg & 1;
+        uint64_t low = next_arg();
+        return low | (uint64_t)next_arg() << 32;
+    };
+    for (size_t i = 0; i < format.size(); i++)
+    {
+        if (format[i] != '%')
+        {
+            out += format[i];
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion, rebuilt for the host printf
+        size_t start = i++;
+        string spec = "%";
+        while (i < format.size() && strchr("-+ #0", format[i]))
+            spec += format[i++];
+        for (bool precision = false; i < format.size(); i++)
+        {
+            if (format[i] == '*')
+                spec += to_string((int32_t)next_arg());
+            else if (isdigit((unsigned char)format[i]) || (format[i] == '.' && !precision))
+                spec += format[i];
+            else
+                break;
+            precision = precision || format[i] == '.';
+        }
+        int longs = 0;
+        for (; i < format.size() && strchr("hlzjt", format[i]); i++)
+            longs += format[i] == 'l';
+        if (i >= format.size())
+            break;
+        char conversion = format[i];
+        switch (conversion)
+        {
+        case '%':
+            out += '%';
+            break;
+        case 'd':
+        case 'i':
+            if (longs >= 2)
+                append_format(out, spec + "lld", (long long)next_arg64());
+            else
+                append_format(out, spec + "d", (int32_t)next_arg());
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            if (longs >= 2)
+                append_format(out, spec + "ll" + conversion, (unsigned long long)next_arg64());
+            else
+                append_format(out, spec + conversion, (uint32_t)next_arg());
+            break;
+        case 'c':
+            append_format(out, spec + "c", (int)(char)next_arg());
+            break;
+        case 's':
+        {
+            string str;
+            if (!read_string(core, next_arg(), str))
+                str = "(null)";
+            append_format(out, spec + "s", str.c_str());
+            break;
+        }
+        case 'p':
+            append_format(out, "0x%08x", next_arg());
+            break;
+        default:
+            // not a conversion we know, copied as is
+            out.append(format, start, i - start + 1);
+            break;
+        }
+    }
+    console_put(out.data(), out.size());
+    return out.size();
+}
+
+int32_t HostCalls::guest_write(RvCore *core, uint32_t fd, uint32_t addr, uint32_t len)
+{
+    int out = fd == STDERR_FILENO ? STDERR_FILENO : host_fd(fd);
+    if (fd != STDOUT_FILENO && out < 0)
+        return -EBADF;
+    // keep the console in order
+    if (fd == STDERR_FILENO)
+        flush();
+    uint32_t done = 0;
+    while (done < len)
+    {
+        uint32_t span;
+        uint8_t *p = guest_span(core, addr + done, len - done, MMU_ACCESS_LOAD, &span);
+        if (p == NULL)
+            return done ? (int32_t)done : -EFAULT;
+        if (fd == STDOUT_FILENO)
+        {
+            console_put(p, span);
+            done += span;
+            continue;
+        }
+        ssize_t n = write(out, p, span);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return done ? (int32_t)done : -errno;
+        done += n;
+        if ((uint32_t)n < span)
+            break;
+    }
+    return done;
+}
+
+int32_t HostCalls::guest_read(RvCore *core, uint32_t fd, uint32_t addr, uint32_t len)
+{
+    int in = fd == STDIN_FILENO ? STDIN_FILENO : host_fd(fd);
+    if (in < 0)
+        return -EBADF;
+    if (fd == STDIN_FILENO)
+        flush();
+    uint32_t done = 0;
+    while (done < len)
+    {
+        uint32_t span;
+        uint8_t *p = guest_span(core, addr + done, len - done, MMU_ACCESS_STORE, &span);
+        if (p == NULL)
+            return done ? (int32_t)done : -EFAULT;
+        ssize_t n = read(in, p, span);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return done ? (int32_t)done : -errno;
+        // not a store the cores saw: drop blocks and reservations on it
+        if (n > 0)
+            core->external_write(addr + done, p, n);
+        done += n;
+        // short read: end of file, or all the console had
+        if ((uint32_t)n < span)
+            break;
+    }
+    return done;
+}
+
+int32_t HostCalls::guest_open(RvCore *core, uint32_t path_addr, uint32_t flags, uint32_t mode)
+{
+    if (root_fd < 0)
+        return -EACCES;
+    string path;
+    if (!read_string(core, path_addr, path))
+        return -EFAULT;
+    if (path.empty() || path[0] == '/')
+        return -EACCES;
+    // no component may climb out of the root
+    vector<string> components;
+    for (size_t start = 0; start <= path.size();)
+    {
+        size_t slash = path.find('/', start);
+        if (slash == string::npos)
+            slash = path.size();
+        string component = path.substr(start, slash - start);
+        start = slash + 1;
+        if (component == "..")
+            return -EACCES;
+        if (!component.empty() && component != ".")
+            components.push_back(component);
+    }
+    int slot = 0;
+    while (slot < HOSTCALL_MAX_FILES && files[slot] >= 0)
+        slot++;
+    if (slot == HOSTCALL_MAX_FILES)
+        return -EMFILE;
+    static const int access_modes[] = {O_RDONLY, O_WRONLY, O_RDWR};
+    if ((flags & HOSTCALL_O_ACCMODE) > 2)
+        return -EINVAL;
+    int host_flags = access_modes[flags & HOSTCALL_O_ACCMODE] | O_NOFOLLOW | O_CLOEXEC;
+    if (flags & HOSTCALL_O_APPEND)
+        host_flags |= O_APPEND;
+    if (flags & HOSTCALL_O_CREAT)
+        host_flags |= O_CREAT;
+    if (flags & HOSTCALL_O_TRUNC)
+        host_flags |= O_TRUNC;
+    if (flags & HOSTCALL_O_EXCL)
+        host_flags |= O_EXCL;
+    // opened one directory at a time, none of them a symlink (O_NOFOLLOW
+    // on the last one as well), so the walk cannot leave the root
+    int dir = root_fd;
+    for (size_t i = 0; i + 1 < components.size(); i++)
+    {
+        int next = openat(dir, components[i].c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        int error = errno;
+        if (dir != root_fd)
+            ::close(dir);
+        if (next < 0)
+            return -error;
+        dir = next;
+    }
+    int fd = openat(dir, components.empty() ? "." : components.back().c_str(), host_flags, mode & 0777);
+    int error = errno;
+    if (dir != root_fd)
+        ::close(dir);
+    if (fd < 0)
+        return -error;
+    files[slot] = fd;
+    return slot + HOSTCALL_FIRST_FD;
+}
+
+int32_t HostCalls::guest_close(uint32_t fd)
+{
+    // the console stays open
+    if (fd < HOSTCALL_FIRST_FD)
+        return 0;
+    int host = host_fd(fd);
+    if (host < 0)
+        return -EBADF;
+    files[fd - HOSTCALL_FIRST_FD] = -1;
+    return ::close(host) < 0 ? -errno : 0;
+}
+
+int HostCalls::host_fd(uint32_t fd)
+{
+    if (fd < HOSTCALL_FIRST_FD || fd >= HOSTCALL_FIRST_FD + HOSTCALL_MAX_FILES)
+        return -1;
+    return files[fd - HOSTCALL_FIRST_FD];
+}
+
+uint8_t *HostCalls::guest_span(RvCore *core, uint32_t addr, uint32_t len, uint32_t access, uint32_t *span)
+{
+    *span = min(len, (uint32_t)MMU_PGSIZE - (addr & (MMU_PGSIZE - 1)));
+    uint8_t *p = core->translate(addr, *span, access);
+    if (p == NULL && *span > 1)
+    {
+        // the page may be split between image windows
+        *span = 1;
+        p = core->translate(addr, 1, access);
+    }
+    return p;
+}
+
+// false on a fault or with no terminator within HOSTCALL_MAX_STRING
+bool HostCalls::read_string(RvCore *core, uint32_t addr, string &str)
+{
+    str.clear();
+    while (str.size() < HOSTCALL_MAX_STRING)
+    {
+        uint32_t span;
+        const char *p = (const char *)guest_span(core, addr, HOSTCALL_MAX_STRING - str.size(), MMU_ACCESS_LOAD, &span);
+        if (p == NULL)
+            return false;
+        const char *end = (const char *)memchr(p, 0, span);
+        if (end != NULL)
+        {
+            str.append(p, end - p);
+            return true;
+        }
+        str.append(p, span);
+        addr += span;
+    }
+    return false;
+}
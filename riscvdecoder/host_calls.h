@@ -0,0 +1,82 @@
+#ifndef __HOST_CALLS__
+#define __HOST_CALLS__
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "rv_core.h"
+using namespace std;
+
+//--------------------------------------------------------------------
+// Host calls through CSR_SIM_CTRL. The command sits in bits 31:24 of the
+// value written, its arguments in the low 24 bits or in a0..a7:
+//   PUTC     low 8 bits to the console
+//   GETC     next byte of console input, -1 at the end of it
+//   PRINTF   printf(a0, a1..a7) to the console: flags, width, precision,
+//            h/l/ll and d i u x X o c s p %
+//   WRITE    write(a0 fd, a1 buf, a2 len)
+//   READ     read(a0 fd, a1 buf, a2 len)
+//   OPEN     open(a0 path, a1 flags, a2 mode), flags as newlib defines them
+//   CLOSE    close(a0 fd)
+// The result (character, byte count, fd, or -errno) is what the next read
+// of CSR_SIM_CTRL returns. EXIT never gets here, the core handles it.
+//
+// Console output (PUTC, PRINTF, writes to fd 1) collects in one buffer
+// that is written out when it fills, before the guest reads input or
+// writes to fd 2, and at flush()/close(); a guest printing a character at
+// a time costs a memcpy, not a host write. Guest fds 0..2 are the
+// console, files opened by the guest get 3 and up and map to host fds.
+// OPEN only sees the directory given to set_root(): absolute paths, ".."
+// components and symlinks anywhere in the path are refused, and with no
+// root every OPEN fails. READ goes through external_write(), so blocks
+// predecoded from the buffer and LR reservations on it are dropped.
+//
+// Not thread safe; RvPlatform's parallel mode defers host CSRs to its
+// SC_THREAD (defer_shared), so calls from different cores never overlap.
+//--------------------------------------------------------------------
+#define HOSTCALL_CONSOLE_BUFFER (64 << 10)
+#define HOSTCALL_MAX_FILES      32
+#define HOSTCALL_FIRST_FD       3           // guest fds below are the console
+#define HOSTCALL_MAX_STRING     4096        // longest path or %s argument
+#define HOSTCALL_PRINTF_ARGS    7           // a1..a7
+
+// newlib's open() flags, as the guest passes them
+#define HOSTCALL_O_ACCMODE      0x3
+#define HOSTCALL_O_APPEND       0x8
+#define HOSTCALL_O_CREAT        0x200
+#define HOSTCALL_O_TRUNC        0x400
+#define HOSTCALL_O_EXCL         0x800
+
+class HostCalls : public RvCoreHost
+{
+public:
+    HostCalls(size_t console_buffer = HOSTCALL_CONSOLE_BUFFER);
+    ~HostCalls();
+    // directory OPEN paths are relative to; false if it cannot be opened
+    bool set_root(const char *dir);
+    bool host_csr_write(RvCore *core, uint32_t csr_num, uint32_t value);
+    // writes out the buffered console output
+    void flush();
+    // flush() and close the files the guest left open
+    void close();
+
+protected:
+    void console_put(const void *data, size_t len);
+    int32_t guest_getc();
+    int32_t guest_printf(RvCore *core);
+    int32_t guest_write(RvCore *core, uint32_t fd, uint32_t addr, uint32_t len);
+    int32_t guest_read(RvCore *core, uint32_t fd, uint32_t addr, uint32_t len);
+    int32_t guest_open(RvCore *core, uint32_t path_addr, uint32_t flags, uint32_t mode);
+    int32_t guest_close(uint32_t fd);
+    // host fd behind guest fd, -1 if it is not open
+    int host_fd(uint32_t fd);
+    // host address of guest virtual addr for access and how many bytes
+    // from there (at most len) lie in the same page, NULL on a fault
+    uint8_t *guest_span(RvCore *core, uint32_t addr, uint32_t len, uint32_t access, uint32_t *span);
+    bool read_string(RvCore *core, uint32_t addr, string &str);
+
+    vector<char> console;
+    size_t used;
+    int root_fd;
+    int files[HOSTCALL_MAX_FILES];          // host fd per guest fd from HOSTCALL_FIRST_FD, -1 if free
+};
+#endif
@@ -0,0 +1,218 @@
+#include "image_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_CACHE_ALIGN(offset)   (((offset) + GUEST_PAGE_MASK) & ~(uint64_t)GUEST_PAGE_MASK)
+
+ImageCache::ImageCache()
+{
+    base = NULL;
+    size = 0;
+    mapping_given = false;
+    header = NULL;
+}
+
+ImageCache::~ImageCache()
+{
+    if (base != NULL && !mapping_given)
+        munmap(base, size);
+}
+
+// FNV-1a style over 64-bit words, then the tail bytes
+bool ImageCache::file_hash(const char *file, uint64_t *hash)
+{
+    int fd = open(file, O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    const uint8_t *data = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)st.st_size;
+    size_t words = st.st_size / 8;
+    for (size_t i = 0; i < words; i++)
+    {
+        uint64_t word;
+        memcpy(&word, data + i * 8, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    for (size_t i = words * 8; i < (size_t)st.st_size; i++)
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    munmap((void *)data, st.st_size);
+    *hash = h;
+    return true;
+}
+
+string ImageCache::path_for(const char *cache_dir, uint64_t hash)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return string(cache_dir) + "/" + name + IMAGE_CACHE_SUFFIX;
+}
+
+// count items of item_size at offset, aligned for them, all within file_size
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t align, uint64_t file_size)
+{
+    return offset % align == 0 && offset <= file_size && count <= (file_size - offset) / item_size;
+}
+
+bool ImageCache::load(const string &path, uint64_t elf_hash)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(image_cache_header))
+    {
+        close(fd);
+        return false;
+    }
+    uint8_t *data = (uint8_t *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    const image_cache_header *h = (const image_cache_header *)data;
+    bool valid = h->magic == IMAGE_CACHE_MAGIC && h->version == IMAGE_CACHE_VER && h->elf_hash == elf_hash &&
+                 h->insn_size == sizeof(core_insn) && h->op_max == CORE_OP_MAX && h->file_size == (uint64_t)st.st_size &&
+                 section_fits(h->regions_offset, h->region_count, sizeof(image_cache_region), alignof(image_cache_region), h->file_size) &&
+                 section_fits(h->ranges_offset, h->range_count, sizeof(guest_range), alignof(guest_range), h->file_size) &&
+                 section_fits(h->page_addrs_offset, h->page_count, sizeof(uint32_t), alignof(uint32_t), h->file_size) &&
+                 section_fits(h->pages_offset, h->page_count, GUEST_PAGE_SIZE, GUEST_PAGE_SIZE, h->file_size) &&
+                 section_fits(h->blocks_offset, h->block_count, sizeof(core_block_record), alignof(core_block_record), h->file_size) &&
+                 section_fits(h->insns_offset, h->insn_count, sizeof(core_insn), alignof(core_insn), h->file_size);
+    if (valid)
+    {
+        // names run from the end of the region array to at most the end of the file
+        const image_cache_region *regions = (const image_cache_region *)(data + h->regions_offset);
+        uint64_t names_size = h->file_size - (h->regions_offset + (uint64_t)h->region_count * sizeof(image_cache_region));
+        for (uint32_t i = 0; valid && i < h->region_count; i++)
+            valid = (uint64_t)regions[i].name_offset + regions[i].name_len <= names_size;
+    }
+    // a cache written by anything but save() must not send the core off the rails
+    valid = valid && RvCore::check_blocks((const core_block_record *)(data + h->blocks_offset), h->block_count,
+                                          (const core_insn *)(data + h->insns_offset), h->insn_count);
+    if (!valid)
+    {
+        munmap(data, st.st_size);
+        return false;
+    }
+    if (base != NULL && !mapping_given)
+        munmap(base, size);
+    base = data;
+    size = st.st_size;
+    mapping_given = false;
+    header = h;
+    return true;
+}
+
+void ImageCache::restore_image(RegionManager &regmgr, GuestMemory *mem, uint32_t *start_addr)
+{
+    const image_cache_region *regions = (const image_cache_region *)(base + header->regions_offset);
+    const char *names = (const char *)(regions + header->region_count);
+    for (uint32_t i = 0; i < header->region_count; i++)
+        regmgr.add_region({regions[i].start_addr, regions[i].end_addr, regions[i].region_size, 0,
+                           string(names + regions[i].name_offset, regions[i].name_len), regions[i].region_flags});
+    regmgr.init_regions();
+
+    const guest_range *ranges = (const guest_range *)(base + header->ranges_offset);
+    for (uint32_t i = 0; i < header->range_count; i++)
+        mem->add_range(ranges[i].start_addr, ranges[i].end_addr - ranges[i].start_addr);
+    const uint32_t *page_addrs = (const uint32_t *)(base + header->page_addrs_offset);
+    for (uint32_t i = 0; i < header->page_count; i++)
+    {
+        uint8_t *page = base + header->pages_offset + (uint64_t)i * GUEST_PAGE_SIZE;
+        // a page mem already has takes a copy; a page the ranges cover
+        // only in part attaches like any other, GuestMemory backing every
+        // page a range touches
+        if (!mem->attach_page(page_addrs[i], page))
+        {
+            uint8_t *host = mem->page(page_addrs[i]);
+            if (host != NULL)
+                memcpy(host, page, GUEST_PAGE_SIZE);
+        }
+    }
+    mem->keep_mapping(base, size);
+    mapping_given = true;
+    *start_addr = header->start_addr;
+}
+
+void ImageCache::restore_blocks(RvCore *core)
+{
+    core->import_blocks((const core_block_record *)(base + header->blocks_offset), header->block_count,
+                        (const core_insn *)(base + header->insns_offset));
+}
+
+bool ImageCache::save(const string &path, uint64_t elf_hash, uint32_t start_addr, RegionManager &regmgr,
+                      GuestMemory *mem, RvCore *core)
+{
+    const vector<region> &regions = regmgr.get_regions();
+    vector<image_cache_region> cache_regions;
+    string names;
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        cache_regions.push_back({reg_val->start_addr, reg_val->end_addr, reg_val->region_size, reg_val->region_flags,
+                                 (uint32_t)names.size(), (uint32_t)reg_val->region_name.size()});
+        names += reg_val->region_name;
+    }
+    const vector<guest_range> &ranges = mem->get_ranges();
+    vector<uint32_t> page_addrs;
+    mem->page_addresses(page_addrs);
+    vector<core_block_record> blocks;
+    vector<core_insn> insns;
+    core->export_blocks(blocks, insns);
+
+    image_cache_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IMAGE_CACHE_MAGIC;
+    header.version = IMAGE_CACHE_VER;
+    header.elf_hash = elf_hash;
+    header.insn_size = sizeof(core_insn);
+    header.op_max = CORE_OP_MAX;
+    header.start_addr = start_addr;
+    header.region_count = cache_regions.size();
+    header.range_count = ranges.size();
+    header.page_count = page_addrs.size();
+    header.block_count = blocks.size();
+    header.insn_count = insns.size();
+    header.regions_offset = sizeof(header);
+    header.ranges_offset = (header.regions_offset + cache_regions.size() * sizeof(image_cache_region) + names.size() + 7) & ~7ULL;
+    header.page_addrs_offset = header.ranges_offset + ranges.size() * sizeof(guest_range);
+    header.pages_offset = IMAGE_CACHE_ALIGN(header.page_addrs_offset + page_addrs.size() * sizeof(uint32_t));
+    header.blocks_offset = header.pages_offset + (uint64_t)page_addrs.size() * GUEST_PAGE_SIZE;
+    header.insns_offset = header.blocks_offset + blocks.size() * sizeof(core_block_record);
+    header.file_size = header.insns_offset + insns.size() * sizeof(core_insn);
+
+    string tmp_path = path + ".tmp." + to_string(getpid());
+    FILE *out = fopen(tmp_path.c_str(), "wb");
+    if (out == NULL)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(cache_regions.data(), sizeof(image_cache_region), cache_regions.size(), out) == cache_regions.size();
+    ok = ok && fwrite(names.data(), 1, names.size(), out) == names.size();
+    ok = ok && fseek(out, header.ranges_offset, SEEK_SET) == 0;
+    ok = ok && fwrite(ranges.data(), sizeof(guest_range), ranges.size(), out) == ranges.size();
+    ok = ok && fwrite(page_addrs.data(), sizeof(uint32_t), page_addrs.size(), out) == page_addrs.size();
+    ok = ok && fseek(out, header.pages_offset, SEEK_SET) == 0;
+    for (auto addr = page_addrs.begin(); ok && addr != page_addrs.end(); addr++)
+        ok = fwrite(mem->page(*addr), GUEST_PAGE_SIZE, 1, out) == 1;
+    ok = ok && fwrite(blocks.data(), sizeof(core_block_record), blocks.size(), out) == blocks.size();
+    ok = ok && fwrite(insns.data(), sizeof(core_insn), insns.size(), out) == insns.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef __IMAGE_CACHE__
+#define __IMAGE_CACHE__
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "elf_parser.h"
+#include "guest_memory.h"
+#include "rv_core.h"
+using namespace std;
+
+//--------------------------------------------------------------------
+// On-disk cache of a loaded and predecoded ELF, named after a hash of
+// the ELF's contents. It holds the RegionManager regions, the guest
+// memory ranges and loaded pages, and RvCore's predecoded blocks; a run
+// finding a valid cache maps it instead of parsing and decoding the ELF.
+// The pages are page aligned in the file and attached to guest memory
+// straight from a private mapping, copy-on-write like the ELF loader.
+//
+// A cache only matches a simulator with the same IMAGE_CACHE_VER, and
+// the same core_insn layout and handler numbering; bump the version
+// whenever predecode() changes what it produces.
+//--------------------------------------------------------------------
+#define IMAGE_CACHE_MAGIC   0x43495652  // "RVIC"
+#define IMAGE_CACHE_VER     1
+#define IMAGE_CACHE_SUFFIX  ".rvic"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t elf_hash;
+    uint32_t insn_size;         // sizeof(core_insn)
+    uint32_t op_max;            // CORE_OP_MAX
+    uint32_t start_addr;
+    uint32_t region_count;
+    uint32_t range_count;
+    uint32_t page_count;
+    uint32_t block_count;
+    uint32_t insn_count;
+    uint64_t regions_offset;    // image_cache_region[region_count], then the names
+    uint64_t ranges_offset;     // guest_range[range_count]
+    uint64_t page_addrs_offset; // uint32_t[page_count]
+    uint64_t pages_offset;      // page_count pages, page aligned
+    uint64_t blocks_offset;     // core_block_record[block_count]
+    uint64_t insns_offset;      // core_insn[insn_count]
+    uint64_t file_size;
+}image_cache_header;
+
+typedef struct {
+    uint32_t start_addr;
+    uint32_t end_addr;
+    uint32_t region_size;
+    uint32_t region_flags;
+    uint32_t name_offset;       // from the end of the region array
+    uint32_t name_len;
+}image_cache_region;
+
+class ImageCache
+{
+public:
+    ImageCache();
+    ~ImageCache();
+    // hash of the file's contents, false if it cannot be read
+    static bool file_hash(const char *file, uint64_t *hash);
+    static string path_for(const char *cache_dir, uint64_t hash);
+
+    // maps the cache at path if it is valid for elf_hash and this build,
+    // with every section, region name and block inside the file and every
+    // instruction one the core can run; anything else is a miss
+    bool load(const string &path, uint64_t elf_hash);
+    // regions into regmgr, ranges and pages into mem; mem takes over the
+    // mapping, so the cache can go away before it
+    void restore_image(RegionManager &regmgr, GuestMemory *mem, uint32_t *start_addr);
+    // the blocks are used from the mapping, which must outlive core
+    void restore_blocks(RvCore *core);
+    bool loaded() { return header != NULL; }
+
+    // writes the image as loaded, with core's blocks, to path; written to
+    // a temporary file first, concurrent runs may save the same ELF
+    static bool save(const string &path, uint64_t elf_hash, uint32_t start_addr, RegionManager &regmgr,
+                     GuestMemory *mem, RvCore *core);
+
+protected:
+    uint8_t *base;
+    size_t size;
+    bool mapping_given;         // unmapped by the GuestMemory it was restored into
+    const image_cache_header *header;
+};
+#endif
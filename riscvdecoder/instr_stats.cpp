@@ -0,0 +1,99 @@
+#include "instr_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+#define INSTR_TYPE_CLASSES  (INSTR_TYPE_J - INSTR_TYPE_BASE)
+#define IMM_TYPE_CLASSES    (IMM_TYPE_JIMM20 - IMM_TYPE_BASE)
+
+static mutex stats_lock;
+static vector<InstrStatsBlock *> stats_blocks;
+
+InstrStatsBlock *instr_stats_register()
+{
+    InstrStatsBlock *block = new InstrStatsBlock();
+    lock_guard<mutex> guard(stats_lock);
+    stats_blocks.push_back(block);
+    return block;
+}
+
+typedef struct {
+    uint64_t total;
+    uint64_t unknown;
+    uint64_t instructions[ENUM_INST_MAX];
+    uint64_t types[INSTR_TYPE_CLASSES];
+    uint64_t imms[IMM_TYPE_CLASSES];
+}instr_mix;
+
+static void build_mix(instr_mix &mix, bool executed)
+{
+    memset(&mix, 0, sizeof(mix));
+    lock_guard<mutex> guard(stats_lock);
+    for (auto block = stats_blocks.begin(); block != stats_blocks.end(); block++)
+    {
+        const uint64_t *counts = executed ? (*block)->executed : (*block)->decoded;
+        mix.unknown += counts[0];
+        mix.total += counts[0];
+        for (int i = 0; i < MAX_INSTR; i++)
+        {
+            const instr_def &idef = instr_defs[i];
+            uint64_t count = counts[i + 1];
+            mix.total += count;
+            mix.instructions[idef.instruction_enum] += count;
+            mix.types[idef.instruction_type - INSTR_TYPE_DEFAULT] += count;
+            mix.imms[idef.immediate_type - IMM_TYPE_NONE] += count;
+        }
+    }
+}
+
+static void write_json_mix(FILE *out, const char *name, const instr_mix &mix)
+{
+    fprintf(out, "  \"%s\": {\n    \"total\": %llu,\n    \"unknown\": %llu,\n    \"instructions\": {", name,
+            (unsigned long long)mix.total, (unsigned long long)mix.unknown);
+    for (int i = 0; i < ENUM_INST_MAX; i++)
+        fprintf(out, "%s\n      \"%s\": %llu", i ? "," : "", inst_names[i], (unsigned long long)mix.instructions[i]);
+    fprintf(out, "\n    },\n    \"instr_types\": {");
+    for (int i = 0; i < INSTR_TYPE_CLASSES; i++)
+        fprintf(out, "%s\n      \"%s\": %llu", i ? "," : "", instr_types[i], (unsigned long long)mix.types[i]);
+    fprintf(out, "\n    },\n    \"imm_types\": {");
+    for (int i = 0; i < IMM_TYPE_CLASSES; i++)
+        fprintf(out, "%s\n      \"%s\": %llu", i ? "," : "", imm_types[i], (unsigned long long)mix.imms[i]);
+    fprintf(out, "\n    }\n  }");
+}
+
+bool instr_stats_report(const char *path)
+{
+    instr_mix decoded, executed;
+    build_mix(decoded, false);
+    build_mix(executed, true);
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+        return false;
+    size_t len = strlen(path);
+    if (len >= 4 && !strcmp(path + len - 4, ".csv"))
+    {
+        fprintf(out, "group,name,decoded,executed\n");
+        fprintf(out, "total,all,%llu,%llu\n", (unsigned long long)decoded.total, (unsigned long long)executed.total);
+        fprintf(out, "total,unknown,%llu,%llu\n", (unsigned long long)decoded.unknown, (unsigned long long)executed.unknown);
+        for (int i = 0; i < ENUM_INST_MAX; i++)
+            fprintf(out, "instruction,%s,%llu,%llu\n", inst_names[i], (unsigned long long)decoded.instructions[i],
+                    (unsigned long long)executed.instructions[i]);
+        for (int i = 0; i < INSTR_TYPE_CLASSES; i++)
+            fprintf(out, "instr_type,%s,%llu,%llu\n", instr_types[i], (unsigned long long)decoded.types[i],
+                    (unsigned long long)executed.types[i]);
+        for (int i = 0; i < IMM_TYPE_CLASSES; i++)
+            fprintf(out, "imm_type,%s,%llu,%llu\n", imm_types[i], (unsigned long long)decoded.imms[i],
+                    (unsigned long long)executed.imms[i]);
+    }
+    else
+    {
+        fprintf(out, "{\n");
+        write_json_mix(out, "decoded", decoded);
+        fprintf(out, ",\n");
+        write_json_mix(out, "executed", executed);
+        fprintf(out, "\n}\n");
+    }
+    return fclose(out) == 0;
+}
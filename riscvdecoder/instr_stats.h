@@ -0,0 +1,44 @@
+#ifndef __INSTR_STATS__
+#define __INSTR_STATS__
+#include <stdint.h>
+#include "isa.h"
+
+//--------------------------------------------------------------------
+// Instruction-mix counters. Built only with -DRV_INSTR_STATS (make
+// STATS=1); otherwise the macros below expand to nothing.
+//
+// Counters are indexed by instr_defs index + 1 (slot 0 counts unknown
+// encodings) and kept per host thread in cache-line aligned blocks, so
+// counting is a plain increment with no sharing between threads.
+// eInstructions, instr_types and imm_types totals are derived from the
+// table when the report is written.
+//--------------------------------------------------------------------
+#define INSTR_STATS_SLOTS   (MAX_INSTR + 1)
+#define INSTR_STATS_LINE    64
+
+struct alignas(INSTR_STATS_LINE) InstrStatsBlock
+{
+    uint64_t decoded[INSTR_STATS_SLOTS];
+    uint64_t executed[INSTR_STATS_SLOTS];
+};
+
+InstrStatsBlock *instr_stats_register();
+// writes CSV when path ends in ".csv", JSON otherwise; returns false on I/O error
+bool instr_stats_report(const char *path);
+
+inline InstrStatsBlock &instr_stats_local()
+{
+    static thread_local InstrStatsBlock *block = instr_stats_register();
+    return *block;
+}
+
+#ifdef RV_INSTR_STATS
+#define INSTR_STATS_DECODE(opcode_id)   (instr_stats_local().decoded[(opcode_id) + 1]++)
+#define INSTR_STATS_EXECUTE(opcode_id)  (instr_stats_local().executed[(opcode_id) + 1]++)
+#define INSTR_STATS_REPORT(path)        instr_stats_report(path)
+#else
+#define INSTR_STATS_DECODE(opcode_id)   ((void)0)
+#define INSTR_STATS_EXECUTE(opcode_id)  ((void)0)
+#define INSTR_STATS_REPORT(path)        ((void)(path))
+#endif
+#endif
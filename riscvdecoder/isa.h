@@ -2,7 +2,7 @@
 #ifndef __RISCV_ISA_H__
 #define __RISCV_ISA_H__
 
-//#define C_EXTENSION
+#define C_EXTENSION
 
 //-----------------------------------------------------------------
 // General:
@@ -231,6 +231,8 @@ enum eInstructions
     ENUM_INST_REM,
     ENUM_INST_REMU,
     ENUM_INST_FENCE,
+    ENUM_INST_SFENCE,
+    ENUM_INST_IFENCE,
     ENUM_INST_WFI,
     ENUM_INST_AMOLR_W,
     ENUM_INST_AMOSC_W,
@@ -305,6 +307,8 @@ static const char * inst_names[ENUM_INST_MAX+1] =
     [ENUM_INST_REM] = "rem",
     [ENUM_INST_REMU] = "remu",
     [ENUM_INST_FENCE] = "fence",
+    [ENUM_INST_SFENCE] = "sfence.vma",
+    [ENUM_INST_IFENCE] = "fence.i",
     [ENUM_INST_WFI] = "wfi",
     [ENUM_INST_AMOLR_W]     = "amolr.w",
     [ENUM_INST_AMOSC_W]     = "amosc.w",
@@ -564,7 +568,7 @@ static const char * inst_names[ENUM_INST_MAX+1] =
 
 // wfi
 #define INST_WFI 0x10500073
-#define INST_WFI_MASK 0xffff8fff
+#define INST_WFI_MASK 0xffffffff
 
 
 // amoswap
@@ -639,7 +643,9 @@ static const char * inst_names[ENUM_INST_MAX+1] =
 
 #define SR_GET_MPP(val) (((val) >> SR_MPP_SHIFT) & SR_MPP_MASK)
 
+#define SR_MPRV         (1 << 17)
 #define SR_SUM          (1 << 18)
+#define SR_MXR          (1 << 19)
 
 #define SR_SMODE_MASK   (SR_UIE | SR_SIE | SR_UPIE | SR_SPIE | SR_SPP | SR_SUM)
 
@@ -874,7 +880,7 @@ static const char * inst_names[ENUM_INST_MAX+1] =
 #define MISA_RVS MISA_RV('S')
 #define MISA_RVU MISA_RV('U')
 
-#define MISA_VALUE (MISA_RV32 | MISA_RVI | MISA_RVM | MISA_RVS | MISA_RVU)
+#define MISA_VALUE (MISA_RV32 | MISA_RVI | MISA_RVM | MISA_RVA | MISA_RVC | MISA_RVS | MISA_RVU)
 
 //--------------------------------------------------------------------
 // Register Enumerations:
@@ -1056,7 +1062,7 @@ static const char * gpr_names[REGISTERS] =
 #define IMM_TYPE_BIMM 305
 #define IMM_TYPE_JIMM20 306
 
-#define MAX_INSTR 67
+#define MAX_INSTR 71
 
 static const char* instr_types[7] = {
     [0] = "default",
@@ -1086,7 +1092,7 @@ typedef struct{
     uint32_t shift_amt;
 }instr_def;
 
-static instr_def instr_defs[] = {
+static constexpr instr_def instr_defs[MAX_INSTR] = {
     {ENUM_INST_ANDI, INST_ANDI_MASK, INST_ANDI, INSTR_TYPE_I, IMM_TYPE_IMM12, SHAMT_NOT_REQUIRED},
     {ENUM_INST_ADDI, INST_ADDI_MASK, INST_ADDI, INSTR_TYPE_I, IMM_TYPE_IMM12, SHAMT_NOT_REQUIRED},
     {ENUM_INST_SLTI, INST_SLTI_MASK, INST_SLTI, INSTR_TYPE_I, IMM_TYPE_IMM12, SHAMT_NOT_REQUIRED},
@@ -1096,7 +1102,7 @@ static instr_def instr_defs[] = {
     {ENUM_INST_SRLI, INST_SRLI_MASK, INST_SRLI, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_REQUIRED},
     {ENUM_INST_SRAI, INST_SRAI_MASK, INST_SRAI, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_REQUIRED},
     {ENUM_INST_LUI, INST_LUI_MASK, INST_LUI, INSTR_TYPE_DEFAULT, IMM_TYPE_IMM20, SHAMT_NOT_REQUIRED},
-    {ENUM_INST_AUIPC, INST_LUI_MASK, INST_AUIPC, INSTR_TYPE_DEFAULT, IMM_TYPE_IMM20, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_AUIPC, INST_AUIPC_MASK, INST_AUIPC, INSTR_TYPE_DEFAULT, IMM_TYPE_IMM20, SHAMT_NOT_REQUIRED},
     {ENUM_INST_ADD, INST_ADD_MASK, INST_ADD, INSTR_TYPE_R, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_SUB, INST_SUB_MASK, INST_SUB, INSTR_TYPE_R, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_SLT, INST_SLT_MASK, INST_SLT, INSTR_TYPE_R, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
@@ -1141,9 +1147,9 @@ static instr_def instr_defs[] = {
     {ENUM_INST_DIVU, INST_DIVU_MASK, INST_DIVU, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_REM, INST_REM_MASK, INST_REM, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_REMU, INST_REMU_MASK, INST_REMU, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
-    {ENUM_INST_FENCE, INST_SFENCE_MASK, INST_SFENCE, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_SFENCE, INST_SFENCE_MASK, INST_SFENCE, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_FENCE, INST_FENCE_MASK, INST_FENCE, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
-    {ENUM_INST_FENCE, INST_IFENCE_MASK, INST_IFENCE, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_IFENCE, INST_IFENCE_MASK, INST_IFENCE, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_WFI, INST_WFI_MASK, INST_WFI, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_AMOLR_W, INST_AMO_MASK, INST_AMOLR_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_AMOSC_W, INST_AMO_MASK, INST_AMOSC_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
@@ -1154,5 +1160,9 @@ static instr_def instr_defs[] = {
     {ENUM_INST_AMOXOR_W, INST_AMO_MASK, INST_AMOXOR_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_AMOMAX_W, INST_AMO_MASK, INST_AMOMAX_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
     {ENUM_INST_AMOMIN_W, INST_AMO_MASK, INST_AMOMIN_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_SLTIU, INST_SLTIU_MASK, INST_SLTIU, INSTR_TYPE_I, IMM_TYPE_IMM12, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_BLTU, INST_BLTU_MASK, INST_BLTU, INSTR_TYPE_B, IMM_TYPE_BIMM, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_AMOMAXU_W, INST_AMO_MASK, INST_AMOMAXU_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
+    {ENUM_INST_AMOMINU_W, INST_AMO_MASK, INST_AMOMINU_W, INSTR_TYPE_DEFAULT, IMM_TYPE_NONE, SHAMT_NOT_REQUIRED},
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+// RegionManager address translation throughput. Synthetic section
+// layouts (and optionally an ELF's own sections) are looked up with the
+// old linear scan, the binary search with its last-hit check, and the
+// page table; the numbers are printed and appended to a CSV file.
+//   region_bench.elf [-elf file.elf] [-o results.csv]
+#include "elf_parser.h"
+#include "bench_workloads.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <string.h>
+
+#define REGION_BENCH_LOOKUPS    (1 << 22)
+#define REGION_BENCH_RESULTS    "region_bench.csv"
+#define REGION_BENCH_RUN        32      // local workload: lookups per region before moving on
+
+// reference: first region in address order holding addr
+static uint32_t scan_mem_address(const vector<region> &regions, uint32_t addr)
+{
+    for (auto region_val = regions.begin(); region_val != regions.end(); region_val++)
+        if (region_val->start_addr <= addr && region_val->end_addr > addr)
+            return region_val->region_base + (addr - region_val->start_addr);
+    return -1;
+}
+
+// n sections the way -ffunction-sections lays them out: small, mostly
+// back to back, some alignment gaps, and a NOBITS section overlapping
+// the ones after it every 64 sections (.tbss)
+static void synthetic_regions(RegionManager &regmgr, uint32_t n)
+{
+    mt19937 rng(3);
+    uint32_t addr = 0x80000000;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t size = 16 + (rng() % 1024) * 4;
+        if (i % 64 == 63)
+            regmgr.add_region({addr, addr + size, size, 0, ".tbss", SHF_ALLOC | SHF_WRITE});
+        else
+        {
+            regmgr.add_region({addr, addr + size, size, 0, ".text.f" + to_string(i), SHF_ALLOC | SHF_EXECINSTR});
+            addr += size;
+        }
+        addr += (rng() % 4) * 16;
+    }
+    regmgr.init_regions();
+}
+
+// addresses inside and between the regions; local runs stay in one region
+static void lookup_addresses(const vector<region> &regions, bool local, vector<uint32_t> &addrs)
+{
+    mt19937 rng(4);
+    uint32_t first = regions.front().start_addr;
+    uint32_t span = regions.back().end_addr - first;
+    addrs.resize(REGION_BENCH_LOOKUPS);
+    for (size_t i = 0; i < addrs.size(); i++)
+    {
+        if (!local)
+            addrs[i] = first + rng() % span;
+        else if (i % REGION_BENCH_RUN == 0)
+            addrs[i] = first + rng() % span;
+        else
+        {
+            const region &reg = regions[rng() % regions.size()];
+            addrs[i] = i % REGION_BENCH_RUN == 1 ? reg.start_addr : addrs[i - 1] + 4;
+        }
+    }
+}
+
+template <typename F>
+static double run_bench(const vector<uint32_t> &addrs, F lookup, uint64_t *checksum)
+{
+    auto start = chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < addrs.size(); i++)
+        sum += lookup(addrs[i]);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    *checksum = sum;
+    return elapsed.count();
+}
+
+static void report(const char *results_file, const char *path, const string &workload, uint64_t lookups, double seconds)
+{
+    cout << "  " << path << ": " << lookups / seconds / 1e6 << " Mlookups/s" << endl;
+    bench_record(results_file, path, workload.c_str(), lookups, seconds);
+}
+
+static bool bench_regions(const string &name, RegionManager &regmgr, const char *results_file)
+{
+    const vector<region> &regions = regmgr.get_regions();
+    RegionManager paged = regmgr;
+    bool has_table = paged.build_page_table();
+    for (int local = 0; local < 2; local++)
+    {
+        string workload = name + (local ? "_local" : "_random");
+        vector<uint32_t> addrs;
+        lookup_addresses(regions, local, addrs);
+        for (size_t i = 0; i < addrs.size(); i++)
+        {
+            uint32_t want = scan_mem_address(regions, addrs[i]);
+            if (regmgr.get_mem_address(addrs[i]) != want || paged.get_mem_address(addrs[i]) != want)
+            {
+                cout << "Mismatch for address " << hex << addrs[i] << dec << endl;
+                return false;
+            }
+        }
+        uint64_t scan_sum, search_sum, table_sum;
+        cout << workload << " (" << regions.size() << " sections):" << endl;
+        report(results_file, "linear", workload, addrs.size(),
+               run_bench(addrs, [&](uint32_t addr) { return scan_mem_address(regions, addr); }, &scan_sum));
+        report(results_file, "search", workload, addrs.size(),
+               run_bench(addrs, [&](uint32_t addr) { return regmgr.get_mem_address(addr); }, &search_sum));
+        if (has_table)
+            report(results_file, "page_table", workload, addrs.size(),
+                   run_bench(addrs, [&](uint32_t addr) { return paged.get_mem_address(addr); }, &table_sum));
+        if (scan_sum != search_sum || (has_table && scan_sum != table_sum))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *elf_file = NULL;
+    const char *results_file = REGION_BENCH_RESULTS;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], "-elf"))
+            elf_file = argv[++i];
+        else if (!strcmp(argv[i], "-o"))
+            results_file = argv[++i];
+    }
+
+    const uint32_t section_counts[] = {16, 256, 2048};
+    for (uint32_t n : section_counts)
+    {
+        RegionManager regmgr;
+        synthetic_regions(regmgr, n);
+        if (!bench_regions("sections" + to_string(n), regmgr, results_file))
+            return 1;
+    }
+    if (elf_file != NULL)
+    {
+        uint8_t *mem = NULL;
+        uint32_t total_mem_size = 0;
+        uint32_t start_addr = 0;
+        ELFParser elf_parser(elf_file, &start_addr, &mem, &total_mem_size, false);
+        if (mem == NULL)
+            cout << "elf: skipped, unable to load " << elf_file << endl;
+        else if (!bench_regions("elf", elf_parser.regmgr, results_file))
+            return 1;
+        delete[] mem;
+    }
+    return 0;
+}
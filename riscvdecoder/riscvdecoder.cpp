@@ -1,159 +1,244 @@
+#define SC_INCLUDE_DYNAMIC_PROCESSES    // sc_spawn in rv_platform.h
+#include <systemc.h>
 #include "elf_parser.h"
-#include "isa.h"
+#include "testbench.h"
+#include "rv_core.h"
+#include "rv_platform.h"
+#include "image_cache.h"
+#include "host_calls.h"
+#include "wave_tracer.h"
+#ifdef RV_AOT
+#include "rv_aot.h"
+#endif
+#include <chrono>
+#include <sys/stat.h>
 
-SC_MODULE(RV_DECODER)
+// Process exit status once the guest is done: the CSR_SIM_CTRL_EXIT value,
+// a0 after an ecall or ebreak nothing handles, 0 when pc ran off the end of
+// a text section and 1 after any other trap.
+static int guest_exit_status(RvCore *core, const vector<region> &regions)
 {
-    sc_in<bool> clk;
-    sc_in<bool> reset;
-    sc_in<sc_uint<32>> instr;
-    sc_out<sc_uint<5>> rs1;
-    sc_out<sc_uint<5>> rs2;
-    sc_out<sc_uint<5>> rd;
-    sc_out<sc_uint<32>> imm_12_itype;
-    sc_out<sc_uint<32>> imm_12_sbtype;
-    sc_out<sc_uint<32>> imm_20_ujtype;
-    sc_out<sc_uint<32>> selected_imm;
-    sc_out<sc_uint<32>> shift_amt;
-    sc_out<sc_uint<32>> opcode_id;
-    void perform_decoding()
+    if (core->halted && core->halt_cause == CORE_HALT_EXIT)
+        return core->exit_code;
+    if (core->halted && (core->halt_cause == MCAUSE_BREAKPOINT ||
+                         (core->halt_cause >= MCAUSE_ECALL_U && core->halt_cause <= MCAUSE_ECALL_M)))
+        return core->gpr[10];
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+        if ((reg_val->region_flags & SHF_EXECINSTR) && core->pc == reg_val->end_addr)
+            return 0;
+    return 1;
+}
+
+int sc_main(int argc, char *argv[])
+{
+    Testbench tb("tb");
+    WaveTracer waves("waves");
+    HostCalls host_calls;
+    // riscvdecoder.elf [options] [file.elf], elfs/linux.elf by default
+    // -tlm: drive the decoder through its TLM socket instead of the clocked pins
+    // -clock thread|sc_clock|cycle: how the clocked path is driven (testbench.h)
+    // -packed: one sc_signal<DecodedInstr> update per instruction instead of ten
+    // -stats file: instruction-mix report (.csv or JSON), needs make STATS=1
+    // -exec: execute each decoded instruction (TLM path) with RvCore
+    // -fast: execute with RvCore's predecoded blocks, no per-instruction decode
+    // -aot: with -fast, run the blocks translated by rvaot (make aot)
+    // -cores n: n RvCores on the shared image (rv_platform.h), started by thread CSRs
+    // -quantum ns: how far a core may run ahead of simulated time
+    // -parallel: with -cores, every core on its own host thread, meeting once per quantum
+    // -ram mb: back mb MiB from the lowest section address, allocated as the guest touches it
+    // -trace file: binary per-instruction trace instead of the text one (exec_trace.h, rvtrace.elf), not with -fast
+    // -wave file [-wave-signals globs] [-wave-start ns] [-wave-stop ns]: waveforms of the matching signals (wave_tracer.h)
+    // -hostfs dir: directory the guest's CSR_SIM_CTRL_OPEN calls may open files in (host_calls.h)
+    // -cache dir: load the image and predecoded blocks from dir, or save them there (image_cache.h)
+    const char *stats_file = "instr_stats.json";
+    const char *elf_file = "elfs/linux.elf";
+    uint32_t ram_mb = 0;
+    const char *cache_dir = NULL;
+    const char *trace_file = NULL;
+    RvCore interp_core;
+#ifdef RV_AOT
+    AotCore aot_core;
+#endif
+    RvCore *core = &interp_core;
+    bool execute = false;
+    bool fast = false;
+    uint32_t num_cores = 0;
+    uint32_t quantum_ns = FETCH_QUANTUM_NS;
+    bool parallel = false;
+    for (int i = 1; i < argc; i++)
     {
-        rs1 = instr.read().range(20, 15);          // bits 15-20
-        rs2 = instr.read().range(25, 21);          // bits 21-25
-        rd = instr.read().range(12, 7);            // bits 7-12
-        imm_12_itype = instr.read().range(31, 20); // bits 31,20
-        imm_12_sbtype = (instr.read().range(31, 24) << 5) | instr.read().range(11, 7);
-        imm_20_ujtype = instr.read().range(31, 12);
-        shift_amt = instr.read().range(24, 20);
-        for (int i = 0; i < MAX_INSTR; i++)
+        if (!strcmp(argv[i], "-tlm"))
+            tb.set_tlm_mode(true);
+        else if (!strcmp(argv[i], "-packed"))
+            tb.set_packed_output();
+        else if (!strcmp(argv[i], "-clock") && i + 1 < argc)
+        {
+            clock_mode mode;
+            if (clock_mode_by_name(argv[++i], &mode))
+                tb.set_clock_mode(mode);
+            else
+                cout << "Unknown clock mode " << argv[i] << ", using thread" << endl;
+        }
+        else if (!strcmp(argv[i], "-stats") && i + 1 < argc)
+            stats_file = argv[++i];
+        else if (!strcmp(argv[i], "-exec") || !strcmp(argv[i], "-fast"))
+        {
+            execute = true;
+            fast = fast || !strcmp(argv[i], "-fast");
+        }
+        else if (!strcmp(argv[i], "-cores") && i + 1 < argc)
+            num_cores = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-quantum") && i + 1 < argc)
+            quantum_ns = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-parallel"))
+            parallel = true;
+        else if (!strcmp(argv[i], "-ram") && i + 1 < argc)
+            ram_mb = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-cache") && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (!strcmp(argv[i], "-hostfs") && i + 1 < argc)
+        {
+            if (!host_calls.set_root(argv[++i]))
+                cout << "Unable to open " << argv[i] << endl;
+        }
+        else if (!strcmp(argv[i], "-trace") && i + 1 < argc)
+            trace_file = argv[++i];
+        else if (!strcmp(argv[i], "-aot"))
         {
-            uint32_t opcode_val = instr.read();
-            instr_def idef = instr_defs[i];
-            if ((opcode_val & idef.instruction_mask) == idef.instruction_match)
-            {
-                opcode_id.write(i);
-                switch (idef.immediate_type)
-                {
-                case IMM_TYPE_NONE:
-                    selected_imm = 0;
-                    break;
-                case IMM_TYPE_IMM12:
-                    selected_imm = imm_12_itype;
-                    break;
-                case IMM_TYPE_IMM20:
-                    selected_imm = imm_20_ujtype;
-                    break;
-                case IMM_TYPE_SIMM:
-                    selected_imm = imm_12_sbtype;
-                    break;
-                case IMM_TYPE_BIMM:
-                    selected_imm = (imm_12_sbtype.read() << 1);
-                    break;
-                case IMM_TYPE_JIMM20:
-                    selected_imm = (imm_20_ujtype.read() << 1);
-                    break;
-                default:
-                    break;
-                }
-            }
+#ifdef RV_AOT
+            core = &aot_core;
+            execute = fast = true;
+#else
+            cout << "-aot needs a build with a translated image (make aot)" << endl;
+#endif
         }
+        else if (waves.parse_option(argc, argv, i))
+            continue;
+        else if (argv[i][0] != '-')
+            elf_file = argv[i];
     }
-
-    SC_CTOR(RV_DECODER)
+    GuestMemory *mem = new GuestMemory();
+    uint32_t start_addr = 0;
+    RegionManager regmgr;
+    ImageCache cache;
+    string cache_path;
+    uint64_t elf_hash;
+    bool cached = false;
+    auto load_start = chrono::steady_clock::now();
+    if (cache_dir && ImageCache::file_hash(elf_file, &elf_hash))
     {
-        SC_METHOD(perform_decoding);
-        sensitive << clk.pos();
-        sensitive << reset;
+        cache_path = ImageCache::path_for(cache_dir, elf_hash);
+        cached = cache.load(cache_path, elf_hash);
     }
-};
-
-SC_MODULE(Testbench)
-{
-    RV_DECODER *rv_dec;
-    uint8_t *mem;
-    sc_signal<bool> clk;
-    sc_signal<bool> reset;
-    sc_signal<sc_uint<32>> instruction;
-    uint32_t pc_val = 0;
-    sc_signal<sc_uint<32>> pc;
-    sc_signal<sc_uint<5>> rs1;
-    sc_signal<sc_uint<5>> rs2;
-    sc_signal<sc_uint<5>> rd;
-    sc_signal<sc_uint<32>> imm_12_itype;
-    sc_signal<sc_uint<32>> imm_12_sbtype;
-    sc_signal<sc_uint<32>> imm_20_ujtype;
-    sc_signal<sc_uint<32>> selected_imm;
-    sc_signal<sc_uint<32>> shift_amt;
-    sc_signal<sc_uint<32>> opcode_id;
-    uint32_t mem_size = 0;
-
-    void generate_clock_pulse()
+    if (cached)
+        cache.restore_image(regmgr, mem, &start_addr);
+    else
     {
-        while (true)
-        {
-            clk.write(1);
-            wait(5, SC_NS);
-            clk.write(0);
-            wait(5, SC_NS);
-        }
+        ELFParser elf_parser(elf_file, &start_addr, mem);
+        regmgr = elf_parser.regmgr;
     }
-
-    void decode_instruction()
+    if (regmgr.get_regions().empty())
     {
-        if (clk.posedge())
-        {
-            if (pc_val <= mem_size)
-            {
-                pc.write(pc_val);
-                uint32_t *mem_addr = ((uint32_t *)mem);
-                instruction.write(mem_addr[pc_val]);
-                cout << "Timestamp: " << sc_time_stamp() << " pc_val " << pc_val << "| instr: " << instruction <<": "<<inst_names[opcode_id.read()]<<", reg1: "<<gpr_names[rs1.read()] <<", reg2: "<<gpr_names[rs2.read()] <<", reg_rd: "<<gpr_names[rd.read()] <<", selected_imm: " << selected_imm << endl;
-                pc_val = pc_val + 4;
-            }
-        }
+        cout << "Unable to load " << elf_file << endl;
+        delete mem;
+        return 1;
     }
-
-    SC_CTOR(Testbench)
+    core->map_memory(mem);
+    if (cached)
+        cache.restore_blocks(core);
+    else if (cache_dir)
     {
-        rv_dec = new RV_DECODER("rv_decoder");
-        rv_dec->instr(instruction);
-        rv_dec->clk(clk);
-        rv_dec->reset(reset);
-        rv_dec->rs1(rs1);
-        rv_dec->rs2(rs2);
-        rv_dec->rd(rd);
-        rv_dec->imm_12_itype(imm_12_itype);
-        rv_dec->imm_12_sbtype(imm_12_sbtype);
-        rv_dec->imm_20_ujtype(imm_20_ujtype);
-        rv_dec->selected_imm(selected_imm);
-        rv_dec->shift_amt(shift_amt);
-        rv_dec->opcode_id(opcode_id);
-        SC_THREAD(generate_clock_pulse);
-        SC_METHOD(decode_instruction);
-        sensitive << clk.posedge_event();
+        core->predecode_text(regmgr.get_regions());
+        mkdir(cache_dir, 0755);
+        if (!ImageCache::save(cache_path, elf_hash, start_addr, regmgr, mem, core))
+            cout << "Unable to write " << cache_path << endl;
+        else
+            cache.load(cache_path, elf_hash);   // blocks for the other cores
     }
-    void init_mem(uint8_t * memptr, uint32_t start_addr, uint32_t total_mem_size)
+    if (cache_dir)
     {
-        mem = memptr;
-        mem_size = total_mem_size;
-        pc_val = start_addr;
+        chrono::duration<double> load_time = chrono::steady_clock::now() - load_start;
+        cout << (cached ? "Loaded " : "Saved ") << cache_path << " in " << load_time.count() * 1e3 << " ms" << endl;
     }
-
-    ~Testbench()
+    if (ram_mb)
+        mem->add_range(regmgr.get_start_address(), (uint64_t)ram_mb << 20);
+    tb.init_mem(mem, start_addr);
+    ExecTrace trace;
+    // blocks run without RV_DECODER, there is no decode to record
+    if (trace_file && (fast || num_cores))
     {
-        delete rv_dec;
+        cout << "-trace records decoded instructions, it does not work with -fast, -aot or -cores" << endl;
+        trace_file = NULL;
     }
-};
-
-int sc_main(int argc, char *argv[])
-{
-    Testbench tb("tb");
-    int msize = 1 << 22;
-    uint8_t *mem;
-    uint32_t total_mem_size = 0;
-    uint32_t start_addr = 0;
-    ELFParser elf_parser("elfs/linux.elf", &start_addr, &mem, &total_mem_size);
-    tb.init_mem(mem, start_addr, total_mem_size);
-    sc_start(200 * (int)total_mem_size, SC_NS);
+    if (trace_file)
+    {
+        if (trace.open(trace_file, (uint64_t)(sc_get_time_resolution().to_seconds() * 1e15 + 0.5)))
+            tb.set_trace(&trace);
+        else
+            cout << "Unable to write " << trace_file << endl;
+    }
+    tlm::tlm_global_quantum::instance().set(sc_time(quantum_ns, SC_NS));
+    // every path runs until the guest is done (guest_exit_status, Testbench::program_ends)
+    int exit_status;
+    if (num_cores)
+    {
+        // the cores run on their own; the testbench neither fetches nor executes
+        RvPlatform *platform = new RvPlatform("platform", num_cores, parallel);
+        tb.set_exec_mode(NULL, true);
+        platform->map_memory(mem);
+        platform->set_services(&host_calls);
+        for (uint32_t i = 0; i < platform->get_num_cores() && cache.loaded(); i++)
+            cache.restore_blocks(platform->get_core(i));
+        platform->reset(start_addr);
+        auto start = chrono::steady_clock::now();
+        sc_start();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        host_calls.close();
+        platform->print_registers();
+        cout << dec << platform->instret() << " instructions on " << platform->get_num_cores() << " cores in "
+             << elapsed.count() << " s, " << platform->instret() / elapsed.count() / 1e6 << " MIPS" << endl;
+        exit_status = guest_exit_status(platform->exit_core(), regmgr.get_regions());
+        delete platform;
+    }
+    else if (execute)
+    {
+        tb.set_exec_mode(core, fast);
+        core->reset(start_addr);
+        core->host = &host_calls;
+#ifdef RV_AOT
+        if (core == &aot_core && !aot_core.check_image(mem, regmgr.get_regions()))
+            cout << "Translated image does not match the loaded ELF, interpreting" << endl;
+#endif
+        auto start = chrono::steady_clock::now();
+        sc_start();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        host_calls.close();
+        core->print_registers();
+        cout << dec << core->instret << " instructions in " << elapsed.count() << " s, "
+             << core->instret / elapsed.count() / 1e6 << " MIPS";
+        if (core->halted && core->halt_cause == CORE_HALT_EXIT)
+            cout << ", exited with " << core->exit_code;
+        else if (core->halted)
+            cout << ", halted with mcause " << core->halt_cause;
+        cout << ", " << mem->resident_pages() << " of " << (mem->mapped_size() >> GUEST_PAGE_BITS) << " pages touched" << endl;
+        exit_status = guest_exit_status(core, regmgr.get_regions());
+    }
+    else
+    {
+        tb.set_text(regmgr.get_regions());
+        sc_start();
+        exit_status = tb.exit_status;
+    }
+    waves.close();
+    if (trace.is_open())
+    {
+        uint64_t records = trace.records();
+        if (!trace.close())
+            cout << "Unable to write " << trace_file << endl;
+        else
+            cout << dec << records << " instructions traced to " << trace_file << endl;
+    }
+    INSTR_STATS_REPORT(stats_file);
     delete mem;
-    return 0;
+    return exit_status;
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "rv_aot.h"
+
+AotCore::AotCore(uint32_t hart_id) : RvCore(hart_id)
+{
+    image_ok = false;
+    for (int i = 0; i < AOT_CACHE_SIZE; i++)
+        aot_tags[i] = AOT_NO_TAG;
+    memset(aot_cache, 0, sizeof(aot_cache));
+}
+
+bool AotCore::check_image(const uint8_t *mem, const vector<region> &regions)
+{
+    image_ok = aot_text_hash(mem, regions) == aot_image_hash;
+    return image_ok;
+}
+
+bool AotCore::check_image(GuestMemory *mem, const vector<region> &regions)
+{
+    image_ok = aot_text_hash(mem, regions) == aot_image_hash;
+    return image_ok;
+}
+
+uint64_t AotCore::run(uint64_t max_insns)
+{
+    uint64_t start = instret;
+    sync_request = false;
+    while (!halted && !sync_request && instret - start < max_insns)
+    {
+        // the cache also remembers pcs without a translation
+        uint32_t index = AOT_CACHE_INDEX(pc);
+        if (aot_tags[index] != pc)
+        {
+            aot_tags[index] = pc;
+            aot_cache[index] = image_ok ? aot_lookup(pc) : NULL;
+        }
+        if (aot_cache[index] != NULL)
+            aot_cache[index](this);
+        else
+            exec_block(lookup_block(pc)->insns.data());
+    }
+    return instret - start;
+}
@@ -0,0 +1,202 @@
+#ifndef __RV_AOT__
+#define __RV_AOT__
+#include <stdint.h>
+#include <string.h>
+#include "rv_core.h"
+
+//--------------------------------------------------------------------
+// Ahead-of-time translated execution. rvaot turns every basic block of
+// an ELF's text into one C++ function on the guest state of an AotCore
+// (registers in gpr[], x0 writes going to the sink register) and emits
+// aot_lookup() mapping a block address to its function. Linked into the
+// simulator with -DRV_AOT, AotCore::run() calls translated blocks and
+// falls back to the interpreter for any pc that has no translation
+// (indirect targets inside a block, code outside the translated text).
+//
+// Translated code assumes the text is not modified at run time: fence.i
+// only flushes the interpreter's blocks. The translated blocks do not
+// feed the instruction-mix counters.
+//--------------------------------------------------------------------
+#define AOT_CACHE_BITS      12
+#define AOT_CACHE_SIZE      (1 << AOT_CACHE_BITS)
+#define AOT_CACHE_INDEX(pc) (((pc) >> 1) & (AOT_CACHE_SIZE - 1))
+#define AOT_NO_TAG          1       // pcs are 2-byte aligned, never matches
+
+class AotCore;
+typedef void (*aot_block_fn)(AotCore *c);
+
+// generated by rvaot
+extern const uint64_t aot_image_hash;
+extern const uint32_t aot_block_count;
+aot_block_fn aot_lookup(uint32_t pc);
+
+// FNV-1a over the address, size and contents of every executable region;
+// ties a translated image to the ELF it was generated from
+static inline uint64_t aot_text_hash(const uint8_t *mem, const vector<region> &regions)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        if (!(reg_val->region_flags & SHF_EXECINSTR))
+            continue;
+        uint32_t header[2] = {reg_val->start_addr, reg_val->region_size};
+        const uint8_t *bytes = (const uint8_t *)header;
+        for (uint32_t i = 0; i < sizeof(header); i++)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        bytes = mem + reg_val->region_base;
+        for (uint32_t i = 0; i < reg_val->region_size; i++)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// the same hash over the sections as loaded into guest memory
+static inline uint64_t aot_text_hash(GuestMemory *mem, const vector<region> &regions)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        if (!(reg_val->region_flags & SHF_EXECINSTR))
+            continue;
+        uint32_t header[2] = {reg_val->start_addr, reg_val->region_size};
+        const uint8_t *bytes = (const uint8_t *)header;
+        for (uint32_t i = 0; i < sizeof(header); i++)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        uint8_t chunk[GUEST_PAGE_SIZE];
+        for (uint32_t done = 0; done < reg_val->region_size; done += GUEST_PAGE_SIZE)
+        {
+            uint32_t len = min(reg_val->region_size - done, (uint32_t)GUEST_PAGE_SIZE);
+            mem->read(reg_val->start_addr + done, chunk, len);
+            for (uint32_t i = 0; i < len; i++)
+                hash = (hash ^ chunk[i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+class AotCore : public RvCore
+{
+public:
+    AotCore(uint32_t hart_id = 0);
+    // false (and interpret everything) if the linked translation was made
+    // from a different image than the one loaded
+    bool check_image(const uint8_t *mem, const vector<region> &regions);
+    bool check_image(GuestMemory *mem, const vector<region> &regions);
+    uint64_t run(uint64_t max_insns);
+
+    // entry points for translated code
+    void trap(uint32_t cause, uint32_t tval, uint32_t trap_pc) { take_trap(cause, tval, trap_pc); }
+    void trap_return(bool machine) { return_from_trap(machine); }
+    uint32_t csr_read(uint32_t csr_num) { return read_csr(csr_num); }
+    void csr_write(uint32_t csr_num, uint32_t value) { write_csr(csr_num, value); }
+    void load_reserved(uint32_t addr)
+    {
+        set_reservation(addr);
+    }
+    uint32_t store_conditional_failed(uint32_t addr)
+    {
+        uint32_t failed = !reservation_valid || reservation != addr;
+        drop_reservation();
+        return failed;
+    }
+
+protected:
+    bool image_ok;
+    uint32_t aot_tags[AOT_CACHE_SIZE];
+    aot_block_fn aot_cache[AOT_CACHE_SIZE];
+};
+
+//--------------------------------------------------------------------
+// Building blocks of the generated code. Inside a block function c is
+// the core and x its gpr array; "retired" is the number of instructions
+// of the block already executed but not yet added to instret.
+//--------------------------------------------------------------------
+#define AOT_END(retired, next)                  do { c->instret += (retired); c->pc = (next); return; } while (0)
+#define AOT_TRAP(retired, cause, tval, insn_pc) do { c->instret += (retired); c->trap(cause, tval, insn_pc); return; } while (0)
+
+#define AOT_LOAD(type, cast, rd, addr_expr, insn_pc, retired)       \
+    {                                                               \
+        uint32_t addr = (addr_expr);                                \
+        uint8_t *p = c->translate(addr, sizeof(type));              \
+        if (p == NULL)                                              \
+            AOT_TRAP(retired, c->fault_cause, addr, insn_pc);       \
+        type value;                                                 \
+        memcpy(&value, p, sizeof(type));                            \
+        x[rd] = (cast)value;                                        \
+    }
+#define AOT_STORE(type, rs2, addr_expr, insn_pc, retired)           \
+    {                                                               \
+        uint32_t addr = (addr_expr);                                \
+        uint8_t *p = c->translate(addr, sizeof(type), MMU_ACCESS_STORE); \
+        if (p == NULL)                                              \
+            AOT_TRAP(retired, c->fault_cause, addr, insn_pc);       \
+        type value = (type)x[rs2];                                  \
+        memcpy(p, &value, sizeof(type));                            \
+        c->store_access(addr, sizeof(type));                        \
+    }
+#define AOT_AMO(rd, rs1, rs2, expr, insn_pc, retired)               \
+    {                                                               \
+        uint32_t addr = x[rs1];                                     \
+        uint8_t *p = c->translate(addr, 4, MMU_ACCESS_STORE);       \
+        if (p == NULL)                                              \
+            AOT_TRAP(retired, c->fault_cause, addr, insn_pc);       \
+        uint32_t old, src = x[rs2];                                 \
+        memcpy(&old, p, 4);                                         \
+        uint32_t value = (expr);                                    \
+        memcpy(p, &value, 4);                                       \
+        c->atomic_access(addr);                                     \
+        x[rd] = old;                                                \
+    }
+#define AOT_LR(rd, rs1, insn_pc, retired)                           \
+    {                                                               \
+        uint32_t addr = x[rs1];                                     \
+        uint8_t *p = c->translate(addr, 4);                         \
+        if (p == NULL)                                              \
+            AOT_TRAP(retired, c->fault_cause, addr, insn_pc);       \
+        c->load_reserved(addr);                                     \
+        memcpy(&x[rd], p, 4);                                       \
+    }
+#define AOT_SC(rd, rs1, rs2, insn_pc, retired)                      \
+    {                                                               \
+        uint32_t addr = x[rs1];                                     \
+        uint8_t *p = c->translate(addr, 4, MMU_ACCESS_STORE);       \
+        if (p == NULL)                                              \
+            AOT_TRAP(retired, c->fault_cause, addr, insn_pc);       \
+        uint32_t failed = c->store_conditional_failed(addr);        \
+        if (!failed)                                                \
+        {                                                           \
+            memcpy(p, &x[rs2], 4);                                  \
+            c->atomic_access(addr);                                 \
+        }                                                           \
+        x[rd] = failed;                                             \
+    }
+// CSR counters read the instructions retired so far, so the block flushes
+// its count first; expr sees the old value as old and the operand as src
+#define AOT_CSR(rd, csr_num, value, writes, expr, retired)          \
+    {                                                               \
+        c->instret += (retired);                                    \
+        uint32_t src = (value);                                     \
+        uint32_t old = c->csr_read(csr_num);                        \
+        if (writes)                                                 \
+            c->csr_write(csr_num, (expr));                          \
+        x[rd] = old;                                                \
+    }
+
+static inline uint32_t aot_div(uint32_t a, uint32_t b)
+{
+    if (b == 0)
+        return 0xffffffff;
+    if (a == 0x80000000 && b == 0xffffffff)
+        return a;
+    return (int32_t)a / (int32_t)b;
+}
+
+static inline uint32_t aot_rem(uint32_t a, uint32_t b)
+{
+    if (b == 0)
+        return a;
+    if (a == 0x80000000 && b == 0xffffffff)
+        return 0;
+    return (int32_t)a % (int32_t)b;
+}
+#endif
@@ -0,0 +1,852 @@
+#include "rv_core.h"
+#include "decode_table.h"
+#include "instr_stats.h"
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+
+#define CORE_OPCODE(x)          ((x) & 0x7f)
+#define CORE_FUNCT3(x)          (((x) & OPCODE_FUNC3_MASK) >> OPCODE_FUNC3_SHIFT)
+#define CORE_SHAMT(x)           (((x) >> 20) & 0x1f)
+#define CORE_CSR_NUM(x)         ((x) >> 20)
+
+// handlers, in eInstructions order followed by the CORE_OP_* ids
+#define CORE_OPS(X)                                                                         \
+    X(ANDI) X(ADDI) X(SLTI) X(SLTIU) X(ORI) X(XORI) X(SLLI) X(SRLI) X(SRAI) X(LUI) X(AUIPC) \
+    X(ADD) X(SUB) X(SLT) X(SLTU) X(XOR) X(OR) X(AND) X(SLL) X(SRL) X(SRA)                   \
+    X(JAL) X(JALR) X(BEQ) X(BNE) X(BLT) X(BGE) X(BLTU) X(BGEU)                              \
+    X(LB) X(LH) X(LW) X(LBU) X(LHU) X(LWU) X(SB) X(SH) X(SW)                                \
+    X(ECALL) X(EBREAK) X(MRET) X(SRET)                                                      \
+    X(CSRRW) X(CSRRS) X(CSRRC) X(CSRRWI) X(CSRRSI) X(CSRRCI)                                \
+    X(MUL) X(MULH) X(MULHSU) X(MULHU) X(DIV) X(DIVU) X(REM) X(REMU)                         \
+    X(FENCE) X(SFENCE) X(IFENCE) X(WFI)                                                     \
+    X(AMOLR_W) X(AMOSC_W) X(AMOSWAP_W) X(AMOADD_W) X(AMOAND_W) X(AMOOR_W) X(AMOXOR_W)       \
+    X(AMOMAX_W) X(AMOMIN_W) X(AMOMAXU_W) X(AMOMINU_W)
+
+#define CORE_OP_ID(name)        ENUM_INST_##name
+#define CORE_OP_COUNT(name)     + 1
+static_assert(0 CORE_OPS(CORE_OP_COUNT) == ENUM_INST_MAX, "CORE_OPS must list every eInstructions value");
+
+static bool core_ends_block(uint32_t op)
+{
+    switch (op)
+    {
+    case ENUM_INST_JAL:
+    case ENUM_INST_JALR:
+    case ENUM_INST_BEQ:
+    case ENUM_INST_BNE:
+    case ENUM_INST_BLT:
+    case ENUM_INST_BGE:
+    case ENUM_INST_BLTU:
+    case ENUM_INST_BGEU:
+    case ENUM_INST_ECALL:
+    case ENUM_INST_EBREAK:
+    case ENUM_INST_MRET:
+    case ENUM_INST_SRET:
+    case ENUM_INST_IFENCE:
+    case CORE_OP_ILLEGAL:
+    case CORE_OP_FETCH_FAULT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+RvCore::RvCore(uint32_t hart_id)
+{
+    memset(gpr, 0, sizeof(gpr));
+    memset(csr, 0, sizeof(csr));
+    csr[CSR_MHARTID] = hart_id;
+    pc = 0;
+    priv = PRIV_MACHINE;
+    instret = 0;
+    halted = false;
+    halt_cause = 0;
+    exit_code = 0;
+    host = NULL;
+    sync_request = false;
+    defer_shared = false;
+    fault_cause = 0;
+    reservation = 0;
+    reservation_valid = false;
+    held_reservations = NULL;
+    no_window = {0, 0, NULL};
+    last_window = &no_window;
+    memory = NULL;
+    page_window = no_window;
+    mmu_status = 0;
+    tlb_flush();
+    mmu_update_context();
+    memset(block_tags, 0, sizeof(block_tags));
+    memset(block_cache, 0, sizeof(block_cache));
+    imported_records = NULL;
+    imported_count = 0;
+    imported_insns = NULL;
+}
+
+void RvCore::map_image(uint8_t *mem, const vector<region> &regions)
+{
+    // regions are sorted and packed back to back in the image, so sections
+    // that are also adjacent in the address space share one window
+    windows.clear();
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        if (!windows.empty() && windows.back().end_addr == reg_val->start_addr &&
+            windows.back().host + (windows.back().end_addr - windows.back().start_addr) == mem + reg_val->region_base)
+            windows.back().end_addr = reg_val->end_addr;
+        else
+            windows.push_back({reg_val->start_addr, reg_val->end_addr, mem + reg_val->region_base});
+    }
+    last_window = &no_window;
+    tlb_flush();
+    flush_blocks();
+}
+
+void RvCore::map_memory(GuestMemory *mem)
+{
+    memory = mem;
+    last_window = &no_window;
+    tlb_flush();
+    flush_blocks();
+}
+
+void RvCore::reset(uint32_t start_pc)
+{
+    memset(gpr, 0, sizeof(gpr));
+    pc = start_pc;
+    priv = PRIV_MACHINE;
+    halted = false;
+    halt_cause = 0;
+    exit_code = 0;
+    drop_reservation();
+    mmu_update_context();
+}
+
+uint8_t *RvCore::translate_phys_slow(uint32_t addr, uint32_t size)
+{
+    for (auto window = windows.begin(); window != windows.end(); window++)
+    {
+        if (addr >= window->start_addr && (uint64_t)addr + size <= window->end_addr)
+        {
+            last_window = &*window;
+            return window->host + (addr - window->start_addr);
+        }
+    }
+    // pages are not contiguous on the host, an access may not cross one
+    uint32_t page_addr = addr & ~GUEST_PAGE_MASK;
+    if (memory == NULL || (uint64_t)addr + size > (uint64_t)page_addr + GUEST_PAGE_SIZE)
+        return NULL;
+    uint8_t *host = memory->page(addr);
+    if (host == NULL)
+        return NULL;
+    page_window = {page_addr, page_addr + GUEST_PAGE_SIZE, host};
+    last_window = &page_window;
+    return host + (addr - page_addr);
+}
+
+uint32_t RvCore::fetch(uint32_t addr, uint32_t *word)
+{
+    uint16_t half;
+    uint8_t *p = translate(addr, 2, MMU_ACCESS_FETCH);
+    if (p == NULL)
+        return 0;
+    memcpy(&half, p, 2);
+    if (RVC_IS_COMPRESSED(half))
+    {
+        *word = rvc.expand(half);
+        return 2;
+    }
+    p = translate(addr, 4, MMU_ACCESS_FETCH);
+    if (p == NULL)
+        return 0;
+    memcpy(word, p, 4);
+    return 4;
+}
+
+uint32_t RvCore::immediate(uint32_t word)
+{
+    switch (CORE_OPCODE(word))
+    {
+    case 0x23:
+        return OPCODE_STYPE_IMM(word);
+    case 0x63:
+        return OPCODE_SBTYPE_IMM(word);
+    case 0x37:
+    case 0x17:
+        return word & 0xfffff000;
+    case 0x6f:
+        return OPCODE_UJTYPE_IMM(word);
+    case 0x73:
+        return CORE_CSR_NUM(word);
+    case 0x13:
+        if (CORE_FUNCT3(word) == 1 || CORE_FUNCT3(word) == 5)
+        {
+            return CORE_SHAMT(word);
+        }
+        return OPCODE_ITYPE_IMM(word);
+    default:
+        return OPCODE_ITYPE_IMM(word);
+    }
+}
+
+void RvCore::predecode(uint32_t word, int opcode_id, uint32_t insn_pc, uint32_t len, core_insn &insn)
+{
+    uint32_t rd = (word & OPCODE_RD_MASK) >> OPCODE_RD_SHIFT;
+    insn.op = opcode_id >= 0 ? instr_defs[opcode_id].instruction_enum : (uint32_t)CORE_OP_ILLEGAL;
+    if (insn.op == ENUM_INST_LWU)   // RV64 only
+        insn.op = CORE_OP_ILLEGAL;
+    insn.opcode_id = opcode_id;
+    insn.rd = rd ? rd : CORE_SINK_REG;
+    insn.rs1 = (word & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
+    insn.rs2 = (word & OPCODE_RS2_MASK) >> OPCODE_RS2_SHIFT;
+    insn.len = len;
+    insn.pc = insn_pc;
+    insn.imm = immediate(word);
+    if (insn.op == CORE_OP_ILLEGAL)
+        insn.imm = word;    // mtval
+}
+
+// pc following the last instruction of a block
+static uint32_t block_end_pc(const core_insn *insns, uint32_t count)
+{
+    const core_insn &last = insns[count - 1];
+    return last.op == CORE_OP_END ? last.pc : last.pc + last.len;
+}
+
+// host pages code at block_pc fetched from host may lie in; a block cannot
+// reach beyond its guest page
+static void add_code_pages(unordered_set<uintptr_t> &pages, uint32_t block_pc, const uint8_t *host)
+{
+    uintptr_t first = (uintptr_t)host;
+    pages.insert(first >> MMU_PGSHIFT);
+    pages.insert((first + MMU_PGSIZE - 1 - (block_pc & (MMU_PGSIZE - 1))) >> MMU_PGSHIFT);
+}
+
+RvCore::core_block *RvCore::build_block(uint32_t block_pc, uint8_t *host)
+{
+    auto found = blocks.find(block_pc);
+    if (found != blocks.end() && found->second.host == host)
+        return &found->second;
+    // new, or block_pc now maps elsewhere
+    core_block &block = blocks[block_pc];
+    block.insns.clear();
+    block.host = host;
+    if (host != NULL)
+        add_code_pages(code_pages, block_pc, host);
+    if (imported_count && host == translate_phys(block_pc, 2))
+    {
+        const core_block_record *end = imported_records + imported_count;
+        const core_block_record *record = lower_bound(imported_records, end, block_pc,
+            [](const core_block_record &rec, uint32_t value) { return rec.pc < value; });
+        if (record != end && record->pc == block_pc)
+        {
+            const core_insn *first = imported_insns + record->first_insn;
+            block.insns.assign(first, first + record->insn_count);
+            return &block;
+        }
+    }
+    uint32_t insn_pc = block_pc;
+    // blocks stay within one page, the next one may be mapped differently
+    while (block.insns.size() < CORE_BLOCK_MAX_INSNS && (insn_pc >> MMU_PGSHIFT) == (block_pc >> MMU_PGSHIFT))
+    {
+        core_insn insn;
+        uint32_t word;
+        uint32_t len = fetch(insn_pc, &word);
+        if (len == 0)
+        {
+            block.insns.push_back({CORE_OP_FETCH_FAULT, -1, 0, 0, 0, 0, fault_cause, insn_pc});
+            return &block;
+        }
+        predecode(word, word ? rv_decode_table.lookup(word) : -1, insn_pc, len, insn);
+        block.insns.push_back(insn);
+        if (core_ends_block(insn.op))
+            return &block;
+        insn_pc += len;
+    }
+    block.insns.push_back({CORE_OP_END, -1, 0, 0, 0, 0, 0, insn_pc});
+    return &block;
+}
+
+void RvCore::flush_blocks()
+{
+    blocks.clear();
+    code_pages.clear();
+    memset(block_cache, 0, sizeof(block_cache));
+    imported_count = 0;
+    imported_pages.clear();
+}
+
+void RvCore::predecode_text(const vector<region> &regions)
+{
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        if (!(reg_val->region_flags & SHF_EXECINSTR))
+            continue;
+        uint32_t block_pc = reg_val->start_addr;
+        while (block_pc >= reg_val->start_addr && block_pc < reg_val->end_addr)
+        {
+            uint8_t *host = translate(block_pc, 2, MMU_ACCESS_FETCH);
+            if (host == NULL)
+                break;
+            const vector<core_insn> &insns = build_block(block_pc, host)->insns;
+            if (insns.back().op == CORE_OP_FETCH_FAULT)
+                break;
+            block_pc = block_end_pc(insns.data(), insns.size());
+        }
+    }
+}
+
+void RvCore::export_blocks(vector<core_block_record> &records, vector<core_insn> &insns)
+{
+    vector<uint32_t> block_pcs;
+    for (auto block = blocks.begin(); block != blocks.end(); block++)
+        block_pcs.push_back(block->first);
+    sort(block_pcs.begin(), block_pcs.end());
+    for (auto block_pc = block_pcs.begin(); block_pc != block_pcs.end(); block_pc++)
+    {
+        const vector<core_insn> &block_insns = blocks[*block_pc].insns;
+        records.push_back({*block_pc, (uint32_t)insns.size(), (uint32_t)block_insns.size()});
+        insns.insert(insns.end(), block_insns.begin(), block_insns.end());
+    }
+}
+
+void RvCore::import_blocks(const core_block_record *records, uint32_t count, const core_insn *insns)
+{
+    imported_records = records;
+    imported_count = count;
+    imported_insns = insns;
+    // where they would be fetched from with translation off
+    imported_pages.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i && (records[i].pc >> MMU_PGSHIFT) == (records[i - 1].pc >> MMU_PGSHIFT))
+            continue;
+        uint8_t *host = translate_phys(records[i].pc, 2);
+        if (host != NULL)
+            add_code_pages(imported_pages, records[i].pc, host);
+    }
+}
+
+bool RvCore::check_blocks(const core_block_record *records, uint32_t count, const core_insn *insns,
+                          uint32_t insn_count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const core_block_record &record = records[i];
+        if ((i && record.pc <= records[i - 1].pc) || record.insn_count == 0 ||
+            (uint64_t)record.first_insn + record.insn_count > insn_count)
+            return false;
+        uint32_t last_op = insns[record.first_insn + record.insn_count - 1].op;
+        if (!core_ends_block(last_op) && last_op != CORE_OP_END)
+            return false;
+    }
+    for (uint32_t i = 0; i < insn_count; i++)
+    {
+        const core_insn &insn = insns[i];
+        if (insn.op >= CORE_OP_MAX || insn.opcode_id < -1 || insn.opcode_id >= MAX_INSTR ||
+            insn.rd > CORE_SINK_REG || insn.rs1 > CORE_SINK_REG || insn.rs2 > CORE_SINK_REG)
+            return false;
+    }
+    return true;
+}
+
+void RvCore::external_write(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    clear_reservation(addr, len);
+    invalidate_code(data, len);
+    if (host)
+        host->host_write(this, addr, data, len);
+}
+
+void RvCore::invalidate_code(const uint8_t *data, uint32_t len)
+{
+    if (len == 0)
+        return;
+    uintptr_t first = (uintptr_t)data;
+    uintptr_t last = first + len - 1;
+    bool hit = false;
+    bool imported_hit = false;
+    for (uintptr_t page = first >> MMU_PGSHIFT; page <= last >> MMU_PGSHIFT; page++)
+    {
+        hit = hit || code_pages.count(page) != 0;
+        imported_hit = imported_hit || (imported_count && imported_pages.count(page) != 0);
+    }
+    for (auto block = blocks.begin(); hit && block != blocks.end(); block++)
+    {
+        core_block &cached = block->second;
+        if (cached.host == NULL || cached.host == CORE_BLOCK_STALE)
+            continue;
+        // build_block() finds the host changed and fetches it again
+        uintptr_t start = (uintptr_t)cached.host;
+        uintptr_t end = start + (block_end_pc(cached.insns.data(), cached.insns.size()) - block->first);
+        if (start <= last && end > first)
+            cached.host = CORE_BLOCK_STALE;
+    }
+    // imported records on the page are dropped all at once, as fence.i does
+    if (imported_hit)
+    {
+        imported_count = 0;
+        imported_pages.clear();
+    }
+}
+
+uint64_t RvCore::run(uint64_t max_insns)
+{
+    uint64_t start = instret;
+    sync_request = false;
+    while (!halted && !sync_request && instret - start < max_insns)
+        exec_block(lookup_block(pc)->insns.data());
+    return instret - start;
+}
+
+void RvCore::step()
+{
+    core_insn insns[2];
+    uint32_t word;
+    uint32_t len = fetch(pc, &word);
+    if (len == 0)
+        insns[0] = {CORE_OP_FETCH_FAULT, -1, 0, 0, 0, 0, fault_cause, pc};
+    else
+        predecode(word, word ? rv_decode_table.lookup(word) : -1, pc, len, insns[0]);
+    insns[1] = {CORE_OP_END, -1, 0, 0, 0, 0, 0, pc + len};
+    bool defer = defer_shared;
+    defer_shared = false;
+    if (!halted)
+        exec_block(insns);
+    defer_shared = defer;
+}
+
+uint32_t RvCore::execute(const DecodedInstr &instr, uint32_t len)
+{
+    core_insn insns[2];
+    int opcode_id = instr.opcode_id;
+    // the decoder leaves opcode_id untouched for unknown words
+    if (opcode_id >= MAX_INSTR ||
+        (instr.instr & instr_defs[opcode_id].instruction_mask) != instr_defs[opcode_id].instruction_match)
+        opcode_id = -1;
+    predecode(instr.instr, opcode_id, pc, len, insns[0]);
+    insns[0].rd = instr.rd ? instr.rd : CORE_SINK_REG;
+    insns[0].rs1 = instr.rs1;
+    insns[0].rs2 = instr.rs2;
+    insns[1] = {CORE_OP_END, -1, 0, 0, 0, 0, 0, pc + len};
+    if (!halted)
+        exec_block(insns);
+    return pc;
+}
+
+//--------------------------------------------------------------------
+// Threaded interpreter. With GCC/Clang every handler ends in its own
+// indirect jump through the label table; elsewhere it falls back to a
+// switch. Runs to the end of the block and leaves pc at the next one.
+//--------------------------------------------------------------------
+#ifdef __GNUC__
+#define CORE_HANDLER(name)      op_##name:
+#define CORE_OP_HANDLER(name)   op_##name:
+#define CORE_DISPATCH()         goto *labels[insn->op]
+#else
+#define CORE_HANDLER(name)      case CORE_OP_ID(name):
+#define CORE_OP_HANDLER(name)   case CORE_OP_##name:
+#define CORE_DISPATCH()         goto dispatch
+#endif
+#define CORE_RETIRE()           do { executed++; INSTR_STATS_EXECUTE(insn->opcode_id); } while (0)
+#define CORE_NEXT()             do { CORE_RETIRE(); insn++; CORE_DISPATCH(); } while (0)
+#define CORE_EXIT()             do { instret += executed; return; } while (0)
+#define CORE_JUMP(target)       do { pc = (target); CORE_RETIRE(); CORE_EXIT(); } while (0)
+#define CORE_BRANCH(cond)       CORE_JUMP((cond) ? insn->pc + insn->imm : insn->pc + insn->len)
+#define CORE_TRAP(cause, tval)  do { instret += executed; take_trap(cause, tval, insn->pc); return; } while (0)
+// defer_shared: leave the instruction to the host, pc stays on it
+#define CORE_DEFER()            do { pc = insn->pc; sync_request = true; CORE_EXIT(); } while (0)
+
+#define RD      x[insn->rd]
+#define RS1     x[insn->rs1]
+#define RS2     x[insn->rs2]
+#define IMM     insn->imm
+#define SRS1    ((int32_t)RS1)
+#define SRS2    ((int32_t)RS2)
+
+#define CORE_LOAD(type, cast)                                   \
+    {                                                           \
+        uint32_t addr = RS1 + IMM;                              \
+        uint8_t *p = translate(addr, sizeof(type));             \
+        if (p == NULL)                                          \
+            CORE_TRAP(fault_cause, addr);                       \
+        type value;                                             \
+        memcpy(&value, p, sizeof(type));                        \
+        RD = (cast)value;                                       \
+        CORE_NEXT();                                            \
+    }
+#define CORE_STORE(type)                                        \
+    {                                                           \
+        uint32_t addr = RS1 + IMM;                              \
+        uint8_t *p = translate(addr, sizeof(type), MMU_ACCESS_STORE); \
+        if (p == NULL)                                          \
+            CORE_TRAP(fault_cause, addr);                       \
+        type value = (type)RS2;                                 \
+        memcpy(p, &value, sizeof(type));                        \
+        store_access(addr, sizeof(type));                       \
+        CORE_NEXT();                                            \
+    }
+#define CORE_AMO(expr)                                          \
+    {                                                           \
+        if (defer_shared)                                       \
+            CORE_DEFER();                                       \
+        uint32_t addr = RS1;                                    \
+        uint8_t *p = translate(addr, 4, MMU_ACCESS_STORE);      \
+        if (p == NULL)                                          \
+            CORE_TRAP(fault_cause, addr);                       \
+        uint32_t old, src = RS2;                                \
+        memcpy(&old, p, 4);                                     \
+        uint32_t value = (expr);                                \
+        memcpy(p, &value, 4);                                   \
+        atomic_access(addr);                                    \
+        RD = old;                                               \
+        CORE_NEXT();                                            \
+    }
+#define CORE_CSR(value, writes)                                 \
+    {                                                           \
+        if (defer_shared && IMM >= CORE_CSR_HOST_FIRST && IMM <= CORE_CSR_HOST_LAST) \
+            CORE_DEFER();                                       \
+        instret += executed;    /* counters read up to here */  \
+        executed = 0;                                           \
+        uint32_t src = (value);                                 \
+        uint32_t old = read_csr(IMM);                           \
+        if (writes)                                             \
+            write_csr(IMM, CORE_CSR_RESULT);                    \
+        RD = old;                                               \
+        if (halted)     /* CSR_SIM_CTRL_EXIT */                 \
+            CORE_JUMP(insn->pc + insn->len);                    \
+        CORE_NEXT();                                            \
+    }
+
+void RvCore::exec_block(const core_insn *insn)
+{
+#ifdef __GNUC__
+#define CORE_LABEL(name)        [CORE_OP_ID(name)] = &&op_##name,
+    static const void *const labels[CORE_OP_MAX] = {
+        CORE_OPS(CORE_LABEL)
+        [CORE_OP_ILLEGAL] = &&op_ILLEGAL,
+        [CORE_OP_FETCH_FAULT] = &&op_FETCH_FAULT,
+        [CORE_OP_END] = &&op_END,
+    };
+#undef CORE_LABEL
+#endif
+    uint32_t *x = gpr;
+    uint64_t executed = 0;
+    CORE_DISPATCH();
+#ifndef __GNUC__
+dispatch:
+    switch (insn->op)
+    {
+#endif
+    CORE_HANDLER(ANDI)      RD = RS1 & IMM; CORE_NEXT();
+    CORE_HANDLER(ADDI)      RD = RS1 + IMM; CORE_NEXT();
+    CORE_HANDLER(SLTI)      RD = SRS1 < (int32_t)IMM; CORE_NEXT();
+    CORE_HANDLER(SLTIU)     RD = RS1 < IMM; CORE_NEXT();
+    CORE_HANDLER(ORI)       RD = RS1 | IMM; CORE_NEXT();
+    CORE_HANDLER(XORI)      RD = RS1 ^ IMM; CORE_NEXT();
+    CORE_HANDLER(SLLI)      RD = RS1 << IMM; CORE_NEXT();
+    CORE_HANDLER(SRLI)      RD = RS1 >> IMM; CORE_NEXT();
+    CORE_HANDLER(SRAI)      RD = SRS1 >> IMM; CORE_NEXT();
+    CORE_HANDLER(LUI)       RD = IMM; CORE_NEXT();
+    CORE_HANDLER(AUIPC)     RD = insn->pc + IMM; CORE_NEXT();
+    CORE_HANDLER(ADD)       RD = RS1 + RS2; CORE_NEXT();
+    CORE_HANDLER(SUB)       RD = RS1 - RS2; CORE_NEXT();
+    CORE_HANDLER(SLT)       RD = SRS1 < SRS2; CORE_NEXT();
+    CORE_HANDLER(SLTU)      RD = RS1 < RS2; CORE_NEXT();
+    CORE_HANDLER(XOR)       RD = RS1 ^ RS2; CORE_NEXT();
+    CORE_HANDLER(OR)        RD = RS1 | RS2; CORE_NEXT();
+    CORE_HANDLER(AND)       RD = RS1 & RS2; CORE_NEXT();
+    CORE_HANDLER(SLL)       RD = RS1 << (RS2 & 31); CORE_NEXT();
+    CORE_HANDLER(SRL)       RD = RS1 >> (RS2 & 31); CORE_NEXT();
+    CORE_HANDLER(SRA)       RD = SRS1 >> (RS2 & 31); CORE_NEXT();
+
+    CORE_HANDLER(JAL)
+    {
+        uint32_t link = insn->pc + insn->len;
+        RD = link;
+        CORE_JUMP(insn->pc + IMM);
+    }
+    CORE_HANDLER(JALR)
+    {
+        uint32_t target = (RS1 + IMM) & ~1u;
+        RD = insn->pc + insn->len;
+        CORE_JUMP(target);
+    }
+    CORE_HANDLER(BEQ)       CORE_BRANCH(RS1 == RS2);
+    CORE_HANDLER(BNE)       CORE_BRANCH(RS1 != RS2);
+    CORE_HANDLER(BLT)       CORE_BRANCH(SRS1 < SRS2);
+    CORE_HANDLER(BGE)       CORE_BRANCH(SRS1 >= SRS2);
+    CORE_HANDLER(BLTU)      CORE_BRANCH(RS1 < RS2);
+    CORE_HANDLER(BGEU)      CORE_BRANCH(RS1 >= RS2);
+
+    CORE_HANDLER(LB)        CORE_LOAD(int8_t, int32_t)
+    CORE_HANDLER(LH)        CORE_LOAD(int16_t, int32_t)
+    CORE_HANDLER(LW)        CORE_LOAD(uint32_t, uint32_t)
+    CORE_HANDLER(LBU)       CORE_LOAD(uint8_t, uint32_t)
+    CORE_HANDLER(LHU)       CORE_LOAD(uint16_t, uint32_t)
+    CORE_HANDLER(SB)        CORE_STORE(uint8_t)
+    CORE_HANDLER(SH)        CORE_STORE(uint16_t)
+    CORE_HANDLER(SW)        CORE_STORE(uint32_t)
+
+    CORE_HANDLER(ECALL)     CORE_TRAP(MCAUSE_ECALL_U + priv, 0);
+    CORE_HANDLER(EBREAK)    CORE_TRAP(MCAUSE_BREAKPOINT, insn->pc);
+    CORE_HANDLER(MRET)
+    {
+        CORE_RETIRE();
+        instret += executed;
+        return_from_trap(true);
+        return;
+    }
+    CORE_HANDLER(SRET)
+    {
+        CORE_RETIRE();
+        instret += executed;
+        return_from_trap(false);
+        return;
+    }
+
+#define CORE_CSR_RESULT src
+    CORE_HANDLER(CSRRW)     CORE_CSR(RS1, true)
+    CORE_HANDLER(CSRRWI)    CORE_CSR(insn->rs1, true)
+#undef CORE_CSR_RESULT
+#define CORE_CSR_RESULT (old | src)
+    CORE_HANDLER(CSRRS)     CORE_CSR(RS1, insn->rs1 != 0)
+    CORE_HANDLER(CSRRSI)    CORE_CSR(insn->rs1, src != 0)
+#undef CORE_CSR_RESULT
+#define CORE_CSR_RESULT (old & ~src)
+    CORE_HANDLER(CSRRC)     CORE_CSR(RS1, insn->rs1 != 0)
+    CORE_HANDLER(CSRRCI)    CORE_CSR(insn->rs1, src != 0)
+#undef CORE_CSR_RESULT
+
+    CORE_HANDLER(MUL)       RD = RS1 * RS2; CORE_NEXT();
+    CORE_HANDLER(MULH)      RD = ((int64_t)SRS1 * (int64_t)SRS2) >> 32; CORE_NEXT();
+    CORE_HANDLER(MULHSU)    RD = ((int64_t)SRS1 * (int64_t)(uint64_t)RS2) >> 32; CORE_NEXT();
+    CORE_HANDLER(MULHU)     RD = ((uint64_t)RS1 * (uint64_t)RS2) >> 32; CORE_NEXT();
+    CORE_HANDLER(DIV)
+    {
+        if (RS2 == 0)
+            RD = 0xffffffff;
+        else if (RS1 == 0x80000000 && RS2 == 0xffffffff)
+            RD = RS1;
+        else
+            RD = SRS1 / SRS2;
+        CORE_NEXT();
+    }
+    CORE_HANDLER(DIVU)      RD = RS2 ? RS1 / RS2 : 0xffffffff; CORE_NEXT();
+    CORE_HANDLER(REM)
+    {
+        if (RS2 == 0)
+            RD = RS1;
+        else if (RS1 == 0x80000000 && RS2 == 0xffffffff)
+            RD = 0;
+        else
+            RD = SRS1 % SRS2;
+        CORE_NEXT();
+    }
+    CORE_HANDLER(REMU)      RD = RS2 ? RS1 % RS2 : RS1; CORE_NEXT();
+
+    // Stores land in the shared memory as they execute and the platform
+    // orders cores at its syncs, and nothing raises interrupts yet: fences
+    // and wfi retire as nops.
+    CORE_HANDLER(FENCE)     CORE_NEXT();
+    CORE_HANDLER(SFENCE)    tlb_flush(); CORE_NEXT();
+    CORE_HANDLER(WFI)       CORE_NEXT();
+    CORE_HANDLER(IFENCE)
+    {
+        // the block being executed is freed by the flush
+        pc = insn->pc + insn->len;
+        CORE_RETIRE();
+        instret += executed;
+        flush_blocks();
+        return;
+    }
+
+    CORE_HANDLER(AMOLR_W)
+    {
+        uint8_t *p = translate(RS1, 4);
+        if (p == NULL)
+            CORE_TRAP(fault_cause, RS1);
+        set_reservation(RS1);
+        uint32_t value;
+        memcpy(&value, p, 4);
+        RD = value;
+        CORE_NEXT();
+    }
+    CORE_HANDLER(AMOSC_W)
+    {
+        if (defer_shared)
+            CORE_DEFER();
+        uint8_t *p = translate(RS1, 4, MMU_ACCESS_STORE);
+        if (p == NULL)
+            CORE_TRAP(fault_cause, RS1);
+        uint32_t failed = !reservation_valid || reservation != RS1;
+        if (!failed)
+        {
+            memcpy(p, &RS2, 4);
+            atomic_access(RS1);
+        }
+        drop_reservation();
+        RD = failed;
+        CORE_NEXT();
+    }
+    CORE_HANDLER(AMOSWAP_W) CORE_AMO(src)
+    CORE_HANDLER(AMOADD_W)  CORE_AMO(old + src)
+    CORE_HANDLER(AMOAND_W)  CORE_AMO(old & src)
+    CORE_HANDLER(AMOOR_W)   CORE_AMO(old | src)
+    CORE_HANDLER(AMOXOR_W)  CORE_AMO(old ^ src)
+    CORE_HANDLER(AMOMAX_W)  CORE_AMO((int32_t)old > (int32_t)src ? old : src)
+    CORE_HANDLER(AMOMIN_W)  CORE_AMO((int32_t)old < (int32_t)src ? old : src)
+    CORE_HANDLER(AMOMAXU_W) CORE_AMO(old > src ? old : src)
+    CORE_HANDLER(AMOMINU_W) CORE_AMO(old < src ? old : src)
+
+    CORE_HANDLER(LWU)
+    CORE_OP_HANDLER(ILLEGAL)        CORE_TRAP(MCAUSE_ILLEGAL_INSTRUCTION, IMM);
+    CORE_OP_HANDLER(FETCH_FAULT)    CORE_TRAP(IMM, insn->pc);      // IMM holds the cause
+    CORE_OP_HANDLER(END)
+    {
+        pc = insn->pc;
+        CORE_EXIT();
+    }
+#ifndef __GNUC__
+    }
+#endif
+}
+
+uint32_t RvCore::read_csr(uint32_t csr_num)
+{
+    switch (csr_num)
+    {
+    case CSR_MISA:
+        return MISA_VALUE;
+    case CSR_SSTATUS:
+        return csr[CSR_MSTATUS] & SR_SMODE_MASK;
+    case CSR_SIE:
+        return csr[CSR_MIE] & CSR_SIE_MASK;
+    case CSR_SIP:
+        return csr[CSR_MIP] & CSR_SIP_MASK;
+    // one cycle per retired instruction
+    case CSR_MCYCLE:
+    case CSR_RCYCLE:
+    case CSR_MTIME:
+    case CSR_RCYCLE + 2:    // instret
+        return (uint32_t)instret;
+    case CSR_MCYCLEH:
+    case CSR_RCYCLEH:
+    case CSR_MTIMEH:
+    case CSR_RCYCLEH + 2:   // instreth
+        return (uint32_t)(instret >> 32);
+    default:
+    {
+        uint32_t value;
+        if (host && csr_num >= CORE_CSR_HOST_FIRST && csr_num <= CORE_CSR_HOST_LAST &&
+            host->host_csr_read(this, csr_num, &value))
+            return value;
+        return csr[csr_num & (CORE_CSR_COUNT - 1)];
+    }
+    }
+}
+
+void RvCore::write_csr(uint32_t csr_num, uint32_t value)
+{
+    switch (csr_num)
+    {
+    case CSR_MISA:
+    case CSR_MHARTID:
+    case CSR_MVENDORID:
+    case CSR_MARCHID:
+    case CSR_MIMPID:
+        break;
+    case CSR_SSTATUS:
+        csr[CSR_MSTATUS] = (csr[CSR_MSTATUS] & ~SR_SMODE_MASK) | (value & SR_SMODE_MASK);
+        mmu_update_context();
+        break;
+    case CSR_MSTATUS:
+    case CSR_SATP:
+        csr[csr_num] = value;
+        mmu_update_context();
+        break;
+    case CSR_SIE:
+        csr[CSR_MIE] = (csr[CSR_MIE] & ~CSR_SIE_MASK) | (value & CSR_SIE_MASK);
+        break;
+    case CSR_SIP:
+        csr[CSR_MIP] = (csr[CSR_MIP] & ~CSR_SIP_MASK) | (value & CSR_SIP_MASK);
+        break;
+    case CSR_MCAUSE:
+        csr[CSR_MCAUSE] = value & CSR_MCAUSE_MASK;
+        break;
+    case CSR_SIM_CTRL:
+        if ((value & CORE_SIM_CTRL_CMD) == CSR_SIM_CTRL_EXIT)
+        {
+            halted = true;
+            halt_cause = CORE_HALT_EXIT;
+            exit_code = value & ~CORE_SIM_CTRL_CMD;
+            break;
+        }
+        if (host && host->host_csr_write(this, csr_num, value))
+            break;
+        csr[csr_num] = value;
+        break;
+    default:
+        if (host && csr_num >= CORE_CSR_HOST_FIRST && csr_num <= CORE_CSR_HOST_LAST &&
+            host->host_csr_write(this, csr_num, value))
+            break;
+        csr[csr_num & (CORE_CSR_COUNT - 1)] = value;
+        break;
+    }
+}
+
+void RvCore::take_trap(uint32_t cause, uint32_t tval, uint32_t trap_pc)
+{
+    pc = trap_pc;
+    if (csr[CSR_MTVEC] == 0)
+    {
+        halted = true;
+        halt_cause = cause;
+        return;
+    }
+    uint32_t status = csr[CSR_MSTATUS];
+    status = (status & SR_MIE) ? (status | SR_MPIE) : (status & ~SR_MPIE);
+    status &= ~(SR_MIE | SR_MPP);
+    status |= priv << SR_MPP_SHIFT;
+    csr[CSR_MSTATUS] = status;
+    csr[CSR_MEPC] = trap_pc;
+    csr[CSR_MCAUSE] = cause;
+    csr[CSR_MTVAL] = tval;
+    priv = PRIV_MACHINE;
+    pc = csr[CSR_MTVEC] & ~3u;
+    drop_reservation();
+    mmu_update_context();
+}
+
+void RvCore::return_from_trap(bool machine)
+{
+    uint32_t status = csr[CSR_MSTATUS];
+    if (machine)
+    {
+        priv = SR_GET_MPP(status);
+        status = (status & SR_MPIE) ? (status | SR_MIE) : (status & ~SR_MIE);
+        status |= SR_MPIE;
+        status &= ~SR_MPP;
+        pc = csr[CSR_MEPC];
+    }
+    else
+    {
+        priv = (status & SR_SPP) ? PRIV_SUPER : PRIV_USER;
+        status = (status & SR_SPIE) ? (status | SR_SIE) : (status & ~SR_SIE);
+        status |= SR_SPIE;
+        status &= ~SR_SPP;
+        pc = csr[CSR_SEPC];
+    }
+    csr[CSR_MSTATUS] = status;
+    drop_reservation();
+    mmu_update_context();
+}
+
+void RvCore::print_registers()
+{
+    cout << hex << setfill('0');
+    for (int i = 0; i < REGISTERS; i++)
+        cout << setw(4) << setfill(' ') << gpr_names[i] << " " << setw(8) << setfill('0') << gpr[i]
+             << ((i % 4) == 3 ? "\n" : "  ");
+    cout << "  pc " << setw(8) << pc << dec << setfill(' ') << endl;
+}
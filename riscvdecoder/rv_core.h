@@ -0,0 +1,297 @@
+#ifndef __RV_CORE__
+#define __RV_CORE__
+#include <stdint.h>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "isa.h"
+#include "elf_parser.h"
+#include "guest_memory.h"
+#include "decoded_instr.h"
+#include "rvc.h"
+using namespace std;
+
+//--------------------------------------------------------------------
+// RV32IMA execute engine. Code is predecoded once into basic blocks
+// (ending at the first IS_BRANCH_INST, fence.i or CORE_BLOCK_MAX_INSNS)
+// kept in a hash map keyed by PC, and executed with threaded dispatch:
+// each handler jumps straight to the next instruction's handler.
+//
+// Memory accesses go through a direct-mapped software TLB per access
+// type holding host addresses, filled by the Sv32 walker in rv_mmu.cpp
+// (or 1:1 while translation is off). A hit is one compare and one add.
+//
+// All traps go to machine mode. With mtvec still 0 there is no handler
+// to go to, so the core halts instead and halt_cause holds the mcause.
+// Writing CSR_SIM_CTRL_EXIT to CSR_SIM_CTRL halts it as well, with
+// halt_cause CORE_HALT_EXIT and the low 24 bits kept in exit_code.
+//--------------------------------------------------------------------
+#define CORE_BLOCK_MAX_INSNS    64
+#define CORE_BLOCK_CACHE_BITS   12
+#define CORE_BLOCK_CACHE_SIZE   (1 << CORE_BLOCK_CACHE_BITS)
+#define CORE_BLOCK_CACHE_INDEX(pc)  (((pc) >> 1) & (CORE_BLOCK_CACHE_SIZE - 1))
+#define CORE_SINK_REG           REGISTERS   // rd of instructions writing x0
+#define CORE_CSR_COUNT          4096
+#define CORE_CSR_HOST_FIRST     0x800   // custom CSRs offered to the RvCoreHost
+#define CORE_CSR_HOST_LAST      0x8ff
+#define CORE_SIM_CTRL_CMD       0xff000000  // command bits of a CSR_SIM_CTRL write
+#define CORE_HALT_EXIT          0xffffffff  // halt_cause after CSR_SIM_CTRL_EXIT, not an mcause
+#define CORE_BLOCK_STALE        ((uint8_t *)1)  // core_block host once its code was overwritten
+
+#define CORE_TLB_BITS           8
+#define CORE_TLB_SIZE           (1 << CORE_TLB_BITS)
+#define CORE_TLB_INVALID        0xffffffff
+#define CORE_TLB_PRIV_SHIFT     29      // tag: vpn, asid above it, privilege above that
+#define CORE_TLB_BARE           (3u << CORE_TLB_PRIV_SHIFT)    // context while translation is off
+
+enum eMmuAccess
+{
+    MMU_ACCESS_LOAD,
+    MMU_ACCESS_STORE,       // stores and amos
+    MMU_ACCESS_FETCH,
+    MMU_ACCESS_MAX
+};
+
+// handler ids beyond the eInstructions values
+enum eCoreOps
+{
+    CORE_OP_ILLEGAL = ENUM_INST_MAX,
+    CORE_OP_FETCH_FAULT,
+    CORE_OP_END,            // block ended without a control transfer
+    CORE_OP_MAX
+};
+
+typedef struct {
+    uint16_t op;            // eInstructions value or CORE_OP_*
+    int16_t opcode_id;      // instr_defs index, -1 if unknown
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t len;            // 2 for RVC, 4 otherwise
+    uint32_t imm;           // immediate, shift amount or CSR number
+    uint32_t pc;
+}core_insn;
+
+typedef struct {
+    uint32_t start_addr;
+    uint32_t end_addr;
+    uint8_t *host;          // host address of start_addr
+}core_window;
+
+typedef struct {
+    uint32_t context;               // tag bits above the VPN for the current mode
+    uint32_t tag[CORE_TLB_SIZE];    // vpn | context, CORE_TLB_INVALID if empty
+    uintptr_t addend[CORE_TLB_SIZE];    // host address minus virtual address of the page
+}core_tlb;
+
+// a predecoded block as stored outside the core (image_cache.h)
+typedef struct {
+    uint32_t pc;
+    uint32_t first_insn;    // index into the core_insn array saved alongside
+    uint32_t insn_count;
+}core_block_record;
+
+class RvCore;
+
+// What a core is embedded in (a multi-core platform, ...). Gets the custom
+// CSRs the core does not implement itself, every atomic write to memory,
+// plain stores while any core holds a reservation (held_reservations) and
+// every write made behind the cores' backs (external_write); it may set
+// the core's sync_request to end run() after the current block.
+class RvCoreHost
+{
+public:
+    virtual ~RvCoreHost() {}
+    // return false to leave the CSR to the core's plain storage
+    virtual bool host_csr_read(RvCore * /*core*/, uint32_t /*csr_num*/, uint32_t * /*value*/) { return false; }
+    virtual bool host_csr_write(RvCore * /*core*/, uint32_t /*csr_num*/, uint32_t /*value*/) { return false; }
+    // amo or successful sc to addr
+    virtual void host_atomic(RvCore * /*core*/, uint32_t /*addr*/) {}
+    // plain store of size bytes to addr
+    virtual void host_store(RvCore * /*core*/, uint32_t /*addr*/, uint32_t /*size*/) {}
+    // len bytes at addr (host address data) written on behalf of core
+    virtual void host_write(RvCore * /*core*/, uint32_t /*addr*/, const uint8_t * /*data*/, uint32_t /*len*/) {}
+};
+
+class RvCore
+{
+public:
+    uint32_t gpr[REGISTERS + 1];    // gpr_names order, plus the x0 sink
+    uint32_t pc;
+    uint32_t priv;
+    uint32_t csr[CORE_CSR_COUNT];
+    uint64_t instret;
+    bool halted;
+    uint32_t halt_cause;
+    uint32_t exit_code;             // argument of CSR_SIM_CTRL_EXIT
+    RvCoreHost *host;
+    bool sync_request;              // run() returns at the end of the current block
+    // Stop in front of amos, sc and host CSRs instead of executing them
+    // (pc left on the instruction, sync_request set) so the host can run
+    // them with step() in a deterministic order.
+    bool defer_shared;
+    uint32_t fault_cause;           // mcause of the last failed translate()
+    // Reservations held by the cores sharing memory with this one, NULL
+    // if there are none. While it is not 0 every plain store goes to
+    // host_store so the other cores' reservations on it can be dropped;
+    // otherwise a store costs one load of it.
+    atomic<uint32_t> *held_reservations;
+
+    RvCore(uint32_t hart_id = 0);
+    virtual ~RvCore() {}
+    // image as loaded by ELFParser; addresses are section (virtual) addresses
+    void map_image(uint8_t *mem, const vector<region> &regions);
+    // sparse memory, used for physical addresses outside the image windows
+    void map_memory(GuestMemory *mem);
+    void reset(uint32_t start_pc);
+
+    // Runs predecoded blocks until max_insns have retired (rounded up to
+    // the end of a block) or the core halts. Returns instructions retired.
+    virtual uint64_t run(uint64_t max_insns);
+    // Executes the single instruction at pc, also one defer_shared stopped at.
+    void step();
+    // Executes one instruction as decoded by RV_DECODER (word and opcode_id
+    // from instr, register numbers from its rs1/rs2/rd) and returns the new pc.
+    uint32_t execute(const DecodedInstr &instr, uint32_t len);
+    // Instruction fetch for callers driving RV_DECODER: the 32-bit (expanded)
+    // word at addr and its length, or 0 (and fault_cause) if it cannot be fetched.
+    uint32_t fetch(uint32_t addr, uint32_t *word);
+    void flush_blocks();
+    // Predecodes the executable regions front to back into blocks, so
+    // they can be saved before anything runs.
+    void predecode_text(const vector<region> &regions);
+    // Blocks as records sorted by pc plus their instructions, and back.
+    // Imported records stay where they are (they must outlive the core or
+    // the next map_memory/flush_blocks) and are copied in the first time
+    // their pc runs with translation matching the address; fence.i drops them.
+    void export_blocks(vector<core_block_record> &records, vector<core_insn> &insns);
+    void import_blocks(const core_block_record *records, uint32_t count, const core_insn *insns);
+    // whether import_blocks() can run records read from outside: sorted,
+    // within the insn_count instructions, each ending its block and
+    // naming only handlers, instr_defs entries and registers that exist
+    static bool check_blocks(const core_block_record *records, uint32_t count, const core_insn *insns,
+                             uint32_t insn_count);
+    void tlb_flush();
+    void print_registers();
+    // Drop this core's LR reservation if it covers addr (written by another
+    // core). May run on another core's host thread in parallel mode.
+    void clear_reservation(uint32_t addr)
+    {
+        if (reservation_valid && reservation == addr)
+            drop_reservation();
+    }
+    // ... or if it overlaps the len bytes at addr
+    void clear_reservation(uint32_t addr, uint32_t len)
+    {
+        uint32_t reserved = reservation;
+        if (reservation_valid && reserved < (uint64_t)addr + len && (uint64_t)reserved + 4 > addr)
+            drop_reservation();
+    }
+    void atomic_access(uint32_t addr)
+    {
+        if (host)
+            host->host_atomic(this, addr);
+    }
+    void store_access(uint32_t addr, uint32_t size)
+    {
+        if (held_reservations != NULL && held_reservations->load(memory_order_relaxed) != 0)
+            host->host_store(this, addr, size);
+    }
+    // Something other than this core's stores (a host call reading a file,
+    // ...) wrote len bytes at virtual addr, host address data, all within
+    // one page: drops the reservation and the predecoded blocks covering
+    // them, and has the host do the same for the other cores.
+    void external_write(uint32_t addr, const uint8_t *data, uint32_t len);
+    // Blocks (and imported records) fetched from the len bytes at host
+    // address data are rebuilt the next time they run. Safe from within a
+    // handler: the block being executed is marked, not freed.
+    void invalidate_code(const uint8_t *data, uint32_t len);
+    // immediate operand of word by major opcode: sign-extended I/S/B/J
+    // immediates, U immediates in place, shift amounts, CSR numbers
+    static uint32_t immediate(uint32_t word);
+
+    // host address of a size byte access at virtual addr, NULL with
+    // fault_cause set if it faults
+    uint8_t *translate(uint32_t addr, uint32_t size, uint32_t access = MMU_ACCESS_LOAD)
+    {
+        const core_tlb &tlb = tlbs[access];
+        uint32_t vpn = addr >> MMU_PGSHIFT;
+        uint32_t index = vpn & (CORE_TLB_SIZE - 1);
+        if (tlb.tag[index] == (vpn | tlb.context) && ((addr + size - 1) >> MMU_PGSHIFT) == vpn)
+            return (uint8_t *)(tlb.addend[index] + addr);
+        return translate_slow(addr, size, access);
+    }
+
+protected:
+    typedef struct {
+        vector<core_insn> insns;
+        uint8_t *host;      // where the block was fetched from, tells apart address spaces
+    }core_block;
+
+    vector<core_window> windows;
+    const core_window *last_window;
+    core_window no_window;
+    GuestMemory *memory;
+    core_window page_window;        // last page of memory looked up
+    core_tlb tlbs[MMU_ACCESS_MAX];
+    uint32_t mmu_status;            // mstatus SUM and MXR the TLB entries were checked with
+    unordered_map<uint32_t, core_block> blocks;
+    unordered_set<uintptr_t> code_pages;    // host pages blocks were fetched from, >> MMU_PGSHIFT
+    uint32_t block_tags[CORE_BLOCK_CACHE_SIZE];
+    core_block *block_cache[CORE_BLOCK_CACHE_SIZE];
+    atomic<uint32_t> reservation;
+    atomic<bool> reservation_valid;
+    RvcExpander rvc;
+    const core_block_record *imported_records;
+    uint32_t imported_count;
+    const core_insn *imported_insns;
+    unordered_set<uintptr_t> imported_pages;    // host pages the imported records cover, >> MMU_PGSHIFT
+
+    // physical address to host address through the image windows, or the
+    // page of memory the access falls in
+    uint8_t *translate_phys(uint32_t addr, uint32_t size)
+    {
+        const core_window *window = last_window;
+        if (addr < window->start_addr || (uint64_t)addr + size > window->end_addr)
+            return translate_phys_slow(addr, size);
+        return window->host + (addr - window->start_addr);
+    }
+    uint8_t *translate_phys_slow(uint32_t addr, uint32_t size);
+    // rv_mmu.cpp
+    uint8_t *translate_slow(uint32_t addr, uint32_t size, uint32_t access);
+    uint32_t mmu_walk(uint32_t vaddr, uint32_t access, uint32_t access_priv, uint32_t *paddr);
+    uint32_t mmu_access_priv(uint32_t access);
+    void mmu_update_context();
+    void predecode(uint32_t word, int opcode_id, uint32_t insn_pc, uint32_t len, core_insn &insn);
+    core_block *build_block(uint32_t block_pc, uint8_t *host);
+    core_block *lookup_block(uint32_t block_pc)
+    {
+        uint32_t index = CORE_BLOCK_CACHE_INDEX(block_pc);
+        uint8_t *host = translate(block_pc, 2, MMU_ACCESS_FETCH);
+        if (block_tags[index] == block_pc && block_cache[index] != NULL && block_cache[index]->host == host)
+            return block_cache[index];
+        core_block *block = build_block(block_pc, host);
+        block_tags[index] = block_pc;
+        block_cache[index] = block;
+        return block;
+    }
+    void exec_block(const core_insn *insn);
+    void set_reservation(uint32_t addr)
+    {
+        reservation = addr;
+        if (!reservation_valid.exchange(true) && held_reservations != NULL)
+            held_reservations->fetch_add(1);
+    }
+    // exactly once per reservation, whichever core gets here first
+    void drop_reservation()
+    {
+        if (reservation_valid.exchange(false) && held_reservations != NULL)
+            held_reservations->fetch_sub(1);
+    }
+    uint32_t read_csr(uint32_t csr_num);
+    void write_csr(uint32_t csr_num, uint32_t value);
+    void take_trap(uint32_t cause, uint32_t tval, uint32_t trap_pc);
+    void return_from_trap(bool machine);
+};
+#endif
@@ -0,0 +1,165 @@
+#ifndef __RV_DECODER__
+#define __RV_DECODER__
+#include <systemc.h>
+#include <tlm.h>
+#include <tlm_utils/simple_target_socket.h>
+#include <string.h>
+#include "isa.h"
+#include "decode_table.h"
+#include "decoded_instr.h"
+#include "instr_stats.h"
+
+#define DECODE_LATENCY_NS 10
+
+// Decoded fields returned by RV_DECODER::b_transport. The payload data
+// carries the 32-bit instruction word (TLM_WRITE_COMMAND, 4 bytes).
+struct decoded_instr_ext : tlm::tlm_extension<decoded_instr_ext>
+{
+    DecodedInstr instr;
+
+    tlm::tlm_extension_base *clone() const
+    {
+        return new decoded_instr_ext(*this);
+    }
+    void copy_from(const tlm::tlm_extension_base &ext)
+    {
+        *this = static_cast<const decoded_instr_ext &>(ext);
+    }
+};
+
+SC_MODULE(RV_DECODER)
+{
+    tlm_utils::simple_target_socket<RV_DECODER> socket;
+    sc_in<bool> clk;
+    sc_in<bool> reset;
+    sc_in<sc_uint<32>> instr;
+    sc_out<sc_uint<5>> rs1;
+    sc_out<sc_uint<5>> rs2;
+    sc_out<sc_uint<5>> rd;
+    sc_out<sc_uint<32>> imm_12_itype;
+    sc_out<sc_uint<32>> imm_12_sbtype;
+    sc_out<sc_uint<32>> imm_20_ujtype;
+    sc_out<sc_uint<32>> selected_imm;
+    sc_out<sc_uint<32>> shift_amt;
+    sc_out<sc_uint<32>> opcode_id;
+    // optional packed output: when bound, it replaces the ten ports above
+    sc_port<sc_signal_inout_if<DecodedInstr>, 1, SC_ZERO_OR_MORE_BOUND> decoded;
+    bool clocked = true;
+    // Called from the SC_METHOD on each rising edge, or with set_clocked(false)
+    // straight from the process that drives the cycles (which then is the
+    // only one writing the outputs).
+    void perform_decoding()
+    {
+        if (decoded.size())
+        {
+            DecodedInstr instr_out = decoded->read();
+            decode_word(instr.read(), instr_out);
+            decoded->write(instr_out);
+            return;
+        }
+        // Fields of this word only: the output ports still hold the last
+        // instruction's values until the update phase. An unknown word
+        // leaves opcode_id and selected_imm as they were, as on the packed port.
+        DecodedInstr instr_out;
+        instr_out.opcode_id = opcode_id.read();
+        instr_out.selected_imm = selected_imm.read();
+        decode_word(instr.read(), instr_out);
+        rs1 = instr_out.rs1;
+        rs2 = instr_out.rs2;
+        rd = instr_out.rd;
+        imm_12_itype = instr_out.imm_12_itype;
+        imm_12_sbtype = instr_out.imm_12_sbtype;
+        imm_20_ujtype = instr_out.imm_20_ujtype;
+        shift_amt = instr_out.shift_amt;
+        opcode_id = instr_out.opcode_id;
+        selected_imm = instr_out.selected_imm;
+    }
+
+    // Field extraction for every path: the pins, the packed port and
+    // b_transport. The immediate is selected from this word's fields.
+    void decode_word(uint32_t opcode_val, DecodedInstr &ext)
+    {
+        sc_uint<32> word = opcode_val;
+        ext.instr = opcode_val;
+        ext.rs1 = (uint32_t)word.range(20, 15) & 0x1f;
+        ext.rs2 = (uint32_t)word.range(24, 20);
+        ext.rd = (uint32_t)word.range(12, 7) & 0x1f;
+        ext.imm_12_itype = word.range(31, 20);
+        ext.imm_12_sbtype = (word.range(31, 24) << 5) | word.range(11, 7);
+        ext.imm_20_ujtype = word.range(31, 12);
+        ext.shift_amt = word.range(24, 20);
+        int i = rv_decode_table.lookup(opcode_val);
+        INSTR_STATS_DECODE(i);
+        if (i < 0)
+            return;
+        ext.opcode_id = i;
+        ext.instr_type = instr_defs[i].instruction_type;
+        switch (instr_defs[i].immediate_type)
+        {
+        case IMM_TYPE_NONE:
+            ext.selected_imm = 0;
+            break;
+        case IMM_TYPE_IMM12:
+            ext.selected_imm = ext.imm_12_itype;
+            break;
+        case IMM_TYPE_IMM20:
+            ext.selected_imm = ext.imm_20_ujtype;
+            break;
+        case IMM_TYPE_SIMM:
+            ext.selected_imm = ext.imm_12_sbtype;
+            break;
+        case IMM_TYPE_BIMM:
+            ext.selected_imm = ext.imm_12_sbtype << 1;
+            break;
+        case IMM_TYPE_JIMM20:
+            ext.selected_imm = ext.imm_20_ujtype << 1;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void b_transport(tlm::tlm_generic_payload & trans, sc_time & delay)
+    {
+        decoded_instr_ext *ext;
+        trans.get_extension(ext);
+        if (trans.get_command() != tlm::TLM_WRITE_COMMAND || trans.get_data_length() != 4)
+        {
+            trans.set_response_status(tlm::TLM_COMMAND_ERROR_RESPONSE);
+            return;
+        }
+        if (ext == NULL)
+        {
+            trans.set_response_status(tlm::TLM_GENERIC_ERROR_RESPONSE);
+            return;
+        }
+        uint32_t opcode_val;
+        memcpy(&opcode_val, trans.get_data_ptr(), 4);
+        decode_word(opcode_val, ext->instr);
+        delay += sc_time(DECODE_LATENCY_NS, SC_NS);
+        trans.set_response_status(tlm::TLM_OK_RESPONSE);
+    }
+
+    SC_CTOR(RV_DECODER) : socket("socket"), clk("clk"), reset("reset"), instr("instr"), rs1("rs1"), rs2("rs2"), rd("rd"),
+                          imm_12_itype("imm_12_itype"), imm_12_sbtype("imm_12_sbtype"), imm_20_ujtype("imm_20_ujtype"),
+                          selected_imm("selected_imm"), shift_amt("shift_amt"), opcode_id("opcode_id"), decoded("decoded")
+    {
+        socket.register_b_transport(this, &RV_DECODER::b_transport);
+    }
+
+    // before sc_start
+    void set_clocked(bool enable)
+    {
+        clocked = enable;
+    }
+
+    void before_end_of_elaboration()
+    {
+        if (!clocked)
+            return;
+        SC_METHOD(perform_decoding);
+        sensitive << clk.pos();
+        sensitive << reset;
+    }
+};
+#endif
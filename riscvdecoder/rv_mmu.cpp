@@ -0,0 +1,170 @@
+#include "rv_core.h"
+#include <string.h>
+
+//--------------------------------------------------------------------
+// Sv32 translation for RvCore. The software TLB is checked inline in
+// RvCore::translate; everything here runs on a miss. Permissions are
+// checked when an entry is filled, so each access type has its own
+// TLB and a change of SUM/MXR flushes them. The privilege an entry was
+// filled for is part of its tag, next to the ASID from satp.
+//--------------------------------------------------------------------
+#define MMU_PGMASK          (MMU_PGSIZE - 1)
+#define MMU_PTIDXMASK       ((1 << MMU_PTIDXBITS) - 1)
+#define MMU_PPN_LIMIT       (1u << MMU_PPN_BITS)   // physical addresses stop at 4 GiB
+
+static const uint32_t mmu_access_fault[MMU_ACCESS_MAX] = {MCAUSE_FAULT_LOAD, MCAUSE_FAULT_STORE, MCAUSE_FAULT_FETCH};
+static const uint32_t mmu_page_fault[MMU_ACCESS_MAX] = {MCAUSE_PAGE_FAULT_LOAD, MCAUSE_PAGE_FAULT_STORE, MCAUSE_PAGE_FAULT_INST};
+static const uint32_t mmu_misaligned[MMU_ACCESS_MAX] = {MCAUSE_MISALIGNED_LOAD, MCAUSE_MISALIGNED_STORE, MCAUSE_MISALIGNED_FETCH};
+
+void RvCore::tlb_flush()
+{
+    for (int access = 0; access < MMU_ACCESS_MAX; access++)
+        memset(tlbs[access].tag, 0xff, sizeof(tlbs[access].tag));
+}
+
+// privilege loads and stores are checked with: MPP under MPRV
+uint32_t RvCore::mmu_access_priv(uint32_t access)
+{
+    uint32_t status = csr[CSR_MSTATUS];
+    if (access != MMU_ACCESS_FETCH && priv == PRIV_MACHINE && (status & SR_MPRV))
+        return SR_GET_MPP(status);
+    return priv;
+}
+
+// Called whenever priv, satp or mstatus may have changed.
+void RvCore::mmu_update_context()
+{
+    uint32_t status = csr[CSR_MSTATUS] & (SR_SUM | SR_MXR);
+    if (status != mmu_status)
+    {
+        mmu_status = status;
+        tlb_flush();
+    }
+    uint32_t satp = csr[CSR_SATP];
+    uint32_t asid = (satp >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+    for (int access = 0; access < MMU_ACCESS_MAX; access++)
+    {
+        uint32_t access_priv = mmu_access_priv(access);
+        if (!(satp & SATP_MODE) || access_priv == PRIV_MACHINE)
+            tlbs[access].context = CORE_TLB_BARE;
+        else
+            tlbs[access].context = (asid << MMU_VPN_BITS) | (access_priv << CORE_TLB_PRIV_SHIFT);
+    }
+}
+
+// Walks the page table for vaddr, setting A (and D on stores) in the
+// leaf PTE. Returns 0 with the physical address, or the mcause.
+uint32_t RvCore::mmu_walk(uint32_t vaddr, uint32_t access, uint32_t access_priv, uint32_t *paddr)
+{
+    uint32_t table_ppn = csr[CSR_SATP] & SATP_PPN_MASK;
+    for (int level = MMU_LEVELS - 1; level >= 0; level--)
+    {
+        if (table_ppn >= MMU_PPN_LIMIT)
+            return mmu_access_fault[access];
+        uint32_t index = (vaddr >> (MMU_PGSHIFT + level * MMU_PTIDXBITS)) & MMU_PTIDXMASK;
+        uint8_t *p = translate_phys((table_ppn << MMU_PGSHIFT) + index * MMU_PTESIZE, MMU_PTESIZE);
+        if (p == NULL)
+            return mmu_access_fault[access];
+        uint32_t pte;
+        memcpy(&pte, p, MMU_PTESIZE);
+        uint32_t ppn = pte >> PAGE_PFN_SHIFT;
+        if (!(pte & PAGE_PRESENT) || ((pte & PAGE_WRITE) && !(pte & PAGE_READ)))
+            return mmu_page_fault[access];
+        if (PAGE_TABLE(pte))
+        {
+            table_ppn = ppn;
+            continue;
+        }
+
+        // leaf
+        if (pte & PAGE_USER)
+        {
+            if (access_priv == PRIV_SUPER && (access == MMU_ACCESS_FETCH || !(csr[CSR_MSTATUS] & SR_SUM)))
+                return mmu_page_fault[access];
+        }
+        else if (access_priv == PRIV_USER)
+            return mmu_page_fault[access];
+        bool allowed;
+        switch (access)
+        {
+        case MMU_ACCESS_FETCH:
+            allowed = pte & PAGE_EXEC;
+            break;
+        case MMU_ACCESS_STORE:
+            allowed = pte & PAGE_WRITE;
+            break;
+        default:
+            allowed = (pte & PAGE_READ) || ((pte & PAGE_EXEC) && (csr[CSR_MSTATUS] & SR_MXR));
+            break;
+        }
+        if (!allowed)
+            return mmu_page_fault[access];
+        uint32_t level_mask = (1u << (level * MMU_PTIDXBITS)) - 1;
+        if (ppn & level_mask)   // misaligned superpage
+            return mmu_page_fault[access];
+
+        uint32_t update = PAGE_ACCESSED | (access == MMU_ACCESS_STORE ? PAGE_DIRTY : 0);
+        if ((pte & update) != update)
+        {
+            pte |= update;
+            memcpy(p, &pte, MMU_PTESIZE);
+        }
+        ppn |= (vaddr >> MMU_PGSHIFT) & level_mask;
+        if (ppn >= MMU_PPN_LIMIT)
+            return mmu_access_fault[access];
+        *paddr = (ppn << MMU_PGSHIFT) | (vaddr & MMU_PGMASK);
+        return 0;
+    }
+    return mmu_page_fault[access];
+}
+
+uint8_t *RvCore::translate_slow(uint32_t addr, uint32_t size, uint32_t access)
+{
+    const core_tlb &tlb = tlbs[access];
+    bool paging = tlb.context != CORE_TLB_BARE;
+    uint32_t paddr = addr;
+    if (paging)
+    {
+        uint32_t cause = mmu_walk(addr, access, mmu_access_priv(access), &paddr);
+        if (cause)
+        {
+            fault_cause = cause;
+            return NULL;
+        }
+    }
+    uint32_t last = addr + size - 1;
+    if ((last >> MMU_PGSHIFT) != (addr >> MMU_PGSHIFT))
+    {
+        // crosses a page: fine if the second page follows physically
+        uint32_t last_paddr = last;
+        if (paging)
+        {
+            uint32_t cause = mmu_walk(last, access, mmu_access_priv(access), &last_paddr);
+            if (cause)
+            {
+                fault_cause = cause;
+                return NULL;
+            }
+        }
+        uint8_t *host = last_paddr == paddr + size - 1 ? translate_phys(paddr, size) : NULL;
+        if (host == NULL)
+            fault_cause = paging ? mmu_misaligned[access] : mmu_access_fault[access];
+        return host;
+    }
+    uint8_t *host = translate_phys(paddr, size);
+    if (host == NULL)
+    {
+        fault_cause = mmu_access_fault[access];
+        return NULL;
+    }
+    // only whole pages go into the TLB, a hit must not run past the image
+    uint8_t *page = translate_phys(paddr & ~MMU_PGMASK, MMU_PGSIZE);
+    if (page != NULL)
+    {
+        uint32_t vpn = addr >> MMU_PGSHIFT;
+        uint32_t index = vpn & (CORE_TLB_SIZE - 1);
+        tlbs[access].tag[index] = vpn | tlb.context;
+        tlbs[access].addend[index] = (uintptr_t)page - (addr & ~MMU_PGMASK);
+    }
+    return host;
+}
@@ -0,0 +1,390 @@
+#ifndef __RV_PLATFORM__
+#define __RV_PLATFORM__
+#ifndef SC_INCLUDE_DYNAMIC_PROCESSES
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+#endif
+#include <systemc.h>
+#include <tlm.h>
+#include <tlm_utils/tlm_quantumkeeper.h>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "rv_decoder.h"
+#include "rv_core.h"
+
+//--------------------------------------------------------------------
+// Up to RISCV_CORES_NUM RvCores sharing one memory image. Every core
+// has its own SC_THREAD and tlm_quantumkeeper and runs ahead of
+// simulated time by up to the global quantum (DECODE_LATENCY_NS per
+// instruction); it only syncs early on atomics and thread CSRs.
+//
+// Core 0 starts at the entry point, the others are idle until started
+// through the thread CSRs of the core asking for them:
+//   CSR_THREAD_PC, _STACKADDR, _STACKSIZE, _ARG  plain registers
+//   CSR_THREAD_SCHEDCORE   core to start, or any idle one if not idle
+//   write CSR_THREAD_START starts it at THREAD_PC with sp set to
+//                          STACKADDR + STACKSIZE and a0 to THREAD_ARG;
+//                          CSR_THREAD_PID reads its hart id afterwards,
+//                          PLATFORM_NO_CORE if no core was idle
+//   write CSR_THREAD_DONE  the calling core goes idle
+//   read CSR_THREAD_DONE   mask of idle cores
+//   write CSR_THREAD_JOIN  waits until the given core is idle
+// Every other custom CSR goes on to the services host (host_calls.h),
+// if one is set. A core halting goes idle as well; the simulation stops when core 0
+// halts or any core writes CSR_SIM_CTRL_EXIT. Every store, plain or
+// atomic, drops the other cores' LR reservations on the bytes it writes;
+// plain stores only look while some core holds one.
+//
+// With parallel set, one SC_THREAD runs the platform in rounds of one
+// quantum: every running core executes its quantum on its own host
+// thread, stopping in front of amos, sc and thread CSRs (defer_shared).
+// At the barrier after the round the SC_THREAD executes those deferred
+// instructions core by core, applies thread starts/stops and advances
+// simulated time by the quantum. Other cores' stores are not ordered
+// within a round, so results are deterministic for a fixed quantum as
+// long as cores only communicate through atomics and thread CSRs.
+//--------------------------------------------------------------------
+#define PLATFORM_NO_CORE    0xffffffff
+
+enum ePlatformCoreState
+{
+    PLATFORM_CORE_IDLE,
+    PLATFORM_CORE_STARTING,     // registers set, thread not woken yet
+    PLATFORM_CORE_RUNNING,
+    PLATFORM_CORE_STOPPING      // THREAD_DONE written, idle at the next sync
+};
+
+class RvPlatform : public sc_module, public RvCoreHost
+{
+public:
+    SC_HAS_PROCESS(RvPlatform);
+
+    RvPlatform(sc_module_name name, uint32_t core_count, bool parallel = false) : sc_module(name)
+    {
+        services = NULL;
+        held_reservations = 0;
+        num_cores = core_count < 1 ? 1 : (core_count > RISCV_CORES_NUM ? RISCV_CORES_NUM : core_count);
+        for (uint32_t i = 0; i < num_cores; i++)
+        {
+            cores[i] = new RvCore(i);
+            cores[i]->host = this;
+            cores[i]->defer_shared = parallel;
+            cores[i]->held_reservations = &held_reservations;
+            state[i] = PLATFORM_CORE_IDLE;
+            start_target[i] = PLATFORM_NO_CORE;
+            join_target[i] = PLATFORM_NO_CORE;
+            if (!parallel)
+                sc_spawn(sc_bind(&RvPlatform::core_thread, this, i));
+        }
+        if (parallel)
+            SC_THREAD(parallel_thread);
+    }
+
+    ~RvPlatform()
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+            delete cores[i];
+    }
+
+    void map_memory(GuestMemory *mem)
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+            cores[i]->map_memory(mem);
+    }
+
+    // what gets the custom CSRs besides the thread ones
+    void set_services(RvCoreHost *host)
+    {
+        services = host;
+    }
+
+    // core 0 starts at entry_pc
+    void reset(uint32_t entry_pc)
+    {
+        cores[0]->reset(entry_pc);
+        state[0] = PLATFORM_CORE_RUNNING;
+    }
+
+    uint32_t get_num_cores()
+    {
+        return num_cores;
+    }
+
+    RvCore *get_core(uint32_t id)
+    {
+        return cores[id];
+    }
+
+    // the core that ended the run: one that wrote CSR_SIM_CTRL_EXIT, else core 0
+    RvCore *exit_core()
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+            if (cores[i]->halted && cores[i]->halt_cause == CORE_HALT_EXIT)
+                return cores[i];
+        return cores[0];
+    }
+
+    uint64_t instret()
+    {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < num_cores; i++)
+            total += cores[i]->instret;
+        return total;
+    }
+
+    void print_registers()
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+        {
+            cout << "core " << i << ": " << cores[i]->instret << " instructions" << endl;
+            cores[i]->print_registers();
+        }
+    }
+
+    bool host_csr_read(RvCore *core, uint32_t csr_num, uint32_t *value)
+    {
+        if (csr_num != CSR_THREAD_DONE)
+            return services && services->host_csr_read(core, csr_num, value);
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < num_cores; i++)
+            if (state[i] == PLATFORM_CORE_IDLE)
+                mask |= 1 << i;
+        *value = mask;
+        // polled in a loop: let the other cores catch up
+        core->sync_request = true;
+        return true;
+    }
+
+    bool host_csr_write(RvCore *core, uint32_t csr_num, uint32_t value)
+    {
+        uint32_t id = core->csr[CSR_MHARTID];
+        switch (csr_num)
+        {
+        case CSR_THREAD_START:
+        {
+            uint32_t target = pick_core(core->csr[CSR_THREAD_SCHEDCORE]);
+            core->csr[CSR_THREAD_PID] = target;
+            if (target != PLATFORM_NO_CORE)
+            {
+                RvCore *next = cores[target];
+                next->reset(core->csr[CSR_THREAD_PC]);
+                next->gpr[GPR_SP] = core->csr[CSR_THREAD_STACKADDR] + core->csr[CSR_THREAD_STACKSIZE];
+                next->gpr[GPR_A0] = core->csr[CSR_THREAD_ARG];
+                state[target] = PLATFORM_CORE_STARTING;
+                start_target[id] = target;
+                core->sync_request = true;
+            }
+            return true;
+        }
+        case CSR_THREAD_DONE:
+            state[id] = PLATFORM_CORE_STOPPING;
+            core->sync_request = true;
+            return true;
+        case CSR_THREAD_JOIN:
+            join_target[id] = value < num_cores && value != id ? value : PLATFORM_NO_CORE;
+            core->sync_request = true;
+            return true;
+        default:
+            return services && services->host_csr_write(core, csr_num, value);
+        }
+    }
+
+    // another core may hold a reservation on addr
+    void host_atomic(RvCore *core, uint32_t addr)
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+            if (cores[i] != core)
+                cores[i]->clear_reservation(addr);
+        core->sync_request = true;
+    }
+
+    // a plain store drops the other cores' reservations it overlaps, as
+    // the A extension requires; a core's own stores leave its reservation
+    void host_store(RvCore *core, uint32_t addr, uint32_t size)
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+            if (cores[i] != core)
+                cores[i]->clear_reservation(addr, size);
+    }
+
+    // a host call read into memory the other cores may have predecoded or reserved
+    void host_write(RvCore *core, uint32_t addr, const uint8_t *data, uint32_t len)
+    {
+        for (uint32_t i = 0; i < num_cores; i++)
+            if (cores[i] != core)
+            {
+                cores[i]->clear_reservation(addr, len);
+                cores[i]->invalidate_code(data, len);
+            }
+    }
+
+protected:
+    uint32_t num_cores;
+    RvCore *cores[RISCV_CORES_NUM];
+    ePlatformCoreState state[RISCV_CORES_NUM];
+    uint32_t start_target[RISCV_CORES_NUM];    // core started by this one, woken at its next sync
+    uint32_t join_target[RISCV_CORES_NUM];     // core this one waits for
+    sc_event start_event[RISCV_CORES_NUM];
+    sc_event idle_event[RISCV_CORES_NUM];
+    RvCoreHost *services;
+    atomic<uint32_t> held_reservations;     // RvCore::held_reservations of every core
+
+    // parallel mode: round handshake with the worker threads
+    mutex round_mutex;
+    condition_variable round_start;
+    condition_variable round_done;
+    uint64_t round;
+    uint32_t workers_busy;
+    bool workers_exit;
+
+    uint32_t pick_core(uint32_t wanted)
+    {
+        if (wanted < num_cores && state[wanted] == PLATFORM_CORE_IDLE)
+            return wanted;
+        for (uint32_t i = 0; i < num_cores; i++)
+            if (state[i] == PLATFORM_CORE_IDLE)
+                return i;
+        return PLATFORM_NO_CORE;
+    }
+
+    void go_idle(uint32_t id)
+    {
+        state[id] = PLATFORM_CORE_IDLE;
+        idle_event[id].notify(SC_ZERO_TIME);
+    }
+
+    void core_thread(uint32_t id)
+    {
+        RvCore *core = cores[id];
+        uint64_t quantum_insns = tlm::tlm_global_quantum::instance().get().value() /
+                                 sc_time(DECODE_LATENCY_NS, SC_NS).value();
+        tlm_utils::tlm_quantumkeeper qkeeper;
+        if (quantum_insns == 0)
+            quantum_insns = 1;
+        while (true)
+        {
+            if (state[id] == PLATFORM_CORE_IDLE || state[id] == PLATFORM_CORE_STARTING)
+            {
+                wait(start_event[id]);
+                state[id] = PLATFORM_CORE_RUNNING;
+            }
+            qkeeper.reset();
+            while (state[id] == PLATFORM_CORE_RUNNING && !core->halted)
+            {
+                uint64_t insns = core->run(quantum_insns);
+                qkeeper.inc(sc_time((double)insns * DECODE_LATENCY_NS, SC_NS));
+                if (!core->sync_request && !core->halted && !qkeeper.need_sync())
+                    continue;
+                // everything below happens at this core's local time
+                qkeeper.sync();
+                if (start_target[id] != PLATFORM_NO_CORE)
+                {
+                    start_event[start_target[id]].notify(SC_ZERO_TIME);
+                    start_target[id] = PLATFORM_NO_CORE;
+                }
+                if (join_target[id] != PLATFORM_NO_CORE)
+                {
+                    while (state[join_target[id]] != PLATFORM_CORE_IDLE)
+                        wait(idle_event[join_target[id]]);
+                    join_target[id] = PLATFORM_NO_CORE;
+                    qkeeper.reset();
+                }
+            }
+            if (core->halted && (id == 0 || core->halt_cause == CORE_HALT_EXIT))
+            {
+                sc_stop();
+                return;
+            }
+            go_idle(id);
+        }
+    }
+
+    bool runnable(uint32_t id)
+    {
+        return state[id] == PLATFORM_CORE_RUNNING && join_target[id] == PLATFORM_NO_CORE && !cores[id]->halted;
+    }
+
+    void worker_thread(uint32_t id, uint64_t quantum_insns)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(round_mutex);
+                round_start.wait(lock, [&]() { return round != seen || workers_exit; });
+                if (workers_exit)
+                    return;
+                seen = round;
+            }
+            // state is only changed by the SC_THREAD between rounds
+            if (runnable(id))
+                cores[id]->run(quantum_insns);
+            unique_lock<mutex> lock(round_mutex);
+            if (--workers_busy == 0)
+                round_done.notify_one();
+        }
+    }
+
+    void parallel_thread()
+    {
+        sc_time quantum = tlm::tlm_global_quantum::instance().get();
+        uint64_t quantum_insns = quantum.value() / sc_time(DECODE_LATENCY_NS, SC_NS).value();
+        if (quantum_insns == 0)
+            quantum_insns = 1;
+        round = 0;
+        workers_exit = false;
+        vector<thread> workers;
+        for (uint32_t i = 0; i < num_cores; i++)
+            workers.push_back(thread(&RvPlatform::worker_thread, this, i, quantum_insns));
+
+        bool stop = false;
+        while (!stop)
+        {
+            {
+                unique_lock<mutex> lock(round_mutex);
+                workers_busy = num_cores;
+                round++;
+                round_start.notify_all();
+                round_done.wait(lock, [&]() { return workers_busy == 0; });
+            }
+            // barrier: shared traffic and thread control, in core order
+            for (uint32_t i = 0; i < num_cores; i++)
+                if (runnable(i) && cores[i]->sync_request)
+                    cores[i]->step();
+            bool active = false;
+            for (uint32_t i = 0; i < num_cores; i++)
+            {
+                if (state[i] == PLATFORM_CORE_RUNNING && cores[i]->halted)
+                {
+                    if (i == 0 || cores[i]->halt_cause == CORE_HALT_EXIT)
+                        stop = true;
+                    go_idle(i);
+                }
+                else if (state[i] == PLATFORM_CORE_STOPPING)
+                    go_idle(i);
+                else if (state[i] == PLATFORM_CORE_STARTING)
+                    state[i] = PLATFORM_CORE_RUNNING;   // from the next round on
+                start_target[i] = PLATFORM_NO_CORE;
+            }
+            for (uint32_t i = 0; i < num_cores; i++)
+            {
+                if (join_target[i] != PLATFORM_NO_CORE && state[join_target[i]] == PLATFORM_CORE_IDLE)
+                    join_target[i] = PLATFORM_NO_CORE;
+                active = active || runnable(i);
+            }
+            if (!active)
+                stop = true;
+            wait(quantum);
+        }
+        {
+            lock_guard<mutex> lock(round_mutex);
+            workers_exit = true;
+            round_start.notify_all();
+        }
+        for (auto worker = workers.begin(); worker != workers.end(); worker++)
+            worker->join();
+        sc_stop();
+    }
+};
+#endif
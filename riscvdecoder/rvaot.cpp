@@ -0,0 +1,305 @@
+// Ahead-of-time translator: emits a C++ translation unit with one function
+// per basic block of an ELF's executable sections, to be linked into the
+// simulator with -DRV_AOT (see rv_aot.h and "make aot").
+//   rvaot.elf [-o output.cpp] file.elf
+#include "elf_parser.h"
+#include "cfg.h"
+#include "disasm.h"
+#include "rv_core.h"
+#include "rv_aot.h"
+
+#define AOT_FN_FMT  "aot_%08x"
+
+static string aot_reg(uint32_t r)
+{
+    char buf[16];
+    if (r == 0)
+        return "0u";
+    snprintf(buf, sizeof(buf), "x[%u]", r);
+    return buf;
+}
+
+static string aot_hex(uint32_t v)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%08xu", v);
+    return buf;
+}
+
+// Appends the statements for instruction i of the graph, the k-th of its
+// block. flushed is how many of the block's instructions are already in
+// instret. Returns true if the emitted code always leaves the block.
+static bool aot_emit_insn(string &out, const ControlFlowGraph &cfg, uint32_t i, uint32_t k, uint32_t &flushed)
+{
+    uint32_t word = cfg.words[i];
+    uint32_t insn_pc = cfg.addrs[i];
+    uint32_t next = insn_pc + cfg.lengths[i];
+    int opcode_id = cfg.decoded.opcode_id[i];
+    uint32_t op = opcode_id < 0 ? (uint32_t)ENUM_INST_MAX : instr_defs[opcode_id].instruction_enum;
+    uint32_t rd_num = cfg.decoded.rd[i];
+    uint32_t rd = rd_num ? rd_num : CORE_SINK_REG;
+    uint32_t rs1 = cfg.decoded.rs1[i];
+    uint32_t rs2 = cfg.decoded.rs2[i];
+    uint32_t imm = RvCore::immediate(word);
+    string a = aot_reg(rs1), b = aot_reg(rs2), c_imm = aot_hex(imm);
+    string sa = "(int32_t)" + a, sb = "(int32_t)" + b;
+    uint32_t retired = k - flushed;     // before this instruction
+    char line[DISASM_MAX_LINE + 32];
+
+    size_t len = disasm_format(line, insn_pc, word, opcode_id);
+    line[len - 1] = '\0';
+    for (char *p = line; *p; p++)
+        if (*p == '\t')
+            *p = ' ';
+    out += "    // ";
+    out += line;
+    out += "\n";
+
+    string alu;
+    switch (op)
+    {
+    case ENUM_INST_ANDI:    alu = a + " & " + c_imm; break;
+    case ENUM_INST_ADDI:    alu = a + " + " + c_imm; break;
+    case ENUM_INST_SLTI:    alu = sa + " < (int32_t)" + c_imm; break;
+    case ENUM_INST_SLTIU:   alu = a + " < " + c_imm; break;
+    case ENUM_INST_ORI:     alu = a + " | " + c_imm; break;
+    case ENUM_INST_XORI:    alu = a + " ^ " + c_imm; break;
+    case ENUM_INST_SLLI:    alu = a + " << " + to_string(imm); break;
+    case ENUM_INST_SRLI:    alu = a + " >> " + to_string(imm); break;
+    case ENUM_INST_SRAI:    alu = "(uint32_t)(" + sa + " >> " + to_string(imm) + ")"; break;
+    case ENUM_INST_LUI:     alu = c_imm; break;
+    case ENUM_INST_AUIPC:   alu = aot_hex(insn_pc + imm); break;
+    case ENUM_INST_ADD:     alu = a + " + " + b; break;
+    case ENUM_INST_SUB:     alu = a + " - " + b; break;
+    case ENUM_INST_SLT:     alu = sa + " < " + sb; break;
+    case ENUM_INST_SLTU:    alu = a + " < " + b; break;
+    case ENUM_INST_XOR:     alu = a + " ^ " + b; break;
+    case ENUM_INST_OR:      alu = a + " | " + b; break;
+    case ENUM_INST_AND:     alu = a + " & " + b; break;
+    case ENUM_INST_SLL:     alu = a + " << (" + b + " & 31)"; break;
+    case ENUM_INST_SRL:     alu = a + " >> (" + b + " & 31)"; break;
+    case ENUM_INST_SRA:     alu = "(uint32_t)(" + sa + " >> (" + b + " & 31))"; break;
+    case ENUM_INST_MUL:     alu = a + " * " + b; break;
+    case ENUM_INST_MULH:    alu = "(uint32_t)(((int64_t)" + sa + " * (int64_t)" + sb + ") >> 32)"; break;
+    case ENUM_INST_MULHSU:  alu = "(uint32_t)(((int64_t)" + sa + " * (int64_t)(uint64_t)" + b + ") >> 32)"; break;
+    case ENUM_INST_MULHU:   alu = "(uint32_t)(((uint64_t)" + a + " * (uint64_t)" + b + ") >> 32)"; break;
+    case ENUM_INST_DIV:     alu = "aot_div(" + a + ", " + b + ")"; break;
+    case ENUM_INST_DIVU:    alu = "(" + b + " ? " + a + " / " + b + " : 0xffffffffu)"; break;
+    case ENUM_INST_REM:     alu = "aot_rem(" + a + ", " + b + ")"; break;
+    case ENUM_INST_REMU:    alu = "(" + b + " ? " + a + " % " + b + " : " + a + ")"; break;
+    default:
+        break;
+    }
+    if (!alu.empty())
+    {
+        // writes to x0 have no effect
+        if (rd_num)
+            out += "    x[" + to_string(rd) + "] = " + alu + ";\n";
+        return false;
+    }
+
+    char buf[256];
+    string cond;
+    const char *load_type = NULL, *load_cast = "uint32_t", *store_type = NULL, *amo = NULL;
+    const char *csr_expr = NULL;
+    bool csr_imm = false;
+    switch (op)
+    {
+    case ENUM_INST_JAL:
+        if (rd_num)
+            out += "    x[" + to_string(rd) + "] = " + aot_hex(next) + ";\n";
+        snprintf(buf, sizeof(buf), "    AOT_END(%u, 0x%08xu);\n", retired + 1, insn_pc + imm);
+        out += buf;
+        return true;
+    case ENUM_INST_JALR:
+        // target first, rd may be rs1
+        out += "    {\n        uint32_t target = (" + a + " + " + c_imm + ") & ~1u;\n";
+        if (rd_num)
+            out += "        x[" + to_string(rd) + "] = " + aot_hex(next) + ";\n";
+        out += "        AOT_END(" + to_string(retired + 1) + ", target);\n    }\n";
+        return true;
+    case ENUM_INST_BEQ:     cond = a + " == " + b; break;
+    case ENUM_INST_BNE:     cond = a + " != " + b; break;
+    case ENUM_INST_BLT:     cond = sa + " < " + sb; break;
+    case ENUM_INST_BGE:     cond = sa + " >= " + sb; break;
+    case ENUM_INST_BLTU:    cond = a + " < " + b; break;
+    case ENUM_INST_BGEU:    cond = a + " >= " + b; break;
+
+    case ENUM_INST_LB:      load_type = "int8_t"; load_cast = "int32_t"; break;
+    case ENUM_INST_LH:      load_type = "int16_t"; load_cast = "int32_t"; break;
+    case ENUM_INST_LW:      load_type = "uint32_t"; break;
+    case ENUM_INST_LBU:     load_type = "uint8_t"; break;
+    case ENUM_INST_LHU:     load_type = "uint16_t"; break;
+    case ENUM_INST_SB:      store_type = "uint8_t"; break;
+    case ENUM_INST_SH:      store_type = "uint16_t"; break;
+    case ENUM_INST_SW:      store_type = "uint32_t"; break;
+
+    case ENUM_INST_ECALL:
+        snprintf(buf, sizeof(buf), "    AOT_TRAP(%u, MCAUSE_ECALL_U + c->priv, 0, 0x%08xu);\n", retired, insn_pc);
+        out += buf;
+        return true;
+    case ENUM_INST_EBREAK:
+        snprintf(buf, sizeof(buf), "    AOT_TRAP(%u, MCAUSE_BREAKPOINT, 0x%08xu, 0x%08xu);\n", retired, insn_pc, insn_pc);
+        out += buf;
+        return true;
+    case ENUM_INST_MRET:
+    case ENUM_INST_SRET:
+        snprintf(buf, sizeof(buf), "    c->instret += %u;\n    c->trap_return(%s);\n    return;\n",
+                 retired + 1, op == ENUM_INST_MRET ? "true" : "false");
+        out += buf;
+        return true;
+
+    case ENUM_INST_CSRRW:   csr_expr = "src"; break;
+    case ENUM_INST_CSRRS:   csr_expr = "old | src"; break;
+    case ENUM_INST_CSRRC:   csr_expr = "old & ~src"; break;
+    case ENUM_INST_CSRRWI:  csr_expr = "src"; csr_imm = true; break;
+    case ENUM_INST_CSRRSI:  csr_expr = "old | src"; csr_imm = true; break;
+    case ENUM_INST_CSRRCI:  csr_expr = "old & ~src"; csr_imm = true; break;
+
+    // translated code writes memory directly, with nothing to drain, and
+    // no interrupt source exists to wake wfi: both retire as nops
+    case ENUM_INST_FENCE:
+    case ENUM_INST_WFI:
+        return false;
+    case ENUM_INST_SFENCE:
+        out += "    c->tlb_flush();\n";
+        return false;
+    case ENUM_INST_IFENCE:
+        // translated code is never stale, only the interpreter's blocks are
+        out += "    c->flush_blocks();\n";
+        return false;
+
+    case ENUM_INST_AMOLR_W:
+        snprintf(buf, sizeof(buf), "    AOT_LR(%u, %u, 0x%08xu, %u)\n", rd, rs1, insn_pc, retired);
+        out += buf;
+        return false;
+    case ENUM_INST_AMOSC_W:
+        snprintf(buf, sizeof(buf), "    AOT_SC(%u, %u, %u, 0x%08xu, %u)\n", rd, rs1, rs2, insn_pc, retired);
+        out += buf;
+        return false;
+    case ENUM_INST_AMOSWAP_W:   amo = "src"; break;
+    case ENUM_INST_AMOADD_W:    amo = "old + src"; break;
+    case ENUM_INST_AMOAND_W:    amo = "old & src"; break;
+    case ENUM_INST_AMOOR_W:     amo = "old | src"; break;
+    case ENUM_INST_AMOXOR_W:    amo = "old ^ src"; break;
+    case ENUM_INST_AMOMAX_W:    amo = "(int32_t)old > (int32_t)src ? old : src"; break;
+    case ENUM_INST_AMOMIN_W:    amo = "(int32_t)old < (int32_t)src ? old : src"; break;
+    case ENUM_INST_AMOMAXU_W:   amo = "old > src ? old : src"; break;
+    case ENUM_INST_AMOMINU_W:   amo = "old < src ? old : src"; break;
+
+    default:
+        // unknown encodings and lwu, which RV32 does not have
+        snprintf(buf, sizeof(buf), "    AOT_TRAP(%u, MCAUSE_ILLEGAL_INSTRUCTION, 0x%08xu, 0x%08xu);\n", retired, word, insn_pc);
+        out += buf;
+        return true;
+    }
+
+    if (!cond.empty())
+    {
+        snprintf(buf, sizeof(buf), " ? 0x%08xu : 0x%08xu);\n", insn_pc + imm, next);
+        out += "    AOT_END(" + to_string(retired + 1) + ", " + cond + buf;
+        return true;
+    }
+    if (load_type)
+    {
+        snprintf(buf, sizeof(buf), "    AOT_LOAD(%s, %s, %u, %s + %s, 0x%08xu, %u)\n",
+                 load_type, load_cast, rd, a.c_str(), c_imm.c_str(), insn_pc, retired);
+        out += buf;
+    }
+    else if (store_type)
+    {
+        snprintf(buf, sizeof(buf), "    AOT_STORE(%s, %u, %s + %s, 0x%08xu, %u)\n",
+                 store_type, rs2, a.c_str(), c_imm.c_str(), insn_pc, retired);
+        out += buf;
+    }
+    else if (amo)
+    {
+        snprintf(buf, sizeof(buf), "    AOT_AMO(%u, %u, %u, %s, 0x%08xu, %u)\n", rd, rs1, rs2, amo, insn_pc, retired);
+        out += buf;
+    }
+    else if (csr_expr)
+    {
+        // csrrs/csrrc with x0 (or a zero uimm) only read
+        bool writes = op == ENUM_INST_CSRRW || op == ENUM_INST_CSRRWI || rs1 != 0;
+        snprintf(buf, sizeof(buf), "    AOT_CSR(%u, 0x%03x, %s, %d, %s, %u)\n", rd, imm,
+                 csr_imm ? to_string(rs1).c_str() : a.c_str(), writes, csr_expr, retired);
+        out += buf;
+        flushed = k;
+        // CSR_SIM_CTRL_EXIT halts the core right after this instruction
+        if (writes && imm == CSR_SIM_CTRL)
+            out += "    if (c->halted)\n        AOT_END(1, " + aot_hex(next) + ");\n";
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *out_file = NULL;
+    const char *elf_file = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out_file = argv[++i];
+        else
+            elf_file = argv[i];
+    }
+    if (elf_file == NULL)
+    {
+        cerr << "usage: " << argv[0] << " [-o output.cpp] file.elf" << endl;
+        return 1;
+    }
+
+    uint8_t *mem = NULL;
+    uint32_t total_mem_size = 0;
+    uint32_t start_addr = 0;
+    ELFParser elf_parser(elf_file, &start_addr, &mem, &total_mem_size, false);
+    if (mem == NULL)
+    {
+        cerr << "Unable to load " << elf_file << endl;
+        return 1;
+    }
+    const vector<region> &regions = elf_parser.regmgr.get_regions();
+    ControlFlowGraph cfg;
+    cfg.build(mem, regions);
+
+    FILE *out = out_file ? fopen(out_file, "w") : stdout;
+    if (out == NULL)
+    {
+        cerr << "Unable to open " << out_file << endl;
+        delete[] mem;
+        return 1;
+    }
+    fprintf(out, "// Generated by rvaot from %s, do not edit.\n", elf_file);
+    fprintf(out, "#include \"rv_aot.h\"\n\n");
+    fprintf(out, "const uint64_t aot_image_hash = 0x%016llxULL;\n", (unsigned long long)aot_text_hash(mem, regions));
+    fprintf(out, "const uint32_t aot_block_count = %zu;\n", cfg.blocks.size());
+
+    string body;
+    for (auto block = cfg.blocks.begin(); block != cfg.blocks.end(); block++)
+    {
+        body.clear();
+        uint32_t flushed = 0;
+        bool left = false;
+        for (uint32_t k = 0; k < block->insn_count && !left; k++)
+            left = aot_emit_insn(body, cfg, block->first_insn + k, k, flushed);
+        if (!left)
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "    AOT_END(%u, 0x%08xu);\n", block->insn_count - flushed, block->end_addr);
+            body += buf;
+        }
+        fprintf(out, "\nstatic void " AOT_FN_FMT "(AotCore *c)\n{\n    uint32_t *x = c->gpr;\n", block->start_addr);
+        fwrite(body.data(), 1, body.size(), out);
+        fprintf(out, "}\n");
+    }
+
+    fprintf(out, "\naot_block_fn aot_lookup(uint32_t pc)\n{\n    switch (pc)\n    {\n");
+    for (auto block = cfg.blocks.begin(); block != cfg.blocks.end(); block++)
+        fprintf(out, "    case 0x%08xu: return " AOT_FN_FMT ";\n", block->start_addr, block->start_addr);
+    fprintf(out, "    default: return NULL;\n    }\n}\n");
+    if (out != stdout)
+        fclose(out);
+    cerr << elf_file << ": " << cfg.blocks.size() << " blocks, " << cfg.addrs.size() << " instructions" << endl;
+    delete[] mem;
+    return 0;
+}
@@ -0,0 +1,269 @@
+// Batch driver: runs the simulator once per ELF in separate processes,
+// since SystemC elaborates only one sc_main per process. Up to -j runs
+// (host cores by default) are in flight at a time; every run's output
+// goes to its own log and one summary line per ELF to a CSV file.
+//   rvbatch.elf [-j workers] [-o summary.csv] [-logs dir] [-sim simulator]
+//               input... [-- simulator options]
+// An input is an ELF, a directory (every regular file in it, sorted), or
+// a text file listing one ELF path per line.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#define BATCH_DEFAULT_SIM       "./riscvdecoder.elf"
+#define BATCH_DEFAULT_SUMMARY   "batch_summary.csv"
+#define BATCH_DEFAULT_LOGS      "batch_logs"
+
+typedef struct {
+    string elf;
+    string log;
+    pid_t pid;
+    chrono::steady_clock::time_point start;
+    int status;             // exit code, -1 if it did not exit normally
+    int signal;             // terminating signal, 0 if none
+    double wall_seconds;
+    double cpu_seconds;     // user + system time of the run
+    uint64_t instructions;  // from the "... instructions" line of the log, 0 if none
+}batch_job;
+
+static bool is_elf(const string &path)
+{
+    char magic[4];
+    FILE *probe = fopen(path.c_str(), "rb");
+    if (probe == NULL)
+        return false;
+    bool elf = fread(magic, 1, 4, probe) == 4 && !memcmp(magic, "\x7f" "ELF", 4);
+    fclose(probe);
+    return elf;
+}
+
+static void add_input(const string &path, vector<string> &elfs)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        cerr << "Skipping " << path << ": not found" << endl;
+        return;
+    }
+    if (S_ISDIR(st.st_mode))
+    {
+        vector<string> entries;
+        DIR *dir = opendir(path.c_str());
+        struct dirent *entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL)
+        {
+            string file = path + "/" + entry->d_name;
+            if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode) && is_elf(file))
+                entries.push_back(file);
+        }
+        if (dir != NULL)
+            closedir(dir);
+        sort(entries.begin(), entries.end());
+        elfs.insert(elfs.end(), entries.begin(), entries.end());
+    }
+    else if (is_elf(path))
+        elfs.push_back(path);
+    else
+    {
+        // list file: one path per line, # comments
+        ifstream list(path.c_str());
+        string line;
+        while (getline(list, line))
+        {
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#')
+                elfs.push_back(line);
+        }
+    }
+}
+
+// log file name: the ELF's path with separators flattened, unique per input
+static string log_name(const string &logs_dir, const string &elf, size_t index)
+{
+    string name = elf;
+    replace(name.begin(), name.end(), '/', '_');
+    return logs_dir + "/" + to_string(index) + "_" + name + ".log";
+}
+
+// CSV field per RFC 4180: quoted, embedded quotes doubled, so commas and
+// newlines in paths stay inside the field
+static string csv_field(const string &text)
+{
+    string field = "\"";
+    for (auto c = text.begin(); c != text.end(); c++)
+    {
+        if (*c == '"')
+            field += '"';
+        field += *c;
+    }
+    return field + "\"";
+}
+
+static pid_t start_job(batch_job &job, const char *sim, const vector<string> &sim_args)
+{
+    vector<char *> args;
+    args.push_back((char *)sim);
+    for (auto arg = sim_args.begin(); arg != sim_args.end(); arg++)
+        args.push_back((char *)arg->c_str());
+    args.push_back((char *)job.elf.c_str());
+    args.push_back(NULL);
+    job.start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int fd = open(job.log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(sim, args.data());
+        fprintf(stderr, "Unable to run %s\n", sim);
+        _exit(127);
+    }
+    return pid;
+}
+
+// last "<n> instructions" in the log
+static uint64_t log_instructions(const string &log)
+{
+    ifstream in(log.c_str());
+    string line;
+    uint64_t instructions = 0;
+    while (getline(in, line))
+    {
+        size_t pos = line.find(" instructions");
+        if (pos == string::npos)
+            continue;
+        size_t start = line.find_last_not_of("0123456789", pos - 1);
+        start = start == string::npos ? 0 : start + 1;
+        if (start < pos)
+            instructions = strtoull(line.substr(start, pos - start).c_str(), NULL, 10);
+    }
+    return instructions;
+}
+
+static void finish_job(batch_job &job, int status, const struct rusage &usage)
+{
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - job.start;
+    job.wall_seconds = elapsed.count();
+    job.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    job.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    job.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    job.instructions = log_instructions(job.log);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned workers = thread::hardware_concurrency();
+    const char *summary_file = BATCH_DEFAULT_SUMMARY;
+    const char *logs_dir = BATCH_DEFAULT_LOGS;
+    const char *sim = BATCH_DEFAULT_SIM;
+    vector<string> elfs;
+    vector<string> sim_args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            workers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            summary_file = argv[++i];
+        else if (!strcmp(argv[i], "-logs") && i + 1 < argc)
+            logs_dir = argv[++i];
+        else if (!strcmp(argv[i], "-sim") && i + 1 < argc)
+            sim = argv[++i];
+        else if (!strcmp(argv[i], "--"))
+        {
+            sim_args.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        else
+            add_input(argv[i], elfs);
+    }
+    if (elfs.empty())
+    {
+        cerr << "usage: " << argv[0] << " [-j workers] [-o summary.csv] [-logs dir] [-sim simulator] input... [-- simulator options]" << endl;
+        return 1;
+    }
+    if (workers == 0)
+        workers = 1;
+    mkdir(logs_dir, 0755);
+
+    vector<batch_job> jobs(elfs.size());
+    for (size_t i = 0; i < elfs.size(); i++)
+        jobs[i] = {elfs[i], log_name(logs_dir, elfs[i], i), 0, {}, -1, 0, 0, 0, 0};
+
+    // keep up to workers runs going, collecting whichever ends first
+    auto batch_start = chrono::steady_clock::now();
+    map<pid_t, size_t> running;
+    size_t next = 0, failed = 0;
+    while (next < jobs.size() || !running.empty())
+    {
+        while (next < jobs.size() && running.size() < workers)
+        {
+            pid_t pid = start_job(jobs[next], sim, sim_args);
+            if (pid < 0)
+            {
+                cerr << "fork failed for " << jobs[next].elf << endl;
+                jobs[next].status = 127;
+                failed++;
+            }
+            else
+                running[pid] = next;
+            jobs[next].pid = pid;
+            next++;
+        }
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0)
+            break;
+        auto job = running.find(pid);
+        if (job == running.end())
+            continue;
+        batch_job &done = jobs[job->second];
+        finish_job(done, status, usage);
+        running.erase(job);
+        if (done.status != 0)
+            failed++;
+        cerr << (done.status == 0 ? "pass " : "FAIL ") << done.elf << ": " << done.instructions << " instructions, "
+             << done.wall_seconds << " s" << (done.signal ? ", signal " + to_string(done.signal) : "") << endl;
+    }
+    chrono::duration<double> batch_elapsed = chrono::steady_clock::now() - batch_start;
+
+    FILE *out = fopen(summary_file, "w");
+    if (out == NULL)
+    {
+        cerr << "Unable to open " << summary_file << endl;
+        return 1;
+    }
+    fprintf(out, "elf,status,signal,instructions,wall_s,cpu_s,mips,log\n");
+    for (auto job = jobs.begin(); job != jobs.end(); job++)
+        fprintf(out, "%s,%d,%d,%llu,%.6f,%.6f,%.3f,%s\n", csv_field(job->elf).c_str(), job->status, job->signal,
+                (unsigned long long)job->instructions, job->wall_seconds, job->cpu_seconds,
+                job->wall_seconds > 0 ? job->instructions / job->wall_seconds / 1e6 : 0.0,
+                csv_field(job->log).c_str());
+    fclose(out);
+    cerr << jobs.size() << " runs, " << failed << " failed, " << batch_elapsed.count() << " s on " << workers
+         << " workers; summary in " << summary_file << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+#include "rvc.h"
+
+// 32-bit instruction builders; operands are ORed onto the INST_* match values
+#define RVC_RTYPE(inst, rd, rs1, rs2)   ((inst) | ((rd) << OPCODE_RD_SHIFT) | ((rs1) << OPCODE_RS1_SHIFT) | \
+                                         ((rs2) << OPCODE_RS2_SHIFT))
+#define RVC_ITYPE(inst, rd, rs1, imm)   ((inst) | ((rd) << OPCODE_RD_SHIFT) | ((rs1) << OPCODE_RS1_SHIFT) | \
+                                         (((uint32_t)(imm) & 0xfff) << OPCODE_TYPEI_IMM_SHIFT))
+#define RVC_STYPE(inst, rs1, rs2, imm)  ((inst) | ((rs1) << OPCODE_RS1_SHIFT) | ((rs2) << OPCODE_RS2_SHIFT) | \
+                                         (OPCODE_SHIFT_MASK((uint32_t)(imm), 0, 5) << 7) | (OPCODE_SHIFT_MASK((uint32_t)(imm), 5, 7) << 25))
+#define RVC_BTYPE(inst, rs1, rs2, imm)  ((inst) | ((rs1) << OPCODE_RS1_SHIFT) | ((rs2) << OPCODE_RS2_SHIFT) | \
+                                         (OPCODE_SHIFT_MASK((uint32_t)(imm), 11, 1) << 7) | (OPCODE_SHIFT_MASK((uint32_t)(imm), 1, 4) << 8) | \
+                                         (OPCODE_SHIFT_MASK((uint32_t)(imm), 5, 6) << 25) | (OPCODE_SHIFT_MASK((uint32_t)(imm), 12, 1) << 31))
+#define RVC_JTYPE(inst, rd, imm)        ((inst) | ((rd) << OPCODE_RD_SHIFT) | \
+                                         (OPCODE_SHIFT_MASK((uint32_t)(imm), 12, 8) << 12) | (OPCODE_SHIFT_MASK((uint32_t)(imm), 11, 1) << 20) | \
+                                         (OPCODE_SHIFT_MASK((uint32_t)(imm), 1, 10) << 21) | (OPCODE_SHIFT_MASK((uint32_t)(imm), 20, 1) << 31))
+
+// compressed register fields; the primed 3-bit forms name x8-x15
+#define RVC_RD_P(x)     ((((x) & OPCODE_C0_RD_MASK) >> OPCODE_C0_RD_SHIFT) + 8)
+#define RVC_RS1_P(x)    ((((x) & OPCODE_C0_RS1_MASK) >> OPCODE_C0_RS1_SHIFT) + 8)
+#define RVC_RS2_P(x)    ((((x) & OPCODE_C0_RS2_MASK) >> OPCODE_C0_RS2_SHIFT) + 8)
+#define RVC_RD(x)       (((x) & OPCODE_C12_RD_MASK) >> OPCODE_C12_RD_SHIFT)
+#define RVC_RS2(x)      (((x) & OPCODE_C12_RS2_MASK) >> OPCODE_C12_RS2_SHIFT)
+
+#define RVC_BIT(x, b)   OPCODE_SHIFT_MASK(x, b, 1)
+
+uint32_t rvc_expand(uint16_t compressed)
+{
+    uint32_t x = compressed;
+    uint32_t funct3 = OPCODE_SHIFT_MASK(x, 13, 3);
+    uint32_t rd = RVC_RD(x);
+    uint32_t rs2 = RVC_RS2(x);
+    int32_t imm = OPCODE_C_ITYPE_IMM(x);    // imm[5] = bit 12, imm[4:0] = bits 6-2, sign extended
+    uint32_t shamt = OPCODE_SHIFT_MASK(x, 2, 5);
+
+    if (x == 0)
+        return 0;
+    switch (((x & 0x3) << 3) | funct3)
+    {
+    //----------------------------------------------------------------
+    // Quadrant 0
+    //----------------------------------------------------------------
+    case 0x00: // c.addi4spn -> addi rd', sp, nzuimm
+    {
+        uint32_t nzuimm = (OPCODE_SHIFT_MASK(x, 6, 1) << 2) | (OPCODE_SHIFT_MASK(x, 5, 1) << 3) |
+                          (OPCODE_SHIFT_MASK(x, 11, 2) << 4) | (OPCODE_SHIFT_MASK(x, 7, 4) << 6);
+        if (nzuimm == 0)
+            return 0;
+        return RVC_ITYPE(INST_ADDI, RVC_RD_P(x), GPR_SP, nzuimm);
+    }
+    case 0x02: // c.lw -> lw rd', uimm(rs1')
+    case 0x06: // c.sw -> sw rs2', uimm(rs1')
+    {
+        uint32_t uimm = (OPCODE_SHIFT_MASK(x, 6, 1) << 2) | (OPCODE_SHIFT_MASK(x, 10, 3) << 3) |
+                        (OPCODE_SHIFT_MASK(x, 5, 1) << 6);
+        if (funct3 == 2)
+            return RVC_ITYPE(INST_LW, RVC_RD_P(x), RVC_RS1_P(x), uimm);
+        return RVC_STYPE(INST_SW, RVC_RS1_P(x), RVC_RS2_P(x), uimm);
+    }
+
+    //----------------------------------------------------------------
+    // Quadrant 1
+    //----------------------------------------------------------------
+    case 0x08: // c.addi / c.nop -> addi rd, rd, imm
+        return RVC_ITYPE(INST_ADDI, rd, rd, imm);
+    case 0x09: // c.jal -> jal ra, offset
+    case 0x0d: // c.j   -> jal zero, offset
+    {
+        int32_t offset = (OPCODE_SHIFT_MASK(x, 3, 3) << 1) | (RVC_BIT(x, 11) << 4) | (RVC_BIT(x, 2) << 5) |
+                         (RVC_BIT(x, 7) << 6) | (RVC_BIT(x, 6) << 7) | (OPCODE_SHIFT_MASK(x, 9, 2) << 8) |
+                         (RVC_BIT(x, 8) << 10) | (OPCODE_C_IMM_SIGN(x) << 11);
+        return RVC_JTYPE(INST_JAL, funct3 == 1 ? GPR_RA : GPR_ZERO, offset);
+    }
+    case 0x0a: // c.li -> addi rd, zero, imm
+        return RVC_ITYPE(INST_ADDI, rd, GPR_ZERO, imm);
+    case 0x0b:
+        if (rd == GPR_SP) // c.addi16sp -> addi sp, sp, nzimm
+        {
+            int32_t nzimm = (RVC_BIT(x, 6) << 4) | (RVC_BIT(x, 2) << 5) | (RVC_BIT(x, 5) << 6) |
+                            (OPCODE_SHIFT_MASK(x, 3, 2) << 7) | (OPCODE_C_IMM_SIGN(x) << 9);
+            if (nzimm == 0)
+                return 0;
+            return RVC_ITYPE(INST_ADDI, GPR_SP, GPR_SP, nzimm);
+        }
+        // c.lui -> lui rd, nzimm
+        if (rd == GPR_ZERO || imm == 0)
+            return 0;
+        return INST_LUI | (rd << OPCODE_RD_SHIFT) | (((uint32_t)imm << OPCODE_TYPEU_IMM_SHIFT) & OPCODE_TYPEU_IMM_MASK);
+    case 0x0c:
+    {
+        uint32_t rdp = RVC_RS1_P(x);
+        switch (OPCODE_SHIFT_MASK(x, 10, 2))
+        {
+        case 0: // c.srli
+            return RVC_BIT(x, 12) ? 0 : RVC_ITYPE(INST_SRLI, rdp, rdp, shamt);
+        case 1: // c.srai
+            return RVC_BIT(x, 12) ? 0 : (INST_SRAI | (rdp << OPCODE_RD_SHIFT) | (rdp << OPCODE_RS1_SHIFT) |
+                                         (shamt << OPCODE_SHAMT_SHIFT));
+        case 2: // c.andi
+            return RVC_ITYPE(INST_ANDI, rdp, rdp, imm);
+        default: // c.sub, c.xor, c.or, c.and (the RV64 word forms are reserved here)
+        {
+            static const uint32_t alu_ops[4] = {INST_SUB, INST_XOR, INST_OR, INST_AND};
+            if (RVC_BIT(x, 12))
+                return 0;
+            return RVC_RTYPE(alu_ops[OPCODE_SHIFT_MASK(x, 5, 2)], rdp, rdp, RVC_RS2_P(x));
+        }
+        }
+    }
+    case 0x0e: // c.beqz -> beq rs1', zero, offset
+    case 0x0f: // c.bnez -> bne rs1', zero, offset
+    {
+        int32_t offset = (OPCODE_SHIFT_MASK(x, 3, 2) << 1) | (OPCODE_SHIFT_MASK(x, 10, 2) << 3) |
+                         (RVC_BIT(x, 2) << 5) | (OPCODE_SHIFT_MASK(x, 5, 2) << 6) | (OPCODE_C_IMM_SIGN(x) << 8);
+        return RVC_BTYPE(funct3 == 6 ? INST_BEQ : INST_BNE, RVC_RS1_P(x), GPR_ZERO, offset);
+    }
+
+    //----------------------------------------------------------------
+    // Quadrant 2
+    //----------------------------------------------------------------
+    case 0x10: // c.slli -> slli rd, rd, shamt
+        return RVC_BIT(x, 12) ? 0 : RVC_ITYPE(INST_SLLI, rd, rd, shamt);
+    case 0x12: // c.lwsp -> lw rd, uimm(sp)
+    {
+        uint32_t uimm = (OPCODE_SHIFT_MASK(x, 4, 3) << 2) | (RVC_BIT(x, 12) << 5) | (OPCODE_SHIFT_MASK(x, 2, 2) << 6);
+        if (rd == GPR_ZERO)
+            return 0;
+        return RVC_ITYPE(INST_LW, rd, GPR_SP, uimm);
+    }
+    case 0x14:
+        if (!RVC_BIT(x, 12))
+        {
+            if (rs2 == GPR_ZERO) // c.jr -> jalr zero, 0(rs1)
+                return rd == GPR_ZERO ? 0 : RVC_ITYPE(INST_JALR, GPR_ZERO, rd, 0);
+            return RVC_RTYPE(INST_ADD, rd, GPR_ZERO, rs2); // c.mv -> add rd, zero, rs2
+        }
+        if (rs2 == GPR_ZERO)
+        {
+            if (rd == GPR_ZERO) // c.ebreak
+                return INST_EBREAK;
+            return RVC_ITYPE(INST_JALR, GPR_RA, rd, 0); // c.jalr -> jalr ra, 0(rs1)
+        }
+        return RVC_RTYPE(INST_ADD, rd, rd, rs2); // c.add -> add rd, rd, rs2
+    case 0x16: // c.swsp -> sw rs2, uimm(sp)
+    {
+        uint32_t uimm = (OPCODE_SHIFT_MASK(x, 9, 4) << 2) | (OPCODE_SHIFT_MASK(x, 7, 2) << 6);
+        return RVC_STYPE(INST_SW, GPR_SP, rs2, uimm);
+    }
+    default: // c.fld, c.flw, c.fsd, c.fsw and their sp forms: no F/D support
+        return 0;
+    }
+}
+
+RvcExpander::RvcExpander()
+{
+    hits = 0;
+    misses = 0;
+    for (int i = 0; i < RVC_CACHE_SIZE; i++)
+    {
+        tags[i] = RVC_CACHE_INVALID_TAG;
+        expanded[i] = 0;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __RVC__
+#define __RVC__
+#include <stdint.h>
+#include "isa.h"
+
+//--------------------------------------------------------------------
+// RV32C support: length detection and expansion of 16-bit encodings
+// to their 32-bit equivalents.
+//--------------------------------------------------------------------
+#define RVC_IS_COMPRESSED(x)    (((x) & 0x3) != 0x3)
+#define RVC_INST_LEN(x)         (RVC_IS_COMPRESSED(x) ? 2 : 4)
+
+#define RVC_CACHE_BITS          10
+#define RVC_CACHE_SIZE          (1 << RVC_CACHE_BITS)
+#define RVC_CACHE_INDEX(x)      (((x) ^ ((x) >> RVC_CACHE_BITS)) & (RVC_CACHE_SIZE - 1))
+#define RVC_CACHE_INVALID_TAG   0xffff  // low bits 11: never a compressed encoding
+
+// Returns the 32-bit instruction for a compressed encoding, or 0 if the
+// encoding is reserved or needs an extension the decoder lacks (F/D).
+uint32_t rvc_expand(uint16_t compressed);
+
+// Direct-mapped cache of expansions keyed on the 16-bit encoding
+class RvcExpander
+{
+protected:
+    uint16_t tags[RVC_CACHE_SIZE];
+    uint32_t expanded[RVC_CACHE_SIZE];
+public:
+    uint64_t hits;
+    uint64_t misses;
+    RvcExpander();
+    uint32_t expand(uint16_t compressed)
+    {
+        uint32_t index = RVC_CACHE_INDEX(compressed);
+        if (tags[index] == compressed)
+        {
+            hits++;
+            return expanded[index];
+        }
+        misses++;
+        tags[index] = compressed;
+        expanded[index] = rvc_expand(compressed);
+        return expanded[index];
+    }
+};
+#endif
@@ -0,0 +1,319 @@
+// Regression checks for the parts of the simulator that run without
+// SystemC; prints each check and exits 1 if any failed.
+//   make check
+#include "guest_memory.h"
+#include "elf_parser.h"
+#include "rv_core.h"
+#include "image_cache.h"
+#include <iostream>
+#include <string.h>
+#include <elf.h>
+
+static bool check_failed;
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond))                                                            \
+        {                                                                       \
+            cout << "  " << __FILE__ << ":" << __LINE__ << ": " << #cond << endl; \
+            check_failed = true;                                                \
+        }                                                                       \
+    } while (0)
+
+// ranges starting and ending inside a page back the whole page
+static void check_unaligned_ranges()
+{
+    GuestMemory mem;
+    uint8_t data[0x100], back[0x100];
+    for (int i = 0; i < 0x100; i++)
+        data[i] = i;
+    mem.add_range(0x80000100, 0x100);
+    CHECK(mem.page(0x80000100) != NULL);
+    CHECK(mem.write(0x80000100, data, sizeof(data)));
+    CHECK(mem.read(0x80000100, back, sizeof(back)) && !memcmp(data, back, sizeof(data)));
+    // bytes of the page outside the range are still refused
+    CHECK(!mem.write(0x80000000, data, 1));
+    CHECK(!mem.write(0x800001ff, data, 2));
+
+    // starts mid-page, ends mid-page two pages on
+    mem.add_range(0x80001f80, 0x1100);
+    uint8_t span[0x1100];
+    for (size_t i = 0; i < sizeof(span); i++)
+        span[i] = i * 7;
+    CHECK(mem.write(0x80001f80, span, sizeof(span)));
+    uint8_t span_back[0x1100];
+    CHECK(mem.read(0x80001f80, span_back, sizeof(span_back)) && !memcmp(span, span_back, sizeof(span)));
+    CHECK(mem.page(0x80003000) != NULL);
+    CHECK(mem.page(0x80004000) == NULL);
+    CHECK(!mem.write(0x80003080, span, 1));
+
+    // a page attached from elsewhere may hold a range only in part
+    GuestMemory attached;
+    static uint8_t host_page[GUEST_PAGE_SIZE];
+    attached.add_range(0x10f00, 0x80);
+    CHECK(attached.attach_page(0x10000, host_page));
+    CHECK(attached.write(0x10f00, data, 0x80) && host_page[0xf7f] == 0x7f);
+    CHECK(!attached.attach_page(0x11000, host_page));
+}
+
+#define CHECK_TEXT_ADDR     0x110d4     // where a default lld link puts .text
+#define CHECK_DATA_ADDR     0x120f8
+#define CHECK_BSS_ADDR      0x12100
+#define CHECK_EXIT_CODE     42
+
+static uint32_t enc_i(uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1, int32_t imm)
+{
+    return (imm & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static uint32_t enc_s(uint32_t opcode, uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    return ((imm >> 5) & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | (imm & 0x1f) << 7 | opcode;
+}
+
+// Writes an executable laid out the way a linker does without page
+// alignment: .text and .data each start mid-page at an address that
+// agrees with its file offset within the page, .bss follows .data in the
+// same PT_LOAD. The program adds the .data word to the zeroed .bss word,
+// stores the sum to .bss and exits with it through CSR_SIM_CTRL.
+static bool write_unaligned_elf(const char *path)
+{
+    const uint32_t a0 = 10, a1 = 11, a2 = 12;
+    const uint32_t text[] = {
+        ((CHECK_DATA_ADDR - CHECK_TEXT_ADDR) & ~0xfffu) | a1 << 7 | 0x17,        // auipc a1, %hi(val)
+        enc_i(0x13, a1, 0, a1, (CHECK_DATA_ADDR - CHECK_TEXT_ADDR) & 0xfff),    // addi a1, a1, %lo(val)
+        enc_i(0x03, a0, 2, a1, 0),                                              // lw a0, 0(a1)
+        enc_i(0x03, a2, 2, a1, CHECK_BSS_ADDR - CHECK_DATA_ADDR),               // lw a2, bss(a1)
+        a2 << 20 | a0 << 15 | a0 << 7 | 0x33,                                   // add a0, a0, a2
+        enc_s(0x23, 2, a1, a0, CHECK_BSS_ADDR - CHECK_DATA_ADDR),               // sw a0, bss(a1)
+        enc_i(0x73, 0, 1, a0, CSR_SIM_CTRL),                                    // csrw sim_ctrl, a0
+        0x6f,                                                                   // j .
+    };
+    const uint32_t data[] = {CHECK_EXIT_CODE, 0};
+    const char names[] = "\0.text\0.data\0.bss\0.shstrtab";
+    const uint32_t text_offset = CHECK_TEXT_ADDR & GUEST_PAGE_MASK;
+    const uint32_t data_offset = CHECK_DATA_ADDR & GUEST_PAGE_MASK;
+    const uint32_t names_offset = data_offset + sizeof(data);
+    const uint32_t shdr_offset = (names_offset + sizeof(names) + 3) & ~3u;
+
+    vector<uint8_t> file(shdr_offset + 5 * sizeof(Elf32_Shdr));
+    Elf32_Ehdr ehdr = {};
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_machine = EM_RISCV;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_entry = CHECK_TEXT_ADDR;
+    ehdr.e_phoff = sizeof(Elf32_Ehdr);
+    ehdr.e_shoff = shdr_offset;
+    ehdr.e_ehsize = sizeof(Elf32_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf32_Phdr);
+    ehdr.e_phnum = 2;
+    ehdr.e_shentsize = sizeof(Elf32_Shdr);
+    ehdr.e_shnum = 5;
+    ehdr.e_shstrndx = 4;
+    const Elf32_Phdr phdrs[2] = {
+        {PT_LOAD, text_offset, CHECK_TEXT_ADDR, CHECK_TEXT_ADDR, sizeof(text), sizeof(text), PF_R | PF_X, GUEST_PAGE_SIZE},
+        {PT_LOAD, data_offset, CHECK_DATA_ADDR, CHECK_DATA_ADDR, sizeof(data), CHECK_BSS_ADDR + 8 - CHECK_DATA_ADDR,
+         PF_R | PF_W, GUEST_PAGE_SIZE},
+    };
+    const Elf32_Shdr shdrs[5] = {
+        {},
+        {1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, CHECK_TEXT_ADDR, text_offset, sizeof(text), 0, 0, 4, 0},
+        {7, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, CHECK_DATA_ADDR, data_offset, sizeof(data), 0, 0, 4, 0},
+        {13, SHT_NOBITS, SHF_ALLOC | SHF_WRITE, CHECK_BSS_ADDR, data_offset + sizeof(data), 8, 0, 0, 4, 0},
+        {18, SHT_STRTAB, 0, 0, names_offset, sizeof(names), 0, 0, 1, 0},
+    };
+    memcpy(&file[0], &ehdr, sizeof(ehdr));
+    memcpy(&file[ehdr.e_phoff], phdrs, sizeof(phdrs));
+    memcpy(&file[text_offset], text, sizeof(text));
+    memcpy(&file[data_offset], data, sizeof(data));
+    memcpy(&file[names_offset], names, sizeof(names));
+    memcpy(&file[shdr_offset], shdrs, sizeof(shdrs));
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        return false;
+    bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+    return fclose(out) == 0 && ok;
+}
+
+// runs the program in mem from start_addr and checks it exits as it should
+static void check_unaligned_run(GuestMemory *mem, uint32_t start_addr)
+{
+    RvCore core;
+    core.map_memory(mem);
+    core.reset(start_addr);
+    core.run(1000);
+    CHECK(core.halted && core.halt_cause == CORE_HALT_EXIT);
+    CHECK(core.exit_code == CHECK_EXIT_CODE);
+    CHECK(core.instret == 7);
+    uint32_t bss = 0;
+    CHECK(mem->read(CHECK_BSS_ADDR, &bss, 4) && bss == CHECK_EXIT_CODE);
+}
+
+// a normally linked ELF, loaded into guest memory and run to completion
+static void check_unaligned_elf()
+{
+    char path[] = "/tmp/rvcheck_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    close(fd);
+    CHECK(write_unaligned_elf(path));
+    GuestMemory mem;
+    uint32_t start_addr = 0;
+    ELFParser elf_parser(path, &start_addr, &mem, false);
+    CHECK(start_addr == CHECK_TEXT_ADDR);
+    CHECK(elf_parser.regmgr.get_regions().size() == 3);
+    uint32_t word = 0;
+    CHECK(mem.read(CHECK_DATA_ADDR, &word, 4) && word == CHECK_EXIT_CODE);
+    check_unaligned_run(&mem, start_addr);
+    remove(path);
+}
+
+// the same ELF saved to an image cache with its predecoded blocks, then
+// restored into fresh memory and a fresh core
+static void check_unaligned_cache()
+{
+    char path[] = "/tmp/rvcheck_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    close(fd);
+    CHECK(write_unaligned_elf(path));
+    string cache_path = string(path) + IMAGE_CACHE_SUFFIX;
+    {
+        GuestMemory mem;
+        uint32_t start_addr = 0;
+        ELFParser elf_parser(path, &start_addr, &mem, false);
+        RvCore core;
+        core.map_memory(&mem);
+        core.predecode_text(elf_parser.regmgr.get_regions());
+        CHECK(ImageCache::save(cache_path, 1, start_addr, elf_parser.regmgr, &mem, &core));
+    }
+    ImageCache cache;
+    CHECK(cache.load(cache_path, 1));
+    if (cache.loaded())
+    {
+        RegionManager regmgr;
+        GuestMemory *mem = new GuestMemory;
+        uint32_t start_addr = 0;
+        cache.restore_image(regmgr, mem, &start_addr);
+        CHECK(start_addr == CHECK_TEXT_ADDR && regmgr.get_regions().size() == 3);
+        RvCore core;
+        core.map_memory(mem);
+        cache.restore_blocks(&core);
+        core.reset(start_addr);
+        core.run(1000);
+        CHECK(core.halted && core.exit_code == CHECK_EXIT_CODE && core.instret == 7);
+        delete mem;
+    }
+    // a page already present takes a copy instead of the mapping
+    ImageCache again;
+    CHECK(again.load(cache_path, 1));
+    if (again.loaded())
+    {
+        RegionManager regmgr;
+        GuestMemory mem;
+        uint32_t start_addr = 0;
+        mem.add_range(CHECK_DATA_ADDR, 4);
+        mem.write(CHECK_DATA_ADDR, "junk", 4);
+        again.restore_image(regmgr, &mem, &start_addr);
+        check_unaligned_run(&mem, start_addr);
+    }
+    remove(cache_path.c_str());
+    remove(path);
+}
+
+// drops the reservations of the other core on every store, as RvPlatform does
+class CheckHost : public RvCoreHost
+{
+public:
+    RvCore *cores[2];
+    void host_atomic(RvCore *core, uint32_t addr)
+    {
+        for (RvCore *other : cores)
+            if (other != core)
+                other->clear_reservation(addr);
+    }
+    void host_store(RvCore *core, uint32_t addr, uint32_t size)
+    {
+        for (RvCore *other : cores)
+            if (other != core)
+                other->clear_reservation(addr, size);
+    }
+};
+
+// runs core from pc until it halts on the zero word after its code
+static void run_from(RvCore &core, uint32_t pc)
+{
+    core.pc = pc;
+    core.halted = false;
+    core.run(100);
+}
+
+// lr.w on one core, a plain sw from the other, sc.w on the first: the sc
+// fails if the store hit the reserved word and succeeds otherwise
+static void check_store_clears_reservation()
+{
+    const uint32_t a0 = 10, a1 = 11, a2 = 12, a3 = 13, a4 = 14;
+    const uint32_t lr[] = {0x10000000u | a1 << 15 | 2 << 12 | a4 << 7 | 0x2f, 0};
+    const uint32_t sc[] = {0x18000000u | a2 << 20 | a1 << 15 | 2 << 12 | a3 << 7 | 0x2f, 0};
+    const uint32_t sw[] = {enc_s(0x23, 2, a1, a0, 0), 0};
+    GuestMemory mem;
+    mem.add_range(0x1000, 0x3000);
+    mem.write(0x1000, lr, sizeof(lr));
+    mem.write(0x1100, sc, sizeof(sc));
+    mem.write(0x1200, sw, sizeof(sw));
+    atomic<uint32_t> held_reservations(0);
+    CheckHost host;
+    RvCore first(0), second(1);
+    host.cores[0] = &first;
+    host.cores[1] = &second;
+    for (RvCore *core : host.cores)
+    {
+        core->map_memory(&mem);
+        core->reset(0x1000);
+        core->host = &host;
+        core->held_reservations = &held_reservations;
+    }
+    for (int hit = 0; hit < 2; hit++)
+    {
+        first.gpr[a1] = 0x2000;
+        run_from(first, 0x1000);
+        CHECK(held_reservations == 1);
+        second.gpr[a1] = hit ? 0x2002 : 0x2004;
+        run_from(second, 0x1200);
+        CHECK(held_reservations == (hit ? 0u : 1u));
+        first.gpr[a3] = 2;
+        run_from(first, 0x1100);
+        CHECK(first.gpr[a3] == (hit ? 1u : 0u));
+        CHECK(held_reservations == 0);
+    }
+}
+
+int main()
+{
+    const struct {
+        const char *name;
+        void (*run)();
+    } checks[] = {
+        {"unaligned ranges", check_unaligned_ranges},
+        {"unaligned elf", check_unaligned_elf},
+        {"unaligned image cache", check_unaligned_cache},
+        {"store clears reservation", check_store_clears_reservation},
+    };
+    bool failed = false;
+    for (auto check : checks)
+    {
+        check_failed = false;
+        check.run();
+        cout << check.name << ": " << (check_failed ? "FAILED" : "ok") << endl;
+        failed = failed || check_failed;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+// Standalone static disassembler: decodes every executable section of an
+// ELF without elaborating the SystemC model.
+//   rvdisasm.elf [-b] [-j threads] [-o output] [-cfg cfg.bin] file.elf
+//     -b   write the binary decode table instead of text
+//     -cfg also write the basic-block graph (see cfg.h)
+#include "elf_parser.h"
+#include "decode_block.h"
+#include "disasm.h"
+#include "rvc.h"
+#include "cfg.h"
+#include <thread>
+#include <atomic>
+
+#define DISASM_CHUNK_INSNS  (1 << 16)
+#define DISASM_TABLE_MAGIC  0x54445652  // "RVDT"
+#define DISASM_TABLE_VER    2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_count;
+    uint32_t entry_offset;  // entry point as an offset into the memory image
+}disasm_table_header;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t word;          // 32-bit instruction, RVC encodings expanded
+    uint32_t raw;           // encoding as stored in the image
+    int32_t opcode_id;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t shamt;
+    uint32_t imm;
+}disasm_record;
+
+typedef struct {
+    const region *section;
+    uint32_t first_byte;    // offsets into the section, on instruction boundaries
+    uint32_t end_byte;
+    uint32_t insn_count;
+    vector<char> out;
+    size_t out_len;
+}disasm_chunk;
+
+typedef struct {
+    vector<uint32_t> words;
+    vector<int32_t> compressed;     // original RVC encoding, -1 for 32-bit instructions
+    vector<uint32_t> addrs;
+    DecodedSoA soa;
+    RvcExpander rvc;
+}disasm_worker;
+
+static void disassemble_chunk(disasm_chunk &chunk, const uint8_t *mem, bool binary, disasm_worker &worker)
+{
+    const uint8_t *text = mem + chunk.section->region_base;
+    worker.words.resize(chunk.insn_count);
+    worker.compressed.resize(chunk.insn_count);
+    worker.addrs.resize(chunk.insn_count);
+    uint32_t offset = chunk.first_byte;
+    for (uint32_t i = 0; i < chunk.insn_count; i++)
+    {
+        uint16_t half;
+        memcpy(&half, text + offset, 2);
+        worker.addrs[i] = chunk.section->start_addr + offset;
+        if (RVC_IS_COMPRESSED(half))
+        {
+            worker.words[i] = worker.rvc.expand(half);
+            worker.compressed[i] = half;
+            offset += 2;
+        }
+        else
+        {
+            memcpy(&worker.words[i], text + offset, 4);
+            worker.compressed[i] = -1;
+            offset += 4;
+        }
+    }
+    DecodedSoA &soa = worker.soa;
+    decode_block(worker.words.data(), chunk.insn_count, soa);
+
+    if (binary)
+    {
+        chunk.out.resize(chunk.insn_count * sizeof(disasm_record));
+        disasm_record *rec = (disasm_record *)chunk.out.data();
+        for (uint32_t i = 0; i < chunk.insn_count; i++)
+        {
+            uint32_t word = worker.words[i];
+            rec[i] = {worker.addrs[i], word, worker.compressed[i] >= 0 ? (uint32_t)worker.compressed[i] : word, soa.opcode_id[i],
+                      (uint8_t)soa.rd[i], (uint8_t)soa.rs1[i], (uint8_t)soa.rs2[i], (uint8_t)soa.shamt[i],
+                      disasm_immediate(word)};
+        }
+        chunk.out_len = chunk.out.size();
+        return;
+    }
+    chunk.out.resize((size_t)chunk.insn_count * DISASM_MAX_LINE);
+    char *p = chunk.out.data();
+    for (uint32_t i = 0; i < chunk.insn_count; i++)
+        p += disasm_format(p, worker.addrs[i], worker.words[i], soa.opcode_id[i], worker.compressed[i]);
+    chunk.out_len = p - chunk.out.data();
+}
+
+int main(int argc, char *argv[])
+{
+    bool binary = false;
+    unsigned threads = thread::hardware_concurrency();
+    const char *out_file = NULL;
+    const char *elf_file = NULL;
+    const char *cfg_file = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-b"))
+            binary = true;
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out_file = argv[++i];
+        else if (!strcmp(argv[i], "-cfg") && i + 1 < argc)
+            cfg_file = argv[++i];
+        else
+            elf_file = argv[i];
+    }
+    if (elf_file == NULL)
+    {
+        cerr << "usage: " << argv[0] << " [-b] [-j threads] [-o output] [-cfg cfg.bin] file.elf" << endl;
+        return 1;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    uint8_t *mem = NULL;
+    uint32_t total_mem_size = 0;
+    uint32_t start_addr = 0;
+    ELFParser elf_parser(elf_file, &start_addr, &mem, &total_mem_size, false);
+    if (mem == NULL)
+    {
+        cerr << "Unable to load " << elf_file << endl;
+        return 1;
+    }
+
+    // split executable sections into chunks of DISASM_CHUNK_INSNS instructions;
+    // with RVC the boundaries are only known after a sequential length scan
+    vector<disasm_chunk> chunks;
+    uint32_t record_count = 0;
+    const vector<region> &regions = elf_parser.regmgr.get_regions();
+    for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+    {
+        if (!(reg_val->region_flags & SHF_EXECINSTR))
+            continue;
+        const uint8_t *text = mem + reg_val->region_base;
+        uint32_t offset = 0, chunk_start = 0, insns = 0;
+        while (offset + 2 <= reg_val->region_size)
+        {
+            uint32_t len = RVC_INST_LEN(text[offset]);
+            if (offset + len > reg_val->region_size)
+                break;
+            offset += len;
+            if (++insns == DISASM_CHUNK_INSNS)
+            {
+                chunks.push_back({&*reg_val, chunk_start, offset, insns, {}, 0});
+                chunk_start = offset;
+                insns = 0;
+            }
+        }
+        if (insns)
+            chunks.push_back({&*reg_val, chunk_start, offset, insns, {}, 0});
+        for (auto chunk = chunks.rbegin(); chunk != chunks.rend() && chunk->section == &*reg_val; chunk++)
+            record_count += chunk->insn_count;
+    }
+
+    // decode chunks on a pool of worker threads
+    atomic<size_t> next_chunk(0);
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.push_back(thread([&]() {
+            disasm_worker worker;
+            for (size_t c = next_chunk++; c < chunks.size(); c = next_chunk++)
+                disassemble_chunk(chunks[c], mem, binary, worker);
+        }));
+    }
+    for (auto worker = workers.begin(); worker != workers.end(); worker++)
+        worker->join();
+
+    FILE *out = out_file ? fopen(out_file, binary ? "wb" : "w") : stdout;
+    if (out == NULL)
+    {
+        cerr << "Unable to open " << out_file << endl;
+        delete[] mem;
+        return 1;
+    }
+    if (binary)
+    {
+        disasm_table_header header = {DISASM_TABLE_MAGIC, DISASM_TABLE_VER, record_count, start_addr};
+        fwrite(&header, sizeof(header), 1, out);
+    }
+    for (auto chunk = chunks.begin(); chunk != chunks.end(); chunk++)
+    {
+        if (!binary && chunk->first_byte == 0)
+            fprintf(out, "\nDisassembly of section %s:\n\n", chunk->section->region_name.c_str());
+        fwrite(chunk->out.data(), 1, chunk->out_len, out);
+    }
+    if (out != stdout)
+        fclose(out);
+    if (cfg_file)
+    {
+        ControlFlowGraph cfg;
+        cfg.build(mem, regions);
+        if (!cfg.write(cfg_file))
+            cerr << "Unable to write " << cfg_file << endl;
+        else
+            cerr << cfg_file << ": " << cfg.blocks.size() << " blocks, " << cfg.succs.size() << " edges" << endl;
+    }
+    delete[] mem;
+    return 0;
+}
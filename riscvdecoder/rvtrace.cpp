@@ -0,0 +1,53 @@
+// Renders a binary execution trace (riscvdecoder.elf -trace, exec_trace.h)
+// as the text the testbench prints per instruction.
+//   rvtrace.elf [-o output] trace.rvt
+#include "exec_trace.h"
+#include <string.h>
+
+int main(int argc, char *argv[])
+{
+    const char *trace_file = NULL;
+    const char *out_file = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out_file = argv[++i];
+        else
+            trace_file = argv[i];
+    }
+    if (trace_file == NULL)
+    {
+        fprintf(stderr, "usage: %s [-o output] trace.rvt\n", argv[0]);
+        return 1;
+    }
+    ExecTraceReader reader;
+    if (!reader.open(trace_file))
+    {
+        fprintf(stderr, "Unable to read %s\n", trace_file);
+        return 1;
+    }
+    FILE *out = out_file ? fopen(out_file, "w") : stdout;
+    if (out == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", out_file);
+        return 1;
+    }
+    static char out_buf[1 << 16];
+    setvbuf(out, out_buf, _IOFBF, sizeof(out_buf));
+
+    exec_trace_record rec;
+    uint64_t count = 0;
+    char line[EXEC_TRACE_TEXT_MAX];
+    while (reader.next(&rec))
+    {
+        fwrite(line, 1, exec_trace_format(line, sizeof(line), rec, rec.timestamp * reader.get_resolution_fs()), out);
+        count++;
+    }
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+    if (reader.truncated())
+        fprintf(stderr, "%s: trace ends inside a record after %llu records\n", trace_file, (unsigned long long)count);
+    return reader.truncated() ? 1 : 0;
+}
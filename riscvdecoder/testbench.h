@@ -0,0 +1,410 @@
+#ifndef __TESTBENCH__
+#define __TESTBENCH__
+#include <systemc.h>
+#include <tlm.h>
+#include <tlm_utils/simple_initiator_socket.h>
+#include <tlm_utils/tlm_quantumkeeper.h>
+#include <string.h>
+#include "rv_decoder.h"
+#include "rvc.h"
+#include "rv_core.h"
+#include "exec_trace.h"
+
+#define FETCH_QUANTUM_NS 1000
+#define CLOCK_PERIOD_NS  10
+
+// How the clocked (pin) path is driven:
+//   CLOCK_THREAD    an SC_THREAD toggles clk, two waits per cycle
+//   CLOCK_SC_CLOCK  an sc_clock drives the posedge-sensitive methods
+//   CLOCK_CYCLE     one method activation per cycle calls what the rising
+//                   edge triggers directly; no clock signal toggles
+enum clock_mode { CLOCK_THREAD, CLOCK_SC_CLOCK, CLOCK_CYCLE };
+static const char *clock_mode_names[] = {"thread", "sc_clock", "cycle"};
+
+inline bool clock_mode_by_name(const char *name, clock_mode *mode)
+{
+    for (int i = CLOCK_THREAD; i <= CLOCK_CYCLE; i++)
+        if (!strcmp(name, clock_mode_names[i]))
+        {
+            *mode = (clock_mode)i;
+            return true;
+        }
+    return false;
+}
+
+// an instruction put on the decoder's input, see Testbench::clock_edge
+typedef struct {
+    bool valid;
+    uint32_t pc;
+    uint32_t word;
+}fetch_stage;
+
+SC_MODULE(Testbench)
+{
+    tlm_utils::simple_initiator_socket<Testbench> fetch_socket;
+    RV_DECODER *rv_dec;
+    uint8_t *mem;
+    GuestMemory *guest = NULL;
+    sc_signal<bool> clk;
+    sc_signal<bool> reset;
+    sc_signal<sc_uint<32>> instruction;
+    uint32_t pc_val = 0;
+    sc_signal<sc_uint<32>> pc;
+    sc_signal<sc_uint<5>> rs1;
+    sc_signal<sc_uint<5>> rs2;
+    sc_signal<sc_uint<5>> rd;
+    sc_signal<sc_uint<32>> imm_12_itype;
+    sc_signal<sc_uint<32>> imm_12_sbtype;
+    sc_signal<sc_uint<32>> imm_20_ujtype;
+    sc_signal<sc_uint<32>> selected_imm;
+    sc_signal<sc_uint<32>> shift_amt;
+    sc_signal<sc_uint<32>> opcode_id;
+    sc_signal<DecodedInstr> decoded;
+    RvcExpander rvc;
+    uint32_t mem_size = 0;
+    bool tlm_mode = false;
+    bool packed_output = false;
+    bool verbose = true;
+    uint64_t fetched = 0;
+    RvCore *core = NULL;
+    bool exec_blocks = false;
+    ExecTrace *trace = NULL;
+    clock_mode clocking = CLOCK_THREAD;
+    sc_clock *sys_clock = NULL;
+    sc_signal_in_if<bool> *clock = &clk;     // what the posedge methods follow
+    vector<pair<uint32_t, uint32_t>> text;  // executable ranges, empty: run to the end of memory
+    bool stop_pending = false;
+    fetch_stage stages[2] = {};             // fetched two edges ago, one edge ago
+    int exit_status = 0;
+
+    void generate_clock_pulse()
+    {
+        if (tlm_mode)
+            return;
+        while (true)
+        {
+            clk.write(1);
+            wait(CLOCK_PERIOD_NS / 2, SC_NS);
+            clk.write(0);
+            wait(CLOCK_PERIOD_NS / 2, SC_NS);
+        }
+    }
+
+    // CLOCK_CYCLE: the decoder and the fetch side of one rising edge,
+    // then the next activation a period later
+    void run_cycles()
+    {
+        if (tlm_mode)
+            return;
+        rv_dec->perform_decoding();
+        clock_edge();
+        next_trigger(CLOCK_PERIOD_NS, SC_NS);
+    }
+
+    // Fetch the instruction at pc from the 16-bit aligned image; RVC
+    // encodings are expanded to 32 bits. Returns its length in bytes,
+    // or 0 once pc runs past the image.
+    uint32_t fetch_instruction(uint32_t pc, uint32_t *word)
+    {
+        uint16_t half;
+        if (guest)
+        {
+            if (!guest->read(pc, &half, 2))
+                return 0;
+            if (RVC_IS_COMPRESSED(half))
+            {
+                *word = rvc.expand(half);
+                return 2;
+            }
+            return guest->read(pc, word, 4) ? 4 : 0;
+        }
+        if (pc + 2 > mem_size)
+            return 0;
+        memcpy(&half, mem + pc, 2);
+        if (RVC_IS_COMPRESSED(half))
+        {
+            *word = rvc.expand(half);
+            return 2;
+        }
+        if (pc + 4 > mem_size)
+            return 0;
+        memcpy(word, mem + pc, 4);
+        return 4;
+    }
+
+    // Guest completion for the decode-only paths, which never see register
+    // values: pc leaving the text sections, or an ecall, ebreak or
+    // CSR_SIM_CTRL_EXIT whose value is in the instruction itself (csrrwi,
+    // csrrw from x0). Both are off until set_text().
+    bool in_text(uint32_t addr)
+    {
+        if (text.empty())
+            return true;
+        for (auto range = text.begin(); range != text.end(); range++)
+            if (addr >= range->first && addr < range->second)
+                return true;
+        return false;
+    }
+
+    bool program_ends(uint32_t word)
+    {
+        if (text.empty())
+            return false;
+        if (word == INST_ECALL || word == INST_EBREAK)
+            return true;
+        if ((word >> OPCODE_TYPEI_IMM_SHIFT) != CSR_SIM_CTRL)
+            return false;
+        uint32_t src = (word & OPCODE_RS1_MASK) >> OPCODE_RS1_SHIFT;
+        if ((word & INST_CSRRWI_MASK) == INST_CSRRWI)
+        {
+            exit_status = src;
+            return true;
+        }
+        return (word & INST_CSRRW_MASK) == INST_CSRRW && src == 0;
+    }
+
+    void decode_instruction()
+    {
+        if (clock->posedge())
+            clock_edge();
+    }
+
+    // An instruction and what the decoder made of it: into the binary
+    // trace, or printed in the same text rvtrace.elf renders the trace as.
+    void report(const sc_time &when, uint32_t addr, uint32_t word, const DecodedInstr &instr_out)
+    {
+        exec_trace_record rec = {when.value(), addr, word, instr_out.opcode_id, instr_out.selected_imm,
+                                 (uint8_t)instr_out.rs1, (uint8_t)instr_out.rs2, (uint8_t)instr_out.rd};
+        if (trace)
+        {
+            trace->record(rec.timestamp, rec.pc, rec.word, rec.opcode_id, rec.rs1, rec.rs2, rec.rd, rec.selected_imm);
+            return;
+        }
+        if (!verbose)
+            return;
+        char line[EXEC_TRACE_TEXT_MAX];
+        uint64_t resolution_fs = (uint64_t)(sc_get_time_resolution().to_seconds() * 1e15 + 0.5);
+        cout.write(line, exec_trace_format(line, sizeof(line), rec, rec.timestamp * resolution_fs));
+    }
+
+    // the decoder's pin outputs gathered up
+    DecodedInstr pin_outputs()
+    {
+        DecodedInstr instr_out;
+        instr_out.rs1 = rs1.read();
+        instr_out.rs2 = rs2.read();
+        instr_out.rd = rd.read();
+        instr_out.selected_imm = selected_imm.read();
+        instr_out.opcode_id = opcode_id.read();
+        return instr_out;
+    }
+
+    // Fetch side of a rising edge: next word onto the decoder's input,
+    // report of what the decoder produced. A word written on one edge is
+    // decoded on the next and the outputs show it from the one after, so
+    // the report is for the instruction fetched two edges ago; the clock
+    // stops (with set_text) once the last one has been reported.
+    void clock_edge()
+    {
+        if (stages[0].valid && (trace || verbose))
+            report(sc_time_stamp(), stages[0].pc, stages[0].word, packed_output ? decoded.read() : pin_outputs());
+        stages[0] = stages[1];
+        stages[1].valid = false;
+        uint32_t word;
+        uint32_t len = in_text(pc_val) && !stop_pending ? fetch_instruction(pc_val, &word) : 0;
+        if (len)
+        {
+            pc.write(pc_val);
+            instruction.write(word);
+            fetched++;
+            stages[1] = {true, pc_val, word};
+            stop_pending = program_ends(word);
+            pc_val = pc_val + len;
+        }
+        else if (!stages[0].valid && !text.empty())
+            sc_stop();
+    }
+
+    // Loosely-timed fetch: each word goes to the decoder through
+    // b_transport and time is only synchronised once per quantum.
+    void fetch_instructions()
+    {
+        if (!tlm_mode || exec_blocks)
+            return;
+        tlm::tlm_generic_payload trans;
+        decoded_instr_ext ext;
+        uint32_t word;
+        uint32_t len;
+        tlm_utils::tlm_quantumkeeper qkeeper;
+        qkeeper.reset();
+        trans.set_extension(&ext);
+        trans.set_command(tlm::TLM_WRITE_COMMAND);
+        trans.set_data_ptr((unsigned char *)&word);
+        trans.set_data_length(4);
+        trans.set_streaming_width(4);
+        if (core)
+            pc_val = core->pc;
+        while ((len = core ? core->fetch(pc_val, &word) : in_text(pc_val) ? fetch_instruction(pc_val, &word) : 0) != 0)
+        {
+            sc_time delay = qkeeper.get_local_time();
+            trans.set_address(pc_val);
+            trans.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+            fetch_socket->b_transport(trans, delay);
+            if (trans.is_response_error())
+                SC_REPORT_ERROR("Testbench", trans.get_response_string().c_str());
+            qkeeper.set(delay);
+            fetched++;
+            report(sc_time_stamp() + delay, pc_val, word, ext.instr);
+            // with an execute stage the next pc comes from the decoded instruction
+            if (core)
+                pc_val = core->execute(ext.instr, len);
+            else
+                pc_val = pc_val + len;
+            if (core ? core->halted : program_ends(word))
+                break;
+            if (qkeeper.need_sync())
+                qkeeper.sync();
+        }
+        trans.clear_extension(&ext);
+        qkeeper.sync();
+    }
+
+    // Predecoded-block execution, bypassing RV_DECODER: the core runs one
+    // quantum of instructions (DECODE_LATENCY_NS each) between syncs.
+    void run_core()
+    {
+        if (core == NULL || !exec_blocks)
+            return;
+        tlm_utils::tlm_quantumkeeper qkeeper;
+        qkeeper.reset();
+        while (!core->halted)
+        {
+            uint64_t insns = core->run(FETCH_QUANTUM_NS / DECODE_LATENCY_NS);
+            fetched += insns;
+            qkeeper.inc(sc_time((double)insns * DECODE_LATENCY_NS, SC_NS));
+            if (qkeeper.need_sync())
+                qkeeper.sync();
+        }
+        qkeeper.sync();
+    }
+
+    SC_CTOR(Testbench) : fetch_socket("fetch_socket"), clk("clk"), reset("reset"), instruction("instruction"), pc("pc"),
+                         rs1("rs1"), rs2("rs2"), rd("rd"), imm_12_itype("imm_12_itype"), imm_12_sbtype("imm_12_sbtype"),
+                         imm_20_ujtype("imm_20_ujtype"), selected_imm("selected_imm"), shift_amt("shift_amt"),
+                         opcode_id("opcode_id"), decoded("decoded")
+    {
+        rv_dec = new RV_DECODER("rv_decoder");
+        fetch_socket.bind(rv_dec->socket);
+        rv_dec->instr(instruction);
+        rv_dec->reset(reset);
+        rv_dec->rs1(rs1);
+        rv_dec->rs2(rs2);
+        rv_dec->rd(rd);
+        rv_dec->imm_12_itype(imm_12_itype);
+        rv_dec->imm_12_sbtype(imm_12_sbtype);
+        rv_dec->imm_20_ujtype(imm_20_ujtype);
+        rv_dec->selected_imm(selected_imm);
+        rv_dec->shift_amt(shift_amt);
+        rv_dec->opcode_id(opcode_id);
+        SC_THREAD(fetch_instructions);
+        SC_THREAD(run_core);
+    }
+
+    // The clock processes and the decoder's clock binding depend on the
+    // clock mode, so they are only set up once the options are known.
+    void before_end_of_elaboration()
+    {
+        // the loosely-timed paths end when nothing is pending, a free-running clock would keep them going
+        if (clocking == CLOCK_SC_CLOCK && !tlm_mode)
+        {
+            sys_clock = new sc_clock("sys_clock", CLOCK_PERIOD_NS, SC_NS, 0.5, 0, SC_NS, true);
+            clock = sys_clock;
+        }
+        rv_dec->clk(*clock);
+        if (clocking == CLOCK_THREAD)
+            SC_THREAD(generate_clock_pulse);
+        else if (clocking == CLOCK_CYCLE)
+        {
+            // nothing follows the clock, run_cycles calls what a rising edge would
+            SC_METHOD(run_cycles);
+            return;
+        }
+        SC_METHOD(decode_instruction);
+        sensitive << clock->posedge_event();
+    }
+    void init_mem(uint8_t * memptr, uint32_t start_addr, uint32_t total_mem_size)
+    {
+        mem = memptr;
+        mem_size = total_mem_size;
+        pc_val = start_addr;
+    }
+    // sparse memory at the section addresses, start_addr the entry point
+    void init_mem(GuestMemory *memory, uint32_t start_addr)
+    {
+        guest = memory;
+        mem_size = memory->mapped_size();
+        pc_val = start_addr;
+    }
+
+    // The executable regions of the image: the decode-only paths stop
+    // where the program ends (in_text, program_ends) instead of running on
+    // through the data and the clock running forever.
+    void set_text(const vector<region> &regions)
+    {
+        text.clear();
+        for (auto reg_val = regions.begin(); reg_val != regions.end(); reg_val++)
+            if (reg_val->region_flags & SHF_EXECINSTR)
+                text.push_back(make_pair(reg_val->start_addr, reg_val->end_addr));
+    }
+
+    void set_tlm_mode(bool enable)
+    {
+        tlm_mode = enable;
+    }
+
+    // Execute what is fetched: each instruction through RV_DECODER's TLM
+    // socket and RvCore::execute, or with blocks set, RvCore's predecoded
+    // blocks alone. Both use the loosely-timed path instead of the clock.
+    void set_exec_mode(RvCore *exec_core, bool blocks)
+    {
+        core = exec_core;
+        exec_blocks = blocks;
+        tlm_mode = true;
+    }
+
+    // Drop the per-instruction trace, e.g. when timing the model itself.
+    void set_verbose(bool enable)
+    {
+        verbose = enable;
+    }
+
+    // Must be called before sc_start.
+    void set_clock_mode(clock_mode mode)
+    {
+        clocking = mode;
+        // run_cycles is then the only process writing the decoder outputs
+        rv_dec->set_clocked(mode != CLOCK_CYCLE);
+    }
+
+    // Record each fetched instruction into the binary trace instead of
+    // printing it; rvtrace.elf turns the file back into text.
+    void set_trace(ExecTrace *exec_trace)
+    {
+        trace = exec_trace;
+    }
+
+    // Route the decoder outputs through the single packed signal. Must be
+    // called before sc_start, while ports can still be bound.
+    void set_packed_output()
+    {
+        rv_dec->decoded(decoded);
+        packed_output = true;
+    }
+
+    ~Testbench()
+    {
+        delete sys_clock;
+        delete rv_dec;
+    }
+};
+#endif
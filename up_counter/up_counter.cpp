@@ -1,8 +1,18 @@
 #include <systemc.h>
+#include "wave_tracer.h"
+#include <chrono>
+#include <string.h>
 
 using namespace std;
 
 #define NUM_COUNTERS 4
+#define CLOCK_PERIOD_NS 10
+
+// CLOCK_THREAD toggles clk from an SC_THREAD, CLOCK_SC_CLOCK uses an
+// sc_clock, CLOCK_CYCLE calls the rising-edge logic from one method
+// activation per cycle without any clock signal
+enum clock_mode { CLOCK_THREAD, CLOCK_SC_CLOCK, CLOCK_CYCLE };
+static const char *clock_mode_names[] = {"thread", "sc_clock", "cycle"};
 SC_MODULE(JK_FF)
 {
     // Ports
@@ -14,39 +24,64 @@ SC_MODULE(JK_FF)
     sc_out<bool> q_n;
 
     bool state;
+    bool clocked = true;
+    void next_state()
+    {
+        if (j.read() == 0 && k.read() == 0)
+        {
+            // no change
+        }
+        if (j.read() == 0 && k.read() == 1)
+        {
+            state = 0; // reset
+        }
+        if (j.read() == 1 && k.read() == 0)
+        {
+            state = 1; // set
+        }
+        if (j.read() == 1 && k.read() == 1)
+        {
+            state = !state; // toggle
+        }
+    }
+
     void set_state()
+    {
+        if (reset.read() == 1)
+            state = 0;
+        else if (clk.posedge())
+            next_state();
+        q.write(state);
+        q_n.write(!state);
+    }
+
+    // A rising edge without a clock signal (CLOCK_CYCLE). The caller's
+    // process then writes q, so set_state must not be registered as well.
+    void clock_edge()
     {
         if (reset.read() == 1)
             state = 0;
         else
-        {
-            if (clk.posedge())
-            {
-                if (j.read() == 0 && k.read() == 0)
-                {
-                    // no change
-                }
-                if (j.read() == 0 && k.read() == 1)
-                {
-                    state = 0; // reset
-                }
-                if (j.read() == 1 && k.read() == 0)
-                {
-                    state = 1; // set
-                }
-                if (j.read() == 1 && k.read() == 1)
-                {
-                    state = !state; // toggle
-                }
-            }
-        }
+            next_state();
         q.write(state);
         q_n.write(!state);
     }
 
-    SC_CTOR(JK_FF)
+    SC_CTOR(JK_FF) : j("j"), k("k"), clk("clk"), reset("reset"), q("q"), q_n("q_n")
     {
         state = 0;
+    }
+
+    // false when clock_edge drives the flip-flop instead; before sc_start
+    void set_clocked(bool enable)
+    {
+        clocked = enable;
+    }
+
+    void before_end_of_elaboration()
+    {
+        if (!clocked)
+            return;
         SC_METHOD(set_state);
         sensitive << clk.pos();
         sensitive << reset;
@@ -58,8 +93,8 @@ SC_MODULE(UpCounter)
     sc_in<bool> clk;
     sc_in<bool> reset;
     sc_out<sc_uint<4>> count;
-    sc_signal<bool> q[4], qn[4];
-    sc_signal<bool> j[4], k[4];
+    sc_vector<sc_signal<bool>> q, qn;
+    sc_vector<sc_signal<bool>> j, k;
     JK_FF *jk_ff[4];
     void counter_logic()
     {   
@@ -82,7 +117,8 @@ SC_MODULE(UpCounter)
         count.write(cnt);
     }
 
-    SC_CTOR(UpCounter)
+    SC_CTOR(UpCounter) : clk("clk"), reset("reset"), count("count"), q("q", NUM_COUNTERS), qn("qn", NUM_COUNTERS),
+                         j("j", NUM_COUNTERS), k("k", NUM_COUNTERS)
     {
         for (int i = 0; i < NUM_COUNTERS; i++)
         {
@@ -103,6 +139,18 @@ SC_MODULE(UpCounter)
         }
     }
 
+    void clock_edge()
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+            jk_ff[i]->clock_edge();
+    }
+
+    void set_clocked(bool enable)
+    {
+        for (int i = 0; i < NUM_COUNTERS; i++)
+            jk_ff[i]->set_clocked(enable);
+    }
+
     ~UpCounter()
     {
         for (int i = 0; i < NUM_COUNTERS; i++)
@@ -118,17 +166,32 @@ SC_MODULE(Testbench)
     sc_signal<bool> clk;
     sc_signal<bool> reset;
     sc_signal<sc_uint<4>> count;
+    clock_mode clocking = CLOCK_THREAD;
+    sc_clock *sys_clock = NULL;
+    sc_signal_in_if<bool> *clock = &clk;
+    bool quiet = false;
     void generate_clock()
     {
         while (true)
         {
             clk.write(0);
-            wait(5, SC_NS);
+            wait(CLOCK_PERIOD_NS / 2, SC_NS);
             clk.write(1);
-            wait(5, SC_NS);
+            wait(CLOCK_PERIOD_NS / 2, SC_NS);
         }
     }
 
+    // rising edges at the same times as generate_clock's
+    void run_cycles()
+    {
+        if (sc_time_stamp() != SC_ZERO_TIME)
+        {
+            upcntr->clock_edge();
+            monitor();
+        }
+        next_trigger(sc_time_stamp() == SC_ZERO_TIME ? CLOCK_PERIOD_NS / 2 : CLOCK_PERIOD_NS, SC_NS);
+    }
+
     void reset_gen()
     {
        // reset.write(1);
@@ -138,31 +201,84 @@ SC_MODULE(Testbench)
 
     void monitor()
     {
-        cout << "Timestamp: " << sc_time_stamp() << " | Reset " << reset.read() << " | Count: " << count.read() << endl;
+        if (!quiet)
+            cout << "Timestamp: " << sc_time_stamp() << " | Reset " << reset.read() << " | Count: " << count.read() << endl;
     }
 
-    SC_CTOR(Testbench)
+    SC_CTOR(Testbench) : clk("clk"), reset("reset"), count("count")
     {
         upcntr = new UpCounter("upcounter");
-        upcntr->clk(clk);
         upcntr->reset(reset);
         upcntr->count(count);
-        SC_THREAD(generate_clock);
         SC_THREAD(reset_gen);
+    }
+
+    // before sc_start
+    bool set_clock_mode(const char *name)
+    {
+        for (int i = CLOCK_THREAD; i <= CLOCK_CYCLE; i++)
+            if (!strcmp(name, clock_mode_names[i]))
+            {
+                clocking = (clock_mode)i;
+                // run_cycles is then the only process writing the flip-flop outputs
+                upcntr->set_clocked(clocking != CLOCK_CYCLE);
+                return true;
+            }
+        return false;
+    }
+
+    // the clock is chosen after construction, so it is bound here
+    void before_end_of_elaboration()
+    {
+        if (clocking == CLOCK_SC_CLOCK)
+        {
+            sys_clock = new sc_clock("sys_clock", CLOCK_PERIOD_NS, SC_NS, 0.5, CLOCK_PERIOD_NS / 2, SC_NS, true);
+            clock = sys_clock;
+        }
+        upcntr->clk(*clock);
+        if (clocking == CLOCK_THREAD)
+            SC_THREAD(generate_clock);
+        else if (clocking == CLOCK_CYCLE)
+            SC_METHOD(run_cycles);
         SC_METHOD(monitor);
-        sensitive << clk.posedge_event();
+        sensitive << clock->posedge_event();
     }
 
     ~Testbench()
     {
         delete upcntr;
+        delete sys_clock;
     }
     
 };
 
 int sc_main(int argc, char *argv[])
 {
+    // upcounter.elf [-clock thread|sc_clock|cycle] [-cycles n] [-quiet] [-wave options]
+    // -quiet drops the per-cycle output and reports simulated cycles per second instead
     Testbench tb("tb");
-    sc_start(200, SC_NS);
+    WaveTracer waves("waves");
+    uint64_t cycles = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-clock") && i + 1 < argc)
+        {
+            if (!tb.set_clock_mode(argv[++i]))
+                cout << "Unknown clock mode " << argv[i] << ", using thread" << endl;
+        }
+        else if (!strcmp(argv[i], "-cycles") && i + 1 < argc)
+            cycles = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-quiet"))
+            tb.quiet = true;
+        else
+            waves.parse_option(argc, argv, i);
+    }
+    auto start = chrono::steady_clock::now();
+    sc_start((double)cycles * CLOCK_PERIOD_NS, SC_NS);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    waves.close();
+    if (tb.quiet)
+        cout << cycles << " cycles in " << elapsed.count() << " s, " << cycles / elapsed.count() / 1e6
+             << " Mcycles/s with the " << clock_mode_names[tb.clocking] << " clock" << endl;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef __VARINT__
+#define __VARINT__
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+//--------------------------------------------------------------------
+// LEB128-style unsigned varints, 7 bits per byte with the high bit set on
+// all but the last, shared by the compact waveform (.rvw) and execution
+// trace (.rvt) files; a uint64_t takes at most 10 bytes.
+//--------------------------------------------------------------------
+static inline size_t put_varint(uint8_t *buf, uint64_t value)
+{
+    size_t len = 0;
+    while (value >= 0x80)
+    {
+        buf[len++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t)value;
+    return len;
+}
+
+// false at end of file; sets partial when the file ends inside a varint
+// (or before it, unless first: the record it starts was already begun)
+static inline bool get_varint(FILE *in, uint64_t *value, bool *partial, bool first)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = getc(in);
+        if (byte == EOF)
+        {
+            *partial = !first || shift != 0;
+            return false;
+        }
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return true;
+        }
+    }
+    *partial = true;
+    return false;
+}
+#endif
@@ -0,0 +1,46 @@
+// Converts a compact waveform file (-wave file.rvw, wave_writer.h) to VCD
+// for a waveform viewer.
+//   wave2vcd.elf input.rvw output.vcd
+#include "wave_writer.h"
+#include <iostream>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        cerr << "usage: " << argv[0] << " input.rvw output.vcd" << endl;
+        return 1;
+    }
+    CompactWaveReader reader;
+    if (!reader.open(argv[1]))
+    {
+        cerr << "Unable to read " << argv[1] << endl;
+        return 1;
+    }
+    FILE *file = fopen(argv[2], "wb");
+    if (file == NULL)
+    {
+        cerr << "Unable to open " << argv[2] << endl;
+        return 1;
+    }
+    VcdWriter vcd(file, WAVE_DEFAULT_BUFFER);
+    const vector<wave_signal> &signals = reader.get_signals();
+    for (auto signal = signals.begin(); signal != signals.end(); signal++)
+        vcd.add_signal(signal->name, signal->width);
+    vcd.begin(reader.get_resolution_fs());
+    uint64_t time, value, changes = 0;
+    uint32_t index;
+    while (reader.next(&time, &index, &value))
+    {
+        vcd.change(time, index, value);
+        changes++;
+    }
+    if (!vcd.close())
+    {
+        cerr << "Unable to write " << argv[2] << endl;
+        return 1;
+    }
+    if (reader.truncated())
+        cerr << argv[1] << ": damaged after " << changes << " changes" << endl;
+    return reader.truncated() ? 1 : 0;
+}
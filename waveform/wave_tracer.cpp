@@ -0,0 +1,203 @@
+#define SC_INCLUDE_DYNAMIC_PROCESSES    // sc_spawn for the probes
+#include "wave_tracer.h"
+#include <fnmatch.h>
+#include <string.h>
+
+WaveTracer::WaveTracer(sc_module_name name) : sc_module(name)
+{
+    buffer_size = WAVE_DEFAULT_BUFFER;
+    list = false;
+    writer = NULL;
+    recording = false;
+    SC_THREAD(window);
+}
+
+WaveTracer::~WaveTracer()
+{
+    close();
+}
+
+bool WaveTracer::parse_option(int argc, char *argv[], int &i)
+{
+    if (strncmp(argv[i], "-wave", 5))
+        return false;
+    if (!strcmp(argv[i], "-wave-list"))
+        set_list(true);
+    else if (i + 1 >= argc)
+        return false;
+    else if (!strcmp(argv[i], "-wave"))
+        set_file(argv[++i]);
+    else if (!strcmp(argv[i], "-wave-signals"))
+        add_signals(argv[++i]);
+    else if (!strcmp(argv[i], "-wave-start"))
+        start_time = sc_time(atof(argv[++i]), SC_NS);
+    else if (!strcmp(argv[i], "-wave-stop"))
+        stop_time = sc_time(atof(argv[++i]), SC_NS);
+    else if (!strcmp(argv[i], "-wave-buffer"))
+        set_buffer_size((size_t)atoi(argv[++i]) << 10);
+    else
+        return false;
+    return true;
+}
+
+void WaveTracer::set_file(const char *path)
+{
+    file = path;
+}
+
+void WaveTracer::add_signals(const char *globs)
+{
+    string all = globs;
+    size_t start = 0;
+    while (start <= all.size())
+    {
+        size_t comma = all.find(',', start);
+        if (comma == string::npos)
+            comma = all.size();
+        if (comma > start)
+            patterns.push_back(all.substr(start, comma - start));
+        start = comma + 1;
+    }
+}
+
+void WaveTracer::set_window(const sc_time &start, const sc_time &stop)
+{
+    start_time = start;
+    stop_time = stop;
+}
+
+void WaveTracer::set_buffer_size(size_t size)
+{
+    buffer_size = size;
+}
+
+void WaveTracer::set_list(bool enable)
+{
+    list = enable;
+}
+
+bool WaveTracer::close()
+{
+    recording = false;
+    if (writer == NULL)
+        return true;
+    bool ok = writer->close();
+    delete writer;
+    writer = NULL;
+    if (!ok)
+        cout << "Unable to write " << file << endl;
+    return ok;
+}
+
+bool WaveTracer::matches(const string &name)
+{
+    if (patterns.empty())
+        return true;
+    for (auto pattern = patterns.begin(); pattern != patterns.end(); pattern++)
+        if (fnmatch(pattern->c_str(), name.c_str(), 0) == 0)
+            return true;
+    return false;
+}
+
+// every channel and bound port under objects, by hierarchical name
+void WaveTracer::collect(const vector<sc_object *> &objects, vector<pair<string, sc_interface *>> &found)
+{
+    for (auto obj = objects.begin(); obj != objects.end(); obj++)
+    {
+        if (*obj == this)
+            continue;
+        sc_interface *iface = dynamic_cast<sc_interface *>(*obj);
+        sc_port_base *port = dynamic_cast<sc_port_base *>(*obj);
+        if (port != NULL)
+            iface = port->get_interface();
+        if (iface != NULL)
+            found.push_back(make_pair(string((*obj)->name()), iface));
+        collect((*obj)->get_child_objects(), found);
+    }
+}
+
+template <typename T> void WaveTracer::sample(const sc_signal_in_if<T> *sig, uint32_t index)
+{
+    record(index, (uint64_t)sig->read());
+}
+
+template <typename T> bool WaveTracer::probe(const string &name, sc_interface *iface, uint32_t width)
+{
+    const sc_signal_in_if<T> *sig = dynamic_cast<const sc_signal_in_if<T> *>(iface);
+    if (sig == NULL)
+        return false;
+    if (list)
+        cout << name << " [" << width << "]" << endl;
+    if (writer == NULL || !matches(name))
+        return true;
+    uint32_t index = writer->add_signal(name, width);
+    last.push_back(0);
+    current.push_back([sig]() { return (uint64_t)sig->read(); });
+    sc_spawn_options options;
+    options.spawn_method();
+    options.dont_initialize();
+    options.set_sensitivity(&sig->value_changed_event());
+    sc_spawn(sc_bind(&WaveTracer::sample<T>, this, sig, index), sc_gen_unique_name("probe"), &options);
+    return true;
+}
+
+template <int W> bool WaveTracer::probe_uint(const string &name, sc_interface *iface)
+{
+    return probe<sc_uint<W>>(name, iface, W) || probe_uint<W - 1>(name, iface);
+}
+
+template <> bool WaveTracer::probe_uint<0>(const string &name, sc_interface *iface)
+{
+    return false;
+}
+
+bool WaveTracer::probe_any(const string &name, sc_interface *iface)
+{
+    return probe<bool>(name, iface, 1) || probe_uint<64>(name, iface) ||
+           probe<uint8_t>(name, iface, 8) || probe<int8_t>(name, iface, 8) ||
+           probe<uint16_t>(name, iface, 16) || probe<int16_t>(name, iface, 16) ||
+           probe<uint32_t>(name, iface, 32) || probe<int32_t>(name, iface, 32) ||
+           probe<uint64_t>(name, iface, 64) || probe<int64_t>(name, iface, 64);
+}
+
+void WaveTracer::end_of_elaboration()
+{
+    if (!file.empty())
+    {
+        writer = WaveWriter::create(file.c_str(), buffer_size);
+        if (writer == NULL)
+            cout << "Unable to write " << file << endl;
+    }
+    if (writer == NULL && !list)
+        return;
+    // walk first, spawning adds objects to the hierarchy
+    vector<pair<string, sc_interface *>> found;
+    collect(sc_get_top_level_objects(), found);
+    for (auto obj = found.begin(); obj != found.end(); obj++)
+        probe_any(obj->first, obj->second);
+    if (writer == NULL)
+        return;
+    writer->begin((uint64_t)(sc_get_time_resolution().to_seconds() * 1e15 + 0.5));
+    if (writer->get_signals().empty())
+        cout << "No signals match -wave-signals" << endl;
+}
+
+void WaveTracer::window()
+{
+    if (writer == NULL)
+        return;
+    if (start_time > SC_ZERO_TIME)
+        wait(start_time);
+    recording = true;
+    uint64_t now = sc_time_stamp().value();
+    for (uint32_t i = 0; i < current.size(); i++)
+    {
+        last[i] = current[i]();
+        writer->change(now, i, last[i]);
+    }
+    if (stop_time <= start_time)
+        return;
+    wait(stop_time - start_time);
+    recording = false;
+    writer->flush();
+}
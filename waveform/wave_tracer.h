@@ -0,0 +1,70 @@
+#ifndef __WAVE_TRACER__
+#define __WAVE_TRACER__
+#include <systemc.h>
+#include <functional>
+#include "wave_writer.h"
+
+//--------------------------------------------------------------------
+// Waveform tracing selected at run time. After elaboration every signal
+// and bound port whose hierarchical name matches one of the globs gets
+// a small method process that records its value changes; nothing else
+// is watched, so signals left out cost nothing. Changes are recorded
+// only inside the start/stop window, starting with a snapshot of every
+// traced value at the start time.
+//
+// Values are bool, sc_uint<1..64> and the integer types up to 64 bits.
+// Create one WaveTracer before sc_start and hand it the command line:
+//   -wave file          .vcd writes VCD, anything else the compact format
+//   -wave-signals globs comma separated, e.g. tb.upcounter.q*,tb.rv_decoder.opcode_id
+//                       (default every signal)
+//   -wave-start ns      -wave-stop ns   record only inside this window
+//   -wave-buffer kb     write buffer size
+//   -wave-list          print the traceable names and widths
+//--------------------------------------------------------------------
+SC_MODULE(WaveTracer)
+{
+public:
+    SC_HAS_PROCESS(WaveTracer);
+    WaveTracer(sc_module_name name);
+    ~WaveTracer();
+
+    // consumes the -wave option at argv[i] and its argument, if it is one
+    bool parse_option(int argc, char *argv[], int &i);
+    void set_file(const char *path);
+    void add_signals(const char *globs);
+    // a zero stop time means no end
+    void set_window(const sc_time &start, const sc_time &stop);
+    void set_buffer_size(size_t size);
+    void set_list(bool enable);
+    // flushes and closes the file; false if anything failed to be written
+    bool close();
+
+protected:
+    void end_of_elaboration();
+    void window();
+    bool matches(const string &name);
+    void collect(const vector<sc_object *> &objects, vector<pair<string, sc_interface *>> &found);
+    bool probe_any(const string &name, sc_interface *iface);
+    template <typename T> bool probe(const string &name, sc_interface *iface, uint32_t width);
+    template <int W> bool probe_uint(const string &name, sc_interface *iface);
+    template <typename T> void sample(const sc_signal_in_if<T> *sig, uint32_t index);
+    inline void record(uint32_t index, uint64_t value)
+    {
+        if (!recording || last[index] == value)
+            return;
+        last[index] = value;
+        writer->change(sc_time_stamp().value(), index, value);
+    }
+
+    string file;
+    vector<string> patterns;
+    sc_time start_time;
+    sc_time stop_time;
+    size_t buffer_size;
+    bool list;
+    WaveWriter *writer;
+    bool recording;
+    vector<uint64_t> last;                      // last value written, per signal
+    vector<function<uint64_t()>> current;       // reads the value now, for the snapshot
+};
+#endif
@@ -0,0 +1,268 @@
+#include "wave_writer.h"
+#include "varint.h"
+#include <string.h>
+#include <algorithm>
+
+//--------------------------------------------------------------------
+// WaveWriter
+//--------------------------------------------------------------------
+WaveWriter::WaveWriter(FILE *file, size_t buffer_size)
+{
+    out = file;
+    buffer.resize(max(buffer_size, (size_t)WAVE_MAX_ENTRY * 2));
+    used = 0;
+    failed = false;
+    last_time = 0;
+    started = false;
+}
+
+WaveWriter::~WaveWriter()
+{
+    close();
+}
+
+WaveWriter *WaveWriter::create(const char *path, size_t buffer_size)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return NULL;
+    size_t len = strlen(path);
+    if (len >= 4 && !strcmp(path + len - 4, ".vcd"))
+        return new VcdWriter(file, buffer_size);
+    return new CompactWaveWriter(file, buffer_size);
+}
+
+uint32_t WaveWriter::add_signal(const string &name, uint32_t width)
+{
+    signals.push_back({name, width});
+    return signals.size() - 1;
+}
+
+void WaveWriter::put(const void *data, size_t len)
+{
+    if (used + len > buffer.size())
+        flush();
+    if (len > buffer.size())
+    {
+        failed |= fwrite(data, 1, len, out) != len;
+        return;
+    }
+    memcpy(buffer.data() + used, data, len);
+    used += len;
+}
+
+void WaveWriter::flush()
+{
+    if (out == NULL || used == 0)
+        return;
+    failed |= fwrite(buffer.data(), 1, used, out) != used;
+    used = 0;
+}
+
+bool WaveWriter::close()
+{
+    if (out == NULL)
+        return !failed;
+    flush();
+    failed |= fclose(out) != 0;
+    out = NULL;
+    return !failed;
+}
+
+//--------------------------------------------------------------------
+// VcdWriter
+//--------------------------------------------------------------------
+void VcdWriter::begin(uint64_t resolution_fs)
+{
+    // VCD time units are 1, 10 or 100 of fs .. s
+    static const char *units[] = {"fs", "ps", "ns", "us", "ms", "s"};
+    uint64_t scale = resolution_fs ? resolution_fs : 1;
+    int unit = 0;
+    while (unit < 5 && scale % 1000 == 0)
+    {
+        scale /= 1000;
+        unit++;
+    }
+    time_multiplier = 1;
+    if (scale != 1 && scale != 10 && scale != 100)
+    {
+        // not expressible, write fs
+        time_multiplier = resolution_fs ? resolution_fs : 1;
+        scale = 1;
+        unit = 0;
+    }
+    string header = "$version riscvdecoder waveform $end\n$timescale " + to_string(scale) + " " + units[unit] + " $end\n";
+
+    // identifier codes from the printable range, shortest first
+    codes.resize(signals.size());
+    for (size_t i = 0; i < signals.size(); i++)
+    {
+        size_t n = i;
+        do
+        {
+            codes[i] += (char)('!' + n % 94);
+            n /= 94;
+        } while (n);
+    }
+
+    // one $scope per name component, signals sorted so each scope is opened once
+    vector<uint32_t> order(signals.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return signals[a].name < signals[b].name; });
+    vector<string> open_scopes;
+    for (auto index = order.begin(); index != order.end(); index++)
+    {
+        vector<string> path;
+        const string &name = signals[*index].name;
+        size_t start = 0, dot;
+        while ((dot = name.find('.', start)) != string::npos)
+        {
+            path.push_back(name.substr(start, dot - start));
+            start = dot + 1;
+        }
+        size_t common = 0;
+        while (common < open_scopes.size() && common < path.size() && open_scopes[common] == path[common])
+            common++;
+        for (size_t i = open_scopes.size(); i > common; i--)
+            header += "$upscope $end\n";
+        open_scopes.resize(common);
+        for (size_t i = common; i < path.size(); i++)
+        {
+            header += "$scope module " + path[i] + " $end\n";
+            open_scopes.push_back(path[i]);
+        }
+        header += "$var wire " + to_string(signals[*index].width) + " " + codes[*index] + " " + name.substr(start) + " $end\n";
+    }
+    for (size_t i = 0; i < open_scopes.size(); i++)
+        header += "$upscope $end\n";
+    header += "$enddefinitions $end\n";
+    put(header.data(), header.size());
+    started = false;
+}
+
+void VcdWriter::change(uint64_t time, uint32_t index, uint64_t value)
+{
+    if (!started || time != last_time)
+    {
+        uint8_t *buf = reserve(24);
+        used += snprintf((char *)buf, 24, "#%llu\n", (unsigned long long)(time * time_multiplier));
+        last_time = time;
+        started = true;
+    }
+    const wave_signal &signal = signals[index];
+    const string &code = codes[index];
+    char *buf = (char *)reserve(WAVE_MAX_ENTRY);
+    size_t len = 0;
+    if (signal.width == 1)
+        buf[len++] = '0' + (value & 1);
+    else
+    {
+        // leading zeros dropped, VCD extends with zeros
+        buf[len++] = 'b';
+        int bit = signal.width - 1;
+        while (bit > 0 && !((value >> bit) & 1))
+            bit--;
+        for (; bit >= 0; bit--)
+            buf[len++] = '0' + ((value >> bit) & 1);
+        buf[len++] = ' ';
+    }
+    memcpy(buf + len, code.data(), code.size());
+    len += code.size();
+    buf[len++] = '\n';
+    used += len;
+}
+
+//--------------------------------------------------------------------
+// CompactWaveWriter
+//--------------------------------------------------------------------
+void CompactWaveWriter::begin(uint64_t resolution_fs)
+{
+    wave_file_header header = {WAVE_COMPACT_MAGIC, WAVE_COMPACT_VER, resolution_fs, (uint32_t)signals.size(), 0};
+    put(&header, sizeof(header));
+    for (auto signal = signals.begin(); signal != signals.end(); signal++)
+    {
+        uint32_t desc[2] = {signal->width, (uint32_t)signal->name.size()};
+        put(desc, sizeof(desc));
+        put(signal->name.data(), signal->name.size());
+    }
+    last_time = 0;
+}
+
+void CompactWaveWriter::change(uint64_t time, uint32_t index, uint64_t value)
+{
+    uint8_t *buf = reserve(WAVE_MAX_ENTRY);
+    size_t len;
+    if (time != last_time)
+    {
+        len = put_varint(buf, (uint64_t)index << 1 | 1);
+        len += put_varint(buf + len, time - last_time);
+        last_time = time;
+    }
+    else
+        len = put_varint(buf, (uint64_t)index << 1);
+    len += put_varint(buf + len, value);
+    used += len;
+}
+
+//--------------------------------------------------------------------
+// CompactWaveReader
+//--------------------------------------------------------------------
+CompactWaveReader::CompactWaveReader()
+{
+    in = NULL;
+    memset(&header, 0, sizeof(header));
+    last_time = 0;
+    partial = false;
+}
+
+CompactWaveReader::~CompactWaveReader()
+{
+    if (in != NULL)
+        fclose(in);
+}
+
+bool CompactWaveReader::open(const char *path)
+{
+    in = fopen(path, "rb");
+    if (in == NULL)
+        return false;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 && header.magic == WAVE_COMPACT_MAGIC &&
+              header.version == WAVE_COMPACT_VER;
+    for (uint32_t i = 0; ok && i < header.signal_count; i++)
+    {
+        uint32_t desc[2];
+        ok = fread(desc, sizeof(desc), 1, in) == 1 && desc[0] >= 1 && desc[0] <= 64;
+        if (!ok)
+            break;
+        string name(desc[1], '\0');
+        ok = fread(&name[0], 1, desc[1], in) == desc[1];
+        signals.push_back({name, desc[0]});
+    }
+    if (!ok)
+    {
+        fclose(in);
+        in = NULL;
+    }
+    return ok;
+}
+
+bool CompactWaveReader::next(uint64_t *time, uint32_t *index, uint64_t *value)
+{
+    uint64_t tag, delta = 0;
+    if (in == NULL || partial || !get_varint(in, &tag, &partial, true))
+        return false;
+    if ((tag & 1) && !get_varint(in, &delta, &partial, false))
+        return false;
+    if (!get_varint(in, value, &partial, false))
+        return false;
+    if ((tag >> 1) >= signals.size())
+    {
+        partial = true;
+        return false;
+    }
+    last_time += delta;
+    *time = last_time;
+    *index = tag >> 1;
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef __WAVE_WRITER__
+#define __WAVE_WRITER__
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+//--------------------------------------------------------------------
+// Waveform file writers, independent of SystemC so that offline tools
+// can use them too. Signals are added first, then begin() writes the
+// header and change() records value changes in time order. Output goes
+// through one large buffer and is written only when it fills up.
+//
+// Two formats: VCD, and a compact binary one for long runs:
+//   wave_file_header, then per signal uint32_t width, uint32_t name
+//   length and the name, then one entry per change:
+//     varint  index << 1 | 1 if time advanced
+//     varint  time - previous time, only if it advanced
+//     varint  value
+// wave2vcd.elf converts a compact file to VCD.
+//--------------------------------------------------------------------
+#define WAVE_COMPACT_MAGIC      0x56575652  // "RVWV"
+#define WAVE_COMPACT_VER        1
+#define WAVE_DEFAULT_BUFFER     (4 << 20)
+#define WAVE_MAX_ENTRY          72          // longest VCD or compact entry
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t resolution_fs;     // length of one time unit
+    uint32_t signal_count;
+    uint32_t reserved;
+}wave_file_header;
+
+typedef struct {
+    string name;                // hierarchical, '.' separated
+    uint32_t width;             // 1 to 64 bits
+}wave_signal;
+
+class WaveWriter
+{
+public:
+    virtual ~WaveWriter();
+    // VCD for paths ending in ".vcd", compact otherwise; NULL if path
+    // cannot be created
+    static WaveWriter *create(const char *path, size_t buffer_size = WAVE_DEFAULT_BUFFER);
+
+    uint32_t add_signal(const string &name, uint32_t width);
+    const vector<wave_signal> &get_signals() { return signals; }
+    virtual void begin(uint64_t resolution_fs) = 0;
+    virtual void change(uint64_t time, uint32_t index, uint64_t value) = 0;
+    void flush();
+    // false if anything failed to be written
+    bool close();
+
+protected:
+    WaveWriter(FILE *file, size_t buffer_size);
+    inline uint8_t *reserve(size_t len)
+    {
+        if (used + len > buffer.size())
+            flush();
+        return buffer.data() + used;
+    }
+    void put(const void *data, size_t len);
+
+    FILE *out;
+    vector<uint8_t> buffer;
+    size_t used;
+    bool failed;
+    vector<wave_signal> signals;
+    uint64_t last_time;
+    bool started;
+};
+
+class VcdWriter : public WaveWriter
+{
+public:
+    VcdWriter(FILE *file, size_t buffer_size) : WaveWriter(file, buffer_size) {}
+    void begin(uint64_t resolution_fs);
+    void change(uint64_t time, uint32_t index, uint64_t value);
+
+protected:
+    vector<string> codes;       // identifier code per signal
+    uint64_t time_multiplier;   // VCD time units per resolution unit
+};
+
+class CompactWaveWriter : public WaveWriter
+{
+public:
+    CompactWaveWriter(FILE *file, size_t buffer_size) : WaveWriter(file, buffer_size) {}
+    void begin(uint64_t resolution_fs);
+    void change(uint64_t time, uint32_t index, uint64_t value);
+};
+
+class CompactWaveReader
+{
+public:
+    CompactWaveReader();
+    ~CompactWaveReader();
+    bool open(const char *path);
+    const vector<wave_signal> &get_signals() { return signals; }
+    uint64_t get_resolution_fs() { return header.resolution_fs; }
+    // false at the end of the file, or on a damaged entry (truncated())
+    bool next(uint64_t *time, uint32_t *index, uint64_t *value);
+    bool truncated() { return partial; }
+
+protected:
+    FILE *in;
+    wave_file_header header;
+    vector<wave_signal> signals;
+    uint64_t last_time;
+    bool partial;
+};
+#endif